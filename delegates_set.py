@@ -4,6 +4,7 @@ import time
 import datetime
 import os
 import csv
+import ctypes
 import numpy.typing as npt
 from enum import IntEnum
 from typing import List, Tuple
@@ -52,6 +53,7 @@ class OperationMode(IntEnum):
     none = 0
     weights = 1
     convolution = 2
+    image_weights = 3
 
 def get_operation_mode(operation_mode : OperationMode) -> str:
     """ Gets the operation mode in string """
@@ -62,6 +64,8 @@ def get_operation_mode(operation_mode : OperationMode) -> str:
             return "weights"
         case OperationMode.convolution:
             return "convolution"
+        case OperationMode.image_weights:
+            return "image weights"
         case _ :
             return "error"
 
@@ -70,11 +74,32 @@ def get_bits_size(operation_mode: OperationMode) -> int:
     match operation_mode:
         case OperationMode.convolution:
             return 32
-        case OperationMode.weights:
+        case OperationMode.weights | OperationMode.image_weights:
             return 8
         case _ :
             return -1
 
+def configure_delegate(delegate: tf.lite.experimental.Delegate, bit_position: int, number_flips: int, seed: int) -> None:
+    """ Changes the fault options of a live delegate:
+    - The interpreter keeps its tensors, the fault plan is rebuilt on the next invoke
+    """
+    library = delegate._library
+    library.tflite_plugin_set_bit_position.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    library.tflite_plugin_set_number_flips.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    library.tflite_plugin_set_seed.argtypes = [ctypes.c_void_p, ctypes.c_ulonglong]
+    library.tflite_plugin_set_bit_position(delegate._get_native_delegate_pointer(), bit_position)
+    library.tflite_plugin_set_number_flips(delegate._get_native_delegate_pointer(), number_flips)
+    library.tflite_plugin_set_seed(delegate._get_native_delegate_pointer(), seed)
+
+def flip_weights(delegate: tf.lite.experimental.Delegate) -> None:
+    """ Restores the weights of a weights mode delegate and flips a new set:
+    - Uses the bit position, number of flips and seed set with configure_delegate
+    """
+    library = delegate._library
+    library.tflite_plugin_flip_weights.argtypes = [ctypes.c_void_p]
+    if library.tflite_plugin_flip_weights(delegate._get_native_delegate_pointer()) != 0:
+        raise RuntimeError("The weights could not be flipped")
+
 OPERATION_MODES = (OperationMode.convolution, OperationMode.weights)
 LAYERS = ("conv2d/", "conv2d_1/", "conv2d_2/", "last/")
 N_SIMULATIONS = 25
@@ -226,32 +251,57 @@ for operation_mode in OPERATION_MODES:
         else:
             file_idx = last_index + 1
 
+        # Convolution faults can be changed on a live delegate, so one interpreter claiming every layer serves the whole campaign
+        # Weights are restored and flipped again by the delegate, so one interpreter serves every point of a layer
+        if operation_mode == OperationMode.convolution:
+            delegate = tf.lite.experimental.load_delegate(
+                library = DELEGATE_PATH,
+                options = {"layer_name": ",".join(LAYERS), 
+                            "faulty_layer": LAYERS[0],
+                            "operation_mode" : int(operation_mode),
+                            "bit_position": 0,
+                            "number_flips": 0,
+                            "dataset_size": test_labels.shape[0]
+                            })
+            new_interpreter = tf.lite.Interpreter(model_path = TFLITE_PATH, experimental_delegates = [delegate])
+            new_interpreter.allocate_tensors()
+
         for layer_counter, layer_name in enumerate(LAYERS):
             layer_time = time.time()
             print(f"Layer {layer_name}:\n")
 
+            if operation_mode == OperationMode.convolution:
+                # Only the current layer is disturbed, the rest of the claimed layers run without faults
+                library = delegate._library
+                library.tflite_plugin_set_faulty_layer.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+                library.tflite_plugin_set_faulty_layer(delegate._get_native_delegate_pointer(), layer_name.encode())
+            else:
+                # The kernel tensors of the layer are found while the graph is partitioned, without flips yet
+                delegate = tf.lite.experimental.load_delegate(
+                    library = DELEGATE_PATH,
+                    options = {"layer_name": layer_name, 
+                                "operation_mode" : int(operation_mode),
+                                "bit_position": 0,
+                                "number_flips": 0,
+                                "dataset_size": test_labels.shape[0]
+                                })
+
+                # The builtin kernels read the weights on every invoke, default delegates would pack them once
+                new_interpreter = tf.lite.Interpreter(model_path = TFLITE_PATH, experimental_delegates = [delegate],
+                                                      experimental_op_resolver_type = tf.lite.experimental.OpResolverType.BUILTIN_WITHOUT_DEFAULT_DELEGATES)
+                new_interpreter.allocate_tensors()
+
             for simulation_number in range(N_SIMULATIONS):
                 simulation_time = time.time()
 
                 for bit_position in range(get_bits_size(operation_mode)):
                     for number_flips in NUM_BITS_TO_FLIP:
                         iteration_time = time.time()
-                        # Using custom_delegate to affect weights or convolutions
-                        # This function calls the plugin_delegate_create
-                        delegate = tf.lite.experimental.load_delegate(
-                            library = DELEGATE_PATH,
-                            options = {"layer_name": layer_name, 
-                                        "operation_mode" : int(operation_mode),
-                                        "bit_position": bit_position,
-                                        "number_flips": number_flips,
-                                        "dataset_size": test_labels.shape[0]
-                                        })
-
-                        # Interpreter creation
-                        new_interpreter = tf.lite.Interpreter(model_path = TFLITE_PATH, experimental_delegates = [delegate])
-
-                        # Allocation of memory
-                        new_interpreter.allocate_tensors()
+                        # New random positions for every point
+                        configure_delegate(delegate, bit_position, number_flips, int.from_bytes(os.urandom(8), "little"))
+                        if operation_mode != OperationMode.convolution:
+                            # The flips of the previous point are restored first
+                            flip_weights(delegate)
                         # Output calculation
                         print(f"Output of Interpreter with custom delegate:")
                         evaluation_time = time.time()
@@ -259,8 +309,6 @@ for operation_mode in OPERATION_MODES:
                         print(f"Evaluation time {time.time() - evaluation_time:.3f} seconds")
                         print(f"Model with delegate accuracy : {accuracy:.2%}")
                         print(f"Model with delegate loss: {loss:.6f}")
-                        del delegate
-                        del new_interpreter
 
                         match operation_mode:
                             case OperationMode.weights:
@@ -284,5 +332,11 @@ for operation_mode in OPERATION_MODES:
                         print(f"Sim={simulation_number} Model={file_idx} flips={number_flips} bit-pos={bit_position} iter-time={datetime.timedelta(seconds = time.time() - iteration_time)} time-now={datetime.timedelta(seconds = time.time() - total_time)}\n")
                 print(f"Simulation={simulation_number} layer={layer_name} sim-time={datetime.timedelta(seconds = time.time() - simulation_time)}\n")
             print(f"Layer={layer_name} layer-time={datetime.timedelta(seconds = time.time() - layer_time)}\n")
+            if operation_mode != OperationMode.convolution:
+                del new_interpreter
+                del delegate
+        if operation_mode == OperationMode.convolution:
+            del new_interpreter
+            del delegate
     print(f"File={save_file_name} file-time={datetime.timedelta(seconds = time.time() - file_time)}\n")
 print(f"Finished total-time={datetime.timedelta(seconds = time.time() - total_time)}\n")
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "AccumulatorCache.h"
+
+#include <cstring>
+
+namespace tflite {
+
+	static_assert(sizeof(AccumulatorCacheFileHeader) == 32, "The header of the accumulator cache file must not have padding");
+
+	AccumulatorCache::AccumulatorCache(int num_images, int image_size, uint64_t weights_key)
+		: num_images_(num_images),
+		image_size_(image_size),
+		weights_key_(weights_key)
+	{
+	}
+
+	size_t AccumulatorCache::getStorageBytes() const
+	{
+		return sizeof(uint64_t) * static_cast<size_t>(num_images_) + sizeof(int32_t) * static_cast<size_t>(num_images_) * image_size_;
+	}
+
+	void AccumulatorCache::Allocate()
+	{
+		file_.Close();
+
+		// Keys go first so every array is aligned
+		arena_.reset(new unsigned char[getStorageBytes()]);
+		keys_ = reinterpret_cast<uint64_t*>(arena_.get());
+		accumulators_ = reinterpret_cast<int32_t*>(arena_.get() + sizeof(uint64_t) * static_cast<size_t>(num_images_));
+		std::memset(keys_, 0, sizeof(uint64_t) * static_cast<size_t>(num_images_));
+	}
+
+	bool AccumulatorCache::Map(const std::string& path, int node_index)
+	{
+		arena_.reset();
+		keys_ = nullptr;
+		accumulators_ = nullptr;
+		if (!file_.OpenWritable(path, sizeof(AccumulatorCacheFileHeader) + getStorageBytes()))
+			return false;
+
+		unsigned char* data = file_.getWritableData();
+		AccumulatorCacheFileHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		keys_ = reinterpret_cast<uint64_t*>(data + sizeof(AccumulatorCacheFileHeader));
+		accumulators_ = reinterpret_cast<int32_t*>(data + sizeof(AccumulatorCacheFileHeader) + sizeof(uint64_t) * static_cast<size_t>(num_images_));
+
+		// A file of another node or model is cleared, its accumulators are not valid
+		if (header.magic != kMagic || header.version != kVersion || header.node_index != node_index ||
+			header.num_images != num_images_ || header.image_size != image_size_ || header.weights_key != weights_key_)
+		{
+			header = AccumulatorCacheFileHeader();
+			header.magic = kMagic;
+			header.version = kVersion;
+			header.node_index = node_index;
+			header.num_images = num_images_;
+			header.image_size = image_size_;
+			header.weights_key = weights_key_;
+			std::memset(keys_, 0, sizeof(uint64_t) * static_cast<size_t>(num_images_));
+			std::memcpy(data, &header, sizeof(header));
+		}
+		return true;
+	}
+
+	int AccumulatorCache::getNumImages() const
+	{
+		return num_images_;
+	}
+
+	int AccumulatorCache::getImageSize() const
+	{
+		return image_size_;
+	}
+
+	const int32_t* AccumulatorCache::Find(int image, uint64_t input_key) const
+	{
+		if (keys_ == nullptr || image < 0 || image >= num_images_ || keys_[image] != input_key)
+			return nullptr;
+		return accumulators_ + static_cast<size_t>(image) * image_size_;
+	}
+
+	int32_t* AccumulatorCache::getStorage(int image)
+	{
+		if (keys_ == nullptr || image < 0 || image >= num_images_)
+			return nullptr;
+		// The image is empty until Store is called again
+		keys_[image] = 0;
+		return accumulators_ + static_cast<size_t>(image) * image_size_;
+	}
+
+	void AccumulatorCache::Store(int image, uint64_t input_key)
+	{
+		if (keys_ == nullptr || image < 0 || image >= num_images_)
+			return;
+		keys_[image] = input_key;
+	}
+
+	uint64_t AccumulatorCache::Hash(const void* data, size_t size, uint64_t hash)
+	{
+		constexpr uint64_t kPrime = 0x100000001B3ull;
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+		// 8 bytes per step, the tail byte by byte
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes + i, sizeof(uint64_t));
+			hash = (hash ^ word) * kPrime;
+		}
+		for (; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * kPrime;
+		}
+		return hash != 0 ? hash : 1;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "MappedFile.h"
+
+namespace tflite {
+
+	// AccumulatorCacheFileHeader
+	// First bytes of an accumulator cache file, all the values are little endian
+	// It is followed by num_images 64 bits keys and num_images * image_size 32 bits accumulators
+	struct AccumulatorCacheFileHeader
+	{
+		// Identifies the file as an accumulator cache
+		uint32_t magic = 0;
+
+		// Version of the layout
+		uint32_t version = 0;
+
+		// Node of the model the accumulators belong to
+		int32_t node_index = -1;
+
+		// Number of images of the dataset
+		int32_t num_images = 0;
+
+		// Number of accumulators of a single image
+		int32_t image_size = 0;
+
+		// Reserved for future versions, always 0
+		int32_t reserved = 0;
+
+		// Hash of the weights and the bias the accumulators were computed with
+		uint64_t weights_key = 0;
+	};
+
+	// AccumulatorCache
+	// Clean int32 accumulators of every image of the dataset for a single node, before requantization
+	// For a fixed model and dataset they are the same on every trial, so they are computed on the first
+	// evaluation of an image and later evaluations only add the change of the faulty products and requantize
+	// Every image is stored with the hash of its input sample, so an image whose input changed,
+	// e.g. because an upstream layer is also disturbed, is computed again instead of being reused
+	// The accumulators live in memory or in a memory mapped file that is kept between campaigns
+	class AccumulatorCache
+	{
+	public:
+		// "DACC" in little endian
+		constexpr static uint32_t kMagic = 0x43434144u;
+
+		// Current version of the layout
+		constexpr static uint32_t kVersion = 1;
+
+		/// <summary>
+		/// Constructor<para/>
+		///	&#009; - Nothing is stored until Allocate or Map is called
+		/// </summary>
+		/// <param name="num_images">: Number of images of the dataset</param>
+		/// <param name="image_size">: Number of accumulators of a single image</param>
+		/// <param name="weights_key">: Hash of the weights and the bias of the node</param>
+		AccumulatorCache(int num_images, int image_size, uint64_t weights_key);
+
+		AccumulatorCache(const AccumulatorCache&) = delete;
+		AccumulatorCache& operator=(const AccumulatorCache&) = delete;
+
+		// Keeps the accumulators in memory, every image starts empty
+		void Allocate();
+
+		// Keeps the accumulators in a memory mapped file
+		// The images of an existing file are reused when it was saved for the same node, sizes and weights,
+		// otherwise the file is cleared
+		// Returns false if the file can not be mapped
+		bool Map(const std::string& path, int node_index);
+
+		// Number of images of the dataset
+		int getNumImages() const;
+
+		// Number of accumulators of a single image
+		int getImageSize() const;
+
+		// Accumulators of an image stored with the same input key, nullptr if there are none
+		const int32_t* Find(int image, uint64_t input_key) const;
+
+		// Storage of the accumulators of an image, filled by the caller before calling Store
+		// nullptr if the image is not in the dataset
+		int32_t* getStorage(int image);
+
+		// Marks the accumulators written to getStorage(image) as valid for the input key
+		void Store(int image, uint64_t input_key);
+
+		// 64 bits FNV-1a style hash of a buffer, 8 bytes per step, chained through hash
+		// Never returns 0, which marks the empty images
+		static uint64_t Hash(const void* data, size_t size, uint64_t hash = 0xCBF29CE484222325ull);
+
+	private:
+		// Number of images of the dataset
+		int num_images_ = 0;
+
+		// Number of accumulators of a single image
+		int image_size_ = 0;
+
+		// Hash of the weights and the bias of the node
+		uint64_t weights_key_ = 0;
+
+		// Memory of the cache when it is not mapped
+		std::unique_ptr<unsigned char[]> arena_;
+
+		// Mapped file of the cache
+		MappedFile file_;
+
+		// Input key of every image, 0 when the image is empty
+		uint64_t* keys_ = nullptr;
+
+		// Accumulators of every image
+		int32_t* accumulators_ = nullptr;
+
+		// Bytes of the keys and the accumulators
+		size_t getStorageBytes() const;
+	};
+
+}
\ No newline at end of file
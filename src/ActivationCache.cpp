@@ -0,0 +1,105 @@
+#include "ActivationCache.h"
+
+#include <cstring>
+
+namespace tflite {
+
+	static_assert(sizeof(ActivationCacheFileHeader) == 32, "The header of the activation cache file must not have padding");
+
+	ActivationCache::ActivationCache(int num_images, size_t sample_bytes, uint64_t model_key)
+		: num_images_(num_images),
+		sample_bytes_(sample_bytes),
+		model_key_(model_key)
+	{
+	}
+
+	size_t ActivationCache::getFileBytes() const
+	{
+		return sizeof(ActivationCacheFileHeader) + sizeof(uint64_t) * static_cast<size_t>(num_images_) + sample_bytes_ * num_images_;
+	}
+
+	bool ActivationCache::Create(const std::string& path, int node_index)
+	{
+		if (!file_.OpenWritable(path, getFileBytes()))
+			return false;
+
+		unsigned char* data = file_.getWritableData();
+		ActivationCacheFileHeader header;
+		std::memcpy(&header, data, sizeof(header));
+
+		// A file of another node or model is cleared, its samples are not valid
+		if (header.magic != kMagic || header.version != kVersion || header.node_index != node_index ||
+			header.num_images != num_images_ || header.sample_bytes != static_cast<int64_t>(sample_bytes_) || header.model_key != model_key_)
+		{
+			header = ActivationCacheFileHeader();
+			header.magic = kMagic;
+			header.version = kVersion;
+			header.node_index = node_index;
+			header.num_images = num_images_;
+			header.sample_bytes = static_cast<int64_t>(sample_bytes_);
+			header.model_key = model_key_;
+			std::memset(data + sizeof(header), 0, sizeof(uint64_t) * static_cast<size_t>(num_images_));
+			std::memcpy(data, &header, sizeof(header));
+		}
+		return true;
+	}
+
+	bool ActivationCache::Open(const std::string& path, int node_index)
+	{
+		if (!file_.Open(path) || file_.getSize() != getFileBytes())
+		{
+			file_.Close();
+			return false;
+		}
+
+		ActivationCacheFileHeader header;
+		std::memcpy(&header, file_.getData(), sizeof(header));
+		if (header.magic != kMagic || header.version != kVersion || header.node_index != node_index ||
+			header.num_images != num_images_ || header.sample_bytes != static_cast<int64_t>(sample_bytes_) || header.model_key != model_key_)
+		{
+			file_.Close();
+			return false;
+		}
+		return true;
+	}
+
+	int ActivationCache::getNumImages() const
+	{
+		return num_images_;
+	}
+
+	size_t ActivationCache::getSampleBytes() const
+	{
+		return sample_bytes_;
+	}
+
+	const uint64_t* ActivationCache::getFlags() const
+	{
+		return reinterpret_cast<const uint64_t*>(file_.getData() + sizeof(ActivationCacheFileHeader));
+	}
+
+	const unsigned char* ActivationCache::getSamples() const
+	{
+		return file_.getData() + sizeof(ActivationCacheFileHeader) + sizeof(uint64_t) * static_cast<size_t>(num_images_);
+	}
+
+	const unsigned char* ActivationCache::getSample(int image) const
+	{
+		if (file_.getData() == nullptr || image < 0 || image >= num_images_ || getFlags()[image] == 0)
+			return nullptr;
+		return getSamples() + sample_bytes_ * image;
+	}
+
+	void ActivationCache::Store(int image, const void* sample)
+	{
+		unsigned char* data = file_.getWritableData();
+		if (data == nullptr || image < 0 || image >= num_images_)
+			return;
+		// The flag is written last, an interrupted capture leaves the image empty
+		uint64_t* flags = reinterpret_cast<uint64_t*>(data + sizeof(ActivationCacheFileHeader));
+		flags[image] = 0;
+		std::memcpy(data + (getSamples() - file_.getData()) + sample_bytes_ * image, sample, sample_bytes_);
+		flags[image] = 1;
+	}
+
+}
\ No newline at end of file
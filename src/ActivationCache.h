@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "MappedFile.h"
+
+namespace tflite {
+
+	// ActivationCacheFileHeader
+	// First bytes of an activation cache file, all the values are little endian
+	// It is followed by num_images 64 bits flags and num_images samples of sample_bytes bytes
+	struct ActivationCacheFileHeader
+	{
+		// Identifies the file as an activation cache
+		uint32_t magic = 0;
+
+		// Version of the layout
+		uint32_t version = 0;
+
+		// Node whose input tensor is stored
+		int32_t node_index = -1;
+
+		// Number of images of the dataset
+		int32_t num_images = 0;
+
+		// Bytes of a single sample of the input tensor
+		int64_t sample_bytes = 0;
+
+		// Hash of the constant tensors of the model
+		uint64_t model_key = 0;
+	};
+
+	// ActivationCache
+	// Input tensor of the first delegated node for every image of the dataset, kept in a memory mapped file
+	// The layers before that node see the same images on every trial, so a captured campaign
+	// stores their result once and replayed campaigns copy it instead of executing them
+	class ActivationCache
+	{
+	public:
+		// "DACT" in little endian
+		constexpr static uint32_t kMagic = 0x54434144u;
+
+		// Current version of the layout
+		constexpr static uint32_t kVersion = 1;
+
+		/// <summary>
+		/// Constructor<para/>
+		///	&#009; - Nothing is mapped until Create or Open is called
+		/// </summary>
+		/// <param name="num_images">: Number of images of the dataset</param>
+		/// <param name="sample_bytes">: Bytes of a single sample of the input tensor</param>
+		/// <param name="model_key">: Hash of the constant tensors of the model</param>
+		ActivationCache(int num_images, size_t sample_bytes, uint64_t model_key);
+
+		ActivationCache(const ActivationCache&) = delete;
+		ActivationCache& operator=(const ActivationCache&) = delete;
+
+		// Maps the file to capture the samples, it is created if it does not exist
+		// The images of an existing file are kept when it was written for the same node, sizes and model,
+		// otherwise the file is cleared
+		// Returns false if the file can not be mapped
+		bool Create(const std::string& path, int node_index);
+
+		// Maps a captured file to replay the samples
+		// Returns false if it can not be opened or it was written for another node, size or model
+		bool Open(const std::string& path, int node_index);
+
+		// Number of images of the dataset
+		int getNumImages() const;
+
+		// Bytes of a single sample of the input tensor
+		size_t getSampleBytes() const;
+
+		// Captured sample of an image, nullptr if it was not captured
+		const unsigned char* getSample(int image) const;
+
+		// Stores the sample of an image, ignored if the image is not in the dataset or the file is read-only
+		void Store(int image, const void* sample);
+
+	private:
+		// Number of images of the dataset
+		int num_images_ = 0;
+
+		// Bytes of a single sample of the input tensor
+		size_t sample_bytes_ = 0;
+
+		// Hash of the constant tensors of the model
+		uint64_t model_key_ = 0;
+
+		// Mapped file of the cache
+		MappedFile file_;
+
+		// Bytes of the whole file
+		size_t getFileBytes() const;
+
+		// Captured flag of every image
+		const uint64_t* getFlags() const;
+
+		// First byte of the samples
+		const unsigned char* getSamples() const;
+	};
+
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "ConvIndirection.h"
+
+#include <algorithm>
+
+namespace tflite {
+	namespace custom_ops {
+
+		bool ConvGeometry::operator==(const ConvGeometry& other) const
+		{
+			return input_height == other.input_height && input_width == other.input_width && input_depth == other.input_depth &&
+				filter_height == other.filter_height && filter_width == other.filter_width && filter_input_depth == other.filter_input_depth &&
+				output_height == other.output_height && output_width == other.output_width &&
+				stride_height == other.stride_height && stride_width == other.stride_width &&
+				dilation_height_factor == other.dilation_height_factor && dilation_width_factor == other.dilation_width_factor &&
+				pad_height == other.pad_height && pad_width == other.pad_width;
+		}
+
+		ConvIndirection::ConvIndirection(const ConvGeometry& geometry)
+			: geometry_(geometry)
+		{
+			const int pixels = geometry.output_height * geometry.output_width;
+			const int filter_taps = geometry.filter_height * geometry.filter_width;
+			origins_.resize(pixels);
+			first_taps_.resize(pixels);
+			tap_counts_.resize(pixels);
+
+			// Every tap of an interior pixel
+			for (int filter_y = 0; filter_y < geometry.filter_height; ++filter_y)
+			{
+				for (int filter_x = 0; filter_x < geometry.filter_width; ++filter_x)
+				{
+					const int32_t input_offset = (geometry.dilation_height_factor * filter_y * geometry.input_width +
+						geometry.dilation_width_factor * filter_x) * geometry.input_depth;
+					const int32_t filter_offset = (filter_y * geometry.filter_width + filter_x) * geometry.filter_input_depth;
+					taps_.push_back({ input_offset, filter_offset });
+				}
+			}
+
+			for (int out_y = 0; out_y < geometry.output_height; ++out_y)
+			{
+				const int in_y_origin = (out_y * geometry.stride_height) - geometry.pad_height;
+				for (int out_x = 0; out_x < geometry.output_width; ++out_x)
+				{
+					const int in_x_origin = (out_x * geometry.stride_width) - geometry.pad_width;
+					const int pixel = out_y * geometry.output_width + out_x;
+					origins_[pixel] = (in_y_origin * geometry.input_width + in_x_origin) * geometry.input_depth;
+
+					const int first_tap = static_cast<int>(taps_.size());
+					for (int filter_y = 0; filter_y < geometry.filter_height; ++filter_y)
+					{
+						const int in_y = in_y_origin + geometry.dilation_height_factor * filter_y;
+						for (int filter_x = 0; filter_x < geometry.filter_width; ++filter_x)
+						{
+							const int in_x = in_x_origin + geometry.dilation_width_factor * filter_x;
+							if (in_x >= 0 && in_x < geometry.input_width && in_y >= 0 && in_y < geometry.input_height)
+							{
+								taps_.push_back(taps_[filter_y * geometry.filter_width + filter_x]);
+							}
+						}
+					}
+
+					// Interior pixels point to the shared taps
+					const int tap_count = static_cast<int>(taps_.size()) - first_tap;
+					if (tap_count == filter_taps)
+					{
+						taps_.resize(first_tap);
+						first_taps_[pixel] = 0;
+					}
+					else
+					{
+						first_taps_[pixel] = first_tap;
+					}
+					tap_counts_[pixel] = tap_count;
+				}
+			}
+
+			// Pixels with all their rows and all their columns inside the input
+			const int filter_span_height = geometry.dilation_height_factor * (geometry.filter_height - 1);
+			const int filter_span_width = geometry.dilation_width_factor * (geometry.filter_width - 1);
+			interior_y_begin_ = geometry.output_height;
+			for (int out_y = 0; out_y < geometry.output_height; ++out_y)
+			{
+				const int in_y_origin = (out_y * geometry.stride_height) - geometry.pad_height;
+				if (in_y_origin >= 0 && in_y_origin + filter_span_height < geometry.input_height)
+				{
+					interior_y_begin_ = std::min(interior_y_begin_, out_y);
+					interior_y_end_ = out_y + 1;
+				}
+			}
+			interior_x_begin_ = geometry.output_width;
+			for (int out_x = 0; out_x < geometry.output_width; ++out_x)
+			{
+				const int in_x_origin = (out_x * geometry.stride_width) - geometry.pad_width;
+				if (in_x_origin >= 0 && in_x_origin + filter_span_width < geometry.input_width)
+				{
+					interior_x_begin_ = std::min(interior_x_begin_, out_x);
+					interior_x_end_ = out_x + 1;
+				}
+			}
+			if (interior_x_begin_ >= interior_x_end_ || interior_y_begin_ >= interior_y_end_)
+			{
+				interior_y_begin_ = interior_y_end_ = interior_x_begin_ = interior_x_end_ = 0;
+			}
+		}
+
+		const ConvGeometry& ConvIndirection::getGeometry() const
+		{
+			return geometry_;
+		}
+
+		int32_t ConvIndirection::getOrigin(int pixel) const
+		{
+			return origins_[pixel];
+		}
+
+		const ConvTap* ConvIndirection::getTaps(int pixel) const
+		{
+			return taps_.data() + first_taps_[pixel];
+		}
+
+		int ConvIndirection::getTapCount(int pixel) const
+		{
+			return tap_counts_[pixel];
+		}
+
+		bool ConvIndirection::isInteriorRow(int out_y) const
+		{
+			return out_y >= interior_y_begin_ && out_y < interior_y_end_;
+		}
+
+		int ConvIndirection::getInteriorXBegin() const
+		{
+			return interior_x_begin_;
+		}
+
+		int ConvIndirection::getInteriorXEnd() const
+		{
+			return interior_x_end_;
+		}
+
+	}
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace tflite {
+	namespace custom_ops {
+
+		// ConvGeometry
+		// Sizes of a single sample of a convolution, the indirection of a node is only valid for the same geometry
+		struct ConvGeometry
+		{
+			int input_height = 0;
+			int input_width = 0;
+			int input_depth = 0;
+			int filter_height = 0;
+			int filter_width = 0;
+			int filter_input_depth = 0;
+			int output_height = 0;
+			int output_width = 0;
+			int stride_height = 1;
+			int stride_width = 1;
+			int dilation_height_factor = 1;
+			int dilation_width_factor = 1;
+			int pad_height = 0;
+			int pad_width = 0;
+
+			bool operator==(const ConvGeometry& other) const;
+		};
+
+		// ConvTap
+		// Filter tap inside the input, the dot product of its channels is a single call
+		struct ConvTap
+		{
+			// Offset of the input row of the tap from the origin of the output pixel
+			int32_t input_offset;
+
+			// Offset of the tap in the row of an output channel of the filter
+			int32_t filter_offset;
+		};
+
+		// ConvIndirection
+		// Taps of every output pixel of a convolution, built when the node is prepared
+		// Interior pixels have all their taps inside the input and share the first filter_height * filter_width taps,
+		// border pixels only list the taps inside the input, so no tap is checked against the padding in the kernels
+		// Padded multiplications are not performed, the same as omitting them in the reference kernel
+		class ConvIndirection
+		{
+		public:
+			// ConvIndirection constructor, the taps of every output pixel of the geometry
+			explicit ConvIndirection(const ConvGeometry& geometry);
+
+			// Geometry the taps were built for
+			const ConvGeometry& getGeometry() const;
+
+			// Offset in the sample of the input element of the first tap of an output pixel and channel 0,
+			// can be outside the sample for border pixels
+			int32_t getOrigin(int pixel) const;
+
+			// Taps of an output pixel inside the input
+			const ConvTap* getTaps(int pixel) const;
+
+			// Number of taps of an output pixel inside the input
+			int getTapCount(int pixel) const;
+
+			// Whether the output row has interior pixels, they are the columns [getInteriorXBegin(), getInteriorXEnd())
+			bool isInteriorRow(int out_y) const;
+
+			// First interior column of the interior rows
+			int getInteriorXBegin() const;
+
+			// End of the interior columns of the interior rows
+			int getInteriorXEnd() const;
+
+		private:
+			// Geometry the taps were built for
+			ConvGeometry geometry_;
+
+			// Interior taps followed by the taps of the border pixels
+			std::vector<ConvTap> taps_;
+
+			// Input origin of every output pixel
+			std::vector<int32_t> origins_;
+
+			// First tap of every output pixel
+			std::vector<int32_t> first_taps_;
+
+			// Number of taps of every output pixel
+			std::vector<int32_t> tap_counts_;
+
+			// Interior pixels are a rectangle of the output, empty when every pixel has padded taps
+			int interior_y_begin_ = 0;
+			int interior_y_end_ = 0;
+			int interior_x_begin_ = 0;
+			int interior_x_end_ = 0;
+		};
+
+	}
+}
\ No newline at end of file
@@ -7,8 +7,9 @@
 #include <iostream>
 #include <vector>
 #include <bitset>
-#include <thread>
-#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <tensorflow/lite/core/c/builtin_op_data.h>
 #include <tensorflow/lite/core/c/c_api_types.h>
 #include <tensorflow/lite/kernels/internal/tensor_ctypes.h>
@@ -18,8 +19,17 @@
 // Necessary for convolutional reference operations
 // For Int8 operations
 #include <tensorflow/lite/kernels/internal/reference/integer_ops/conv.h>
+// Necessary for the clean pass of the hybrid kernel backend
+#include <tensorflow/lite/kernels/cpu_backend_context.h>
+#include <tensorflow/lite/kernels/internal/optimized/integer_ops/conv.h>
 
 #include "Options.h"
+#include "ThreadPool.h"
+#include "Philox.h"
+#include "DotProduct.h"
+#include "Gemm.h"
+#include "ConvIndirection.h"
+#include "ConvSpecialization.h"
 
 // All references to TFLITE_WITH_MULTITHREADED_EIGEN are removed, no multithreading
 namespace tflite {
@@ -191,6 +201,134 @@ namespace tflite {
 			TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node,
 				TfLiteConvParams* params, OpData* data, const MyDelegateOptions& options);
 
+			// Geometry of a single sample of the convolution
+			inline ConvGeometry getConvGeometry(
+				const ConvParams& params,
+				const RuntimeShape& input_shape, const RuntimeShape& filter_shape, const RuntimeShape& output_shape)
+			{
+				ConvGeometry geometry;
+				geometry.input_height = input_shape.Dims(1);
+				geometry.input_width = input_shape.Dims(2);
+				geometry.input_depth = input_shape.Dims(3);
+				geometry.filter_height = filter_shape.Dims(1);
+				geometry.filter_width = filter_shape.Dims(2);
+				geometry.filter_input_depth = filter_shape.Dims(3);
+				geometry.output_height = output_shape.Dims(1);
+				geometry.output_width = output_shape.Dims(2);
+				geometry.stride_height = params.stride_height;
+				geometry.stride_width = params.stride_width;
+				geometry.dilation_height_factor = params.dilation_height_factor;
+				geometry.dilation_width_factor = params.dilation_width_factor;
+				geometry.pad_height = params.padding_values.height;
+				geometry.pad_width = params.padding_values.width;
+				return geometry;
+			}
+
+			// Indirection built in MyDelegateNode::Prepare for the geometry of the shapes, checked again by MyDelegateNode::Eval
+			inline std::shared_ptr<const ConvIndirection> getConvIndirection(
+				const ConvParams& params,
+				const RuntimeShape& input_shape, const RuntimeShape& filter_shape, const RuntimeShape& output_shape,
+				const MyDelegateOptions& options)
+			{
+				TFLITE_DCHECK(options.conv_indirection != nullptr);
+				TFLITE_DCHECK(options.conv_indirection->getGeometry() == getConvGeometry(params, input_shape, filter_shape, output_shape));
+				return options.conv_indirection;
+			}
+
+			// Specialization selected in MyDelegateNode::Prepare for the convolution, checked again by MyDelegateNode::Eval
+			inline std::shared_ptr<const ConvSpecialization> getConvSpecialization(
+				const ConvParams& params,
+				const RuntimeShape& input_shape, const RuntimeShape& filter_shape, const RuntimeShape& output_shape,
+				const int8_t* filter_data, const MyDelegateOptions& options)
+			{
+				TFLITE_DCHECK(options.conv_specialization != nullptr);
+				TFLITE_DCHECK(options.conv_specialization->isBuiltFor(getConvGeometry(params, input_shape, filter_shape, output_shape),
+					filter_data, filter_shape.Dims(0), params.input_offset));
+				return options.conv_specialization;
+			}
+
+			// Clean accumulator of an interior pixel with the taps unrolled for the filter size, dilation 1 and a single group
+			// The input offset is not added, it is the folded sum of the output channel
+			template <int kFilterSize>
+			inline int32_t AccumulateInteriorTaps(const int8_t* pixel_input, const int8_t* filter_row, const int row_size, const int depth)
+			{
+				int32_t acc = 0;
+				for (int filter_y = 0; filter_y < kFilterSize; ++filter_y)
+				{
+					for (int filter_x = 0; filter_x < kFilterSize; ++filter_x)
+					{
+						acc += DotProductInt8(
+							pixel_input + (filter_y * row_size + filter_x * depth),
+							filter_row + (filter_y * kFilterSize + filter_x) * depth,
+							depth, 0);
+					}
+				}
+				return acc;
+			}
+
+			// Interior pixels [x_begin, x_end) of an output row and output channels [start_channel, end_channel) with the kernel
+			// of the filter size and the stride, row_input is the input of the first tap of x_begin
+			// finish(out_x, out_channel, acc) receives the clean accumulator of every output, without the bias
+			template <int kFilterSize, int kStride, typename Finish>
+			inline void SpecializedConvolutionRow(
+				const int8_t* row_input, const int x_begin, const int x_end,
+				const int start_channel, const int end_channel,
+				const int input_width, const int depth,
+				const int8_t* filter_data, const int32_t* folded_offsets,
+				Finish&& finish)
+			{
+				const int row_size = input_width * depth;
+				const int filter_size = kFilterSize * kFilterSize * depth;
+				for (int out_x = x_begin; out_x < x_end; ++out_x)
+				{
+					const int8_t* pixel_input = row_input + (out_x - x_begin) * kStride * depth;
+					for (int out_channel = start_channel; out_channel < end_channel; ++out_channel)
+					{
+						const int32_t acc = AccumulateInteriorTaps<kFilterSize>(
+							pixel_input, filter_data + static_cast<size_t>(out_channel) * filter_size, row_size, depth);
+						// Wrapping like the int32 accumulator
+						finish(out_x, out_channel, static_cast<int32_t>(static_cast<uint32_t>(acc) + static_cast<uint32_t>(folded_offsets[out_channel])));
+					}
+				}
+			}
+
+			// Runs SpecializedConvolutionRow for the filter size and the stride of the specialization
+			// The specialization must have a filter size, the finish functor is inlined in every kernel
+			template <typename Finish>
+			inline void DispatchSpecializedRow(
+				const ConvSpecialization& specialization,
+				const int8_t* row_input, const int x_begin, const int x_end,
+				const int start_channel, const int end_channel,
+				const int input_width, const int depth,
+				const int8_t* filter_data,
+				Finish&& finish)
+			{
+				const int32_t* folded_offsets = specialization.getFoldedOffsets();
+				switch (specialization.getFilterSize() * 10 + specialization.getStride())
+				{
+				case 11:
+					SpecializedConvolutionRow<1, 1>(row_input, x_begin, x_end, start_channel, end_channel, input_width, depth, filter_data, folded_offsets, finish);
+					break;
+				case 12:
+					SpecializedConvolutionRow<1, 2>(row_input, x_begin, x_end, start_channel, end_channel, input_width, depth, filter_data, folded_offsets, finish);
+					break;
+				case 31:
+					SpecializedConvolutionRow<3, 1>(row_input, x_begin, x_end, start_channel, end_channel, input_width, depth, filter_data, folded_offsets, finish);
+					break;
+				case 32:
+					SpecializedConvolutionRow<3, 2>(row_input, x_begin, x_end, start_channel, end_channel, input_width, depth, filter_data, folded_offsets, finish);
+					break;
+				case 51:
+					SpecializedConvolutionRow<5, 1>(row_input, x_begin, x_end, start_channel, end_channel, input_width, depth, filter_data, folded_offsets, finish);
+					break;
+				case 52:
+					SpecializedConvolutionRow<5, 2>(row_input, x_begin, x_end, start_channel, end_channel, input_width, depth, filter_data, folded_offsets, finish);
+					break;
+				default:
+					break;
+				}
+			}
+
 			// Fixed-point per-channel-quantization convolution reference kernel.
 			inline void ConvPerChannel(
 				const ConvParams& params, const int32_t* output_multiplier,
@@ -202,12 +340,6 @@ namespace tflite {
 			{
 				// Get parameters.
 				const int32_t input_offset = params.input_offset;  // r = s(q - Z)
-				const int stride_width = params.stride_width;
-				const int stride_height = params.stride_height;
-				const int dilation_width_factor = params.dilation_width_factor;
-				const int dilation_height_factor = params.dilation_height_factor;
-				const int pad_width = params.padding_values.width;
-				const int pad_height = params.padding_values.height;
 				const int32_t output_offset = params.output_offset;
 
 				// Set min and max value of the output.
@@ -228,10 +360,6 @@ namespace tflite {
 				}
 
 				// Check dimensions of the tensors.
-				const int input_height = input_shape.Dims(1);
-				const int input_width = input_shape.Dims(2);
-				const int filter_height = filter_shape.Dims(1);
-				const int filter_width = filter_shape.Dims(2);
 				const int filter_input_depth = filter_shape.Dims(3);
 				const int groups = input_depth / filter_input_depth;
 				TFLITE_DCHECK_NE(groups, 0);
@@ -241,64 +369,84 @@ namespace tflite {
 				const int output_height = output_shape.Dims(1);
 				const int output_width = output_shape.Dims(2);
 
+				// Taps of every output pixel inside the input, no tap is checked against the padding
+				const std::shared_ptr<const ConvIndirection> indirection = getConvIndirection(params, input_shape, filter_shape, output_shape, options);
+				const std::shared_ptr<const ConvSpecialization> specialization = getConvSpecialization(params, input_shape, filter_shape, output_shape, filter_data, options);
+				const bool specialized = specialization->getFilterSize() != 0;
+
 				// 1 For some reason tensor allocate only allows 1 image to be analyzed
 				for (int batch = 0; batch < batches; ++batch) 
 				{
+					const int8_t* sample_input = input_data + Offset(input_shape, batch, 0, 0, 0);
 					// 
 					for (int out_y = 0; out_y < output_height; ++out_y) 
 					{
-						const int in_y_origin = (out_y * stride_height) - pad_height;
+						const bool specialized_row = specialized && indirection->isInteriorRow(out_y);
 						// 
 						for (int out_x = 0; out_x < output_width; ++out_x) 
 						{
-							const int in_x_origin = (out_x * stride_width) - pad_width;
+							// The interior of the row in a single call of the specialized kernel
+							if (specialized_row && out_x == indirection->getInteriorXBegin())
+							{
+								const int x_end = indirection->getInteriorXEnd();
+								DispatchSpecializedRow(
+									*specialization,
+									sample_input + indirection->getOrigin(out_y * output_width + out_x), out_x, x_end,
+									0, output_depth,
+									input_shape.Dims(2), filter_input_depth,
+									filter_data,
+									[&](int interior_x, int out_channel, int32_t acc)
+									{
+										if (bias_data)
+										{
+											acc += bias_data[out_channel];
+										}
+										acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
+										acc += output_offset;
+										acc = std::max(acc, output_activation_min);
+										acc = std::min(acc, output_activation_max);
+										output_data[Offset(output_shape, batch, out_y, interior_x, out_channel)] = static_cast<int8_t>(acc);
+									});
+								out_x = x_end - 1;
+								continue;
+							}
+
+							const int pixel = out_y * output_width + out_x;
+							const int32_t origin = indirection->getOrigin(pixel);
+							const ConvTap* taps = indirection->getTaps(pixel);
+							const int tap_count = indirection->getTapCount(pixel);
 							// 
 							for (int out_channel = 0; out_channel < output_depth; ++out_channel) 
 							{
 								// Will always be 0!!!!!!! input channels = filter input channels then filters per group = number of filters (output channels) so group = 0
 								auto group = out_channel / filters_per_group;
 
+								const int8_t* filter_row = filter_data + Offset(filter_shape, out_channel, 0, 0, 0);
+								const int32_t channel_origin = origin + group * filter_input_depth;
 								int32_t acc = 0;
-								for (int filter_y = 0; filter_y < filter_height; ++filter_y) 
+								for (int tap = 0; tap < tap_count; ++tap)
 								{
-									const int in_y = in_y_origin + dilation_height_factor * filter_y;
-									for (int filter_x = 0; filter_x < filter_width; ++filter_x) 
-									{
-										const int in_x = in_x_origin + dilation_width_factor * filter_x;
-
-										// Zero padding by omitting the areas outside the image.
-										const bool is_point_inside_image = 
-											(in_x >= 0) && (in_x < input_width) && 
-											(in_y >= 0) && (in_y < input_height);
-
-										if (!is_point_inside_image) 
-										{
-											continue;
-										}
-
-										for (int in_channel = 0; in_channel < filter_input_depth; ++in_channel) 
-										{
-											int32_t input_val = input_data[Offset(input_shape, batch, in_y, in_x, in_channel + group * filter_input_depth)];
-											int32_t filter_val = filter_data[Offset(filter_shape, out_channel, filter_y, filter_x, in_channel)];
-											// Accumulate with 32 bits accumulator.
-											// In the nudging process during model quantization, we force
-											// real value of 0.0 be represented by a quantized value. This
-											// guarantees that the input_offset is a int8_t, even though
-											// it is represented using int32_t. int32_t += int8_t *
-											// (int8_t - int8_t) so the highest value we can get from each
-											// accumulation is [-127, 127] * ([-128, 127] -
-											// [-128, 127]), which is [-32512, 32512]. log2(32512)
-											// = 14.98, which means we can accumulate at least 2^16
-											// multiplications without overflow. The accumulator is
-											// applied to a filter so the accumulation logic will hold as
-											// long as the filter size (filter_y * filter_x * in_channel)
-											// does not exceed 2^16, which is the case in all the models
-											// we have seen so far.
-											// TODO(b/174275578): Add a check to make sure the
-											// accumulator depth is smaller than 2^16.
-											acc += filter_val * (input_val + input_offset);
-										}
-									}
+									// The channels of the tap are contiguous in the input and in the filter
+									// Accumulate with 32 bits accumulator.
+									// In the nudging process during model quantization, we force
+									// real value of 0.0 be represented by a quantized value. This
+									// guarantees that the input_offset is a int8_t, even though
+									// it is represented using int32_t. int32_t += int8_t *
+									// (int8_t - int8_t) so the highest value we can get from each
+									// accumulation is [-127, 127] * ([-128, 127] -
+									// [-128, 127]), which is [-32512, 32512]. log2(32512)
+									// = 14.98, which means we can accumulate at least 2^16
+									// multiplications without overflow. The accumulator is
+									// applied to a filter so the accumulation logic will hold as
+									// long as the filter size (filter_y * filter_x * in_channel)
+									// does not exceed 2^16, which is the case in all the models
+									// we have seen so far.
+									// TODO(b/174275578): Add a check to make sure the
+									// accumulator depth is smaller than 2^16.
+									acc += DotProductInt8(
+										sample_input + (channel_origin + taps[tap].input_offset),
+										filter_row + taps[tap].filter_offset,
+										filter_input_depth, input_offset);
 								}
 
 								// Here is the point where the previous python flipper version carried the bit flipping
@@ -317,7 +465,40 @@ namespace tflite {
 				}
 			}
 			
+			// Adds to the accumulator of an output the change of one of its products when bit_position of the product is flipped
+			// The kernel partial position is relative to the row of the filter, the input is the sample of the output
+			// Padded multiplications are not performed, so they can not be disturbed
+			inline int32_t FlipFaultyProduct(
+				const int32_t acc, const int kernelPartialPosition, const int out_channel, const int group,
+				const int in_y_origin, const int in_x_origin,
+				const int filter_width, const int filter_input_depth,
+				const int input_height, const int input_width,
+				const int dilation_width_factor, const int dilation_height_factor,
+				const int input_offset,
+				const RuntimeShape& input_shape, const int8_t* sample_input,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const int bit_position)
+			{
+				// Converting the kernel partial position into the filter position vector
+				const int in_channel = kernelPartialPosition % filter_input_depth;
+				const int filter_x = (kernelPartialPosition / filter_input_depth) % filter_width;
+				const int filter_y = kernelPartialPosition / (filter_input_depth * filter_width);
+				const int in_y = in_y_origin + dilation_height_factor * filter_y;
+				const int in_x = in_x_origin + dilation_width_factor * filter_x;
+				if (in_x < 0 || in_x >= input_width || in_y < 0 || in_y >= input_height)
+				{
+					return acc;
+				}
+
+				int32_t input_val = sample_input[Offset(input_shape, 0, in_y, in_x, in_channel + group * filter_input_depth)];
+				int32_t filter_val = filter_data[Offset(filter_shape, out_channel, filter_y, filter_x, in_channel)];
+				const uint32_t product = static_cast<uint32_t>(filter_val * (input_val + input_offset));
+				// Wrapping like the int32 accumulator
+				return static_cast<int32_t>(static_cast<uint32_t>(acc) + ((product ^ (1u << bit_position)) - product));
+			}
+
 			// Raw operation to pararellize in threads
+			// Interior pixels use the specialized kernel when the convolution has one, interior rows without faults skip the fault cursor
 			inline void DisturbedConvolutionOperation(
 				const int32_t* output_multiplier, const int32_t* output_shift,
 				const int batches, const int output_height, const int output_width, const int output_depth,
@@ -333,95 +514,104 @@ namespace tflite {
 				const RuntimeShape& filter_shape, const int8_t* filter_data,
 				const RuntimeShape& bias_shape, const int32_t* bias_data,
 				const RuntimeShape& output_shape, int8_t* output_data,
-				const std::vector<int>& chunk_indexes,
+				const ConvIndirection& indirection,
+				const ConvSpecialization& specialization,
 				const MyDelegateOptions& options)
 			{
-				const int& dataset_index = options.dataset_index;
-				int idx_counter = chunk_indexes.size() - 1;
-				// 1 For some reason tensor allocate only allows 1 image to be analyzed
+				const bool specialized = specialization.getFilterSize() != 0;
+
+				// Every sample of the batch is a different image of the dataset with its own error positions
 				for (int batch = 0; batch < batches; ++batch)
 				{
+					const FaultSpan error_positions = options.getErrorPositions(batch);
+					FaultCursor cursor(error_positions, 0, error_positions.size);
+					const int8_t* sample_input = input_data + Offset(input_shape, batch, 0, 0, 0);
+
+					// Fault epilogue, the faulty products of the output are flipped on top of the clean sum
+					auto flip_faults = [&](int out_y, int out_x, int out_channel, int32_t acc)
+					{
+						const int outputPosition = out_y * output_width * output_depth + out_x * output_depth + out_channel;
+						while (cursor.getNextOutput() == outputPosition)
+						{
+							const int kernelPartialPosition = cursor.Pop();
+							acc = FlipFaultyProduct(
+								acc, kernelPartialPosition, out_channel, out_channel / filters_per_group,
+								(out_y * stride_height) - pad_height, (out_x * stride_width) - pad_width,
+								filter_width, filter_input_depth,
+								input_height, input_width,
+								dilation_width_factor, dilation_height_factor,
+								input_offset,
+								input_shape, sample_input,
+								filter_shape, filter_data,
+								options.bit_position);
+						}
+						return acc;
+					};
+
+					// Bias and requantization of the output
+					auto store = [&](int out_y, int out_x, int out_channel, int32_t acc)
+					{
+						if (bias_data)
+						{
+							acc += bias_data[out_channel];
+						}
+						acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
+						acc += output_offset;
+						acc = std::max(acc, output_activation_min);
+						acc = std::min(acc, output_activation_max);
+						output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] = static_cast<int8_t>(acc);
+					};
+
 					// 
 					for (int out_y = 0; out_y < output_height; ++out_y)
 					{
-						const int in_y_origin = (out_y * stride_height) - pad_height;
+						const bool specialized_row = specialized && indirection.isInteriorRow(out_y);
 						// 
 						for (int out_x = 0; out_x < output_width; ++out_x)
 						{
-							const int in_x_origin = (out_x * stride_width) - pad_width;
+							// The interior of the row in a single call of the specialized kernel
+							if (specialized_row && out_x == indirection.getInteriorXBegin())
+							{
+								const int x_end = indirection.getInteriorXEnd();
+								const int8_t* row_input = sample_input + indirection.getOrigin(out_y * output_width + out_x);
+								if (cursor.getNextOutput() < (out_y * output_width + x_end) * output_depth)
+								{
+									DispatchSpecializedRow(specialization, row_input, out_x, x_end, 0, output_depth, input_width, filter_input_depth, filter_data,
+										[&](int interior_x, int out_channel, int32_t acc) { store(out_y, interior_x, out_channel, flip_faults(out_y, interior_x, out_channel, acc)); });
+								}
+								else
+								{
+									DispatchSpecializedRow(specialization, row_input, out_x, x_end, 0, output_depth, input_width, filter_input_depth, filter_data,
+										[&](int interior_x, int out_channel, int32_t acc) { store(out_y, interior_x, out_channel, acc); });
+								}
+								out_x = x_end - 1;
+								continue;
+							}
+
+							const int pixel = out_y * output_width + out_x;
+							const int32_t origin = indirection.getOrigin(pixel);
+							const ConvTap* taps = indirection.getTaps(pixel);
+							const int tap_count = indirection.getTapCount(pixel);
 							// 
 							for (int out_channel = 0; out_channel < output_depth; ++out_channel)
 							{
-								int outputPosition = batch * output_height * output_width * output_depth + out_y * output_width * output_depth + out_x * output_depth + out_channel;
-
 								// Will always be 0!!!!!!! input channels = filter input channels then filters per group = number of filters (output channels) so group = 0
 								auto group = out_channel / filters_per_group;
 
+								// Clean dot product of every tap inside the input, the channels of a tap are contiguous in the input and in the filter
+								// See ConvPerChannel for the overflow analysis of the 32 bits accumulator
+								const int8_t* filter_row = filter_data + Offset(filter_shape, out_channel, 0, 0, 0);
+								const int32_t channel_origin = origin + group * filter_input_depth;
 								int32_t acc = 0;
-								for (int filter_y = 0; filter_y < filter_height; ++filter_y)
+								for (int tap = 0; tap < tap_count; ++tap)
 								{
-									const int in_y = in_y_origin + dilation_height_factor * filter_y;
-									for (int filter_x = 0; filter_x < filter_width; ++filter_x)
-									{
-										const int in_x = in_x_origin + dilation_width_factor * filter_x;
-
-										// Zero padding by omitting the areas outside the image.
-										const bool is_point_inside_image =
-											(in_x >= 0) && (in_x < input_width) &&
-											(in_y >= 0) && (in_y < input_height);
-
-										if (!is_point_inside_image)
-										{
-											continue;
-										}
-
-										for (int in_channel = 0; in_channel < filter_input_depth; ++in_channel)
-										{
-											int kernelPartialPosition = filter_y * filter_width * filter_input_depth + filter_x * filter_input_depth + in_channel;
-
-											int32_t input_val = input_data[Offset(input_shape, batch, in_y, in_x, in_channel + group * filter_input_depth)];
-											int32_t filter_val = filter_data[Offset(filter_shape, out_channel, filter_y, filter_x, in_channel)];
-
-											int32_t result = filter_val * (input_val + input_offset);
-
-											if (idx_counter >= 0 && options.error_flat_positions[dataset_index][chunk_indexes[idx_counter]].first == outputPosition && options.error_flat_positions[dataset_index][chunk_indexes[idx_counter]].second == kernelPartialPosition)
-											{
-												std::bitset<32> bits(result);
-												bits.flip(options.bit_position);
-												result = static_cast<int>(bits.to_ulong());
-												idx_counter--;
-											}
-
-											// Accumulate with 32 bits accumulator.
-											// In the nudging process during model quantization, we force
-											// real value of 0.0 be represented by a quantized value. This
-											// guarantees that the input_offset is a int8_t, even though
-											// it is represented using int32_t. int32_t += int8_t *
-											// (int8_t - int8_t) so the highest value we can get from each
-											// accumulation is [-127, 127] * ([-128, 127] -
-											// [-128, 127]), which is [-32512, 32512]. log2(32512)
-											// = 14.98, which means we can accumulate at least 2^16
-											// multiplications without overflow. The accumulator is
-											// applied to a filter so the accumulation logic will hold as
-											// long as the filter size (filter_y * filter_x * in_channel)
-											// does not exceed 2^16, which is the case in all the models
-											// we have seen so far.
-											// TODO(b/174275578): Add a check to make sure the
-											// accumulator depth is smaller than 2^16.
-											acc += result;
-										}
-									}
+									acc += DotProductInt8(
+										sample_input + (channel_origin + taps[tap].input_offset),
+										filter_row + taps[tap].filter_offset,
+										filter_input_depth, input_offset);
 								}
 
-								if (bias_data)
-								{
-									acc += bias_data[out_channel];
-								}
-								acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
-								acc += output_offset;
-								acc = std::max(acc, output_activation_min);
-								acc = std::min(acc, output_activation_max);
-								output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] = static_cast<int8_t>(acc);
+								store(out_y, out_x, out_channel, flip_faults(out_y, out_x, out_channel, acc));
 							}
 						}
 					}
@@ -429,11 +619,122 @@ namespace tflite {
 			}
 			
 			
+			// Number of output channels per tile, an output cache line of int8 values
+			constexpr int kChannelBlock = 64;
+
+			// Gets the faulty multiplications of a tile drawn with the bit error rate, sorted in decreasing order
+			// The gaps between faulty multiplications are geometric, so the cost depends on the number of faults
+			// The tile index is part of the generator key, so the faults do not depend on the number of threads
+			// Tiles are numbered inside the sample and the image is the dataset index of the sample,
+			// so the faults of an image do not depend on the batch it is evaluated in
+			// Every trial of an image is drawn with its own seed
+			inline void GetTileBitErrors(
+				const int image, const int trial, const int tile, const int pixelPosition,
+				const int start_channel, const int end_channel,
+				const int in_y_origin, const int in_x_origin,
+				const int filter_height, const int filter_width, const int filter_input_depth,
+				const int dilation_width_factor, const int dilation_height_factor,
+				const int input_height, const int input_width,
+				const MyDelegateOptions& options,
+				FaultList& tile_errors)
+			{
+				tile_errors.Clear();
+
+				// Taps outside the image are not executed, so they can not fail
+				// The valid rows and columns of the filter are contiguous
+				int filter_y_start = filter_height, filter_y_end = 0;
+				for (int filter_y = 0; filter_y < filter_height; ++filter_y)
+				{
+					const int in_y = in_y_origin + dilation_height_factor * filter_y;
+					if (in_y >= 0 && in_y < input_height)
+					{
+						filter_y_start = std::min(filter_y_start, filter_y);
+						filter_y_end = filter_y + 1;
+					}
+				}
+				int filter_x_start = filter_width, filter_x_end = 0;
+				for (int filter_x = 0; filter_x < filter_width; ++filter_x)
+				{
+					const int in_x = in_x_origin + dilation_width_factor * filter_x;
+					if (in_x >= 0 && in_x < input_width)
+					{
+						filter_x_start = std::min(filter_x_start, filter_x);
+						filter_x_end = filter_x + 1;
+					}
+				}
+				if (filter_y_start >= filter_y_end || filter_x_start >= filter_x_end)
+					return;
+
+				const int valid_width = filter_x_end - filter_x_start;
+				const long long macs_per_channel = static_cast<long long>(filter_y_end - filter_y_start) * valid_width * filter_input_depth;
+				const long long tile_macs = macs_per_channel * (end_channel - start_channel);
+
+				PhiloxRandom generator(options.getTrialSeed(trial), options.node_index, image, tile);
+				const double log_complement = std::log1p(-options.bit_error_rate);
+				for (long long mac = generator.Geometric(log_complement); mac < tile_macs; mac += 1 + generator.Geometric(log_complement))
+				{
+					// Multiplications are numbered in the order of the kernel loops
+					const int out_channel = start_channel + static_cast<int>(mac / macs_per_channel);
+					const int remainder = static_cast<int>(mac % macs_per_channel);
+					const int filter_y = filter_y_start + remainder / (valid_width * filter_input_depth);
+					const int filter_x = filter_x_start + (remainder / filter_input_depth) % valid_width;
+					const int in_channel = remainder % filter_input_depth;
+					tile_errors.Add(pixelPosition + out_channel, filter_y * filter_width * filter_input_depth + filter_x * filter_input_depth + in_channel);
+				}
+				tile_errors.Reverse();
+			}
+
+			// Gets the faulty multiplications of a whole sample drawn with the bit error rate, sorted in decreasing order
+			// Faults are drawn with the same tiles as the tiled kernel, so every kernel sees the same faults
+			inline void GetSampleBitErrors(
+				const int image, const int trial,
+				const ConvParams& params,
+				const RuntimeShape& input_shape,
+				const RuntimeShape& filter_shape,
+				const RuntimeShape& output_shape,
+				const MyDelegateOptions& options,
+				FaultList& bit_errors)
+			{
+				const int output_depth = output_shape.Dims(3);
+				const int output_height = output_shape.Dims(1);
+				const int output_width = output_shape.Dims(2);
+				const int channel_blocks = (output_depth + kChannelBlock - 1) / kChannelBlock;
+				const int tiles_per_sample = output_height * output_width * channel_blocks;
+
+				// Tiles are visited backwards so the positions stay in decreasing order
+				bit_errors.Clear();
+				FaultList tile_errors;
+				for (int tile = tiles_per_sample - 1; tile >= 0; --tile)
+				{
+					const int channel_block = tile % channel_blocks;
+					const int out_x = (tile / channel_blocks) % output_width;
+					const int out_y = tile / (channel_blocks * output_width);
+					const int start_channel = channel_block * kChannelBlock;
+					const int end_channel = std::min(start_channel + kChannelBlock, output_depth);
+					const int pixelPosition = out_y * output_width * output_depth + out_x * output_depth;
+
+					GetTileBitErrors(
+						image, trial, tile, pixelPosition,
+						start_channel, end_channel,
+						(out_y * params.stride_height) - params.padding_values.height, (out_x * params.stride_width) - params.padding_values.width,
+						filter_shape.Dims(1), filter_shape.Dims(2), filter_shape.Dims(3),
+						params.dilation_width_factor, params.dilation_height_factor,
+						input_shape.Dims(1), input_shape.Dims(2),
+						options,
+						tile_errors);
+					bit_errors.Append(tile_errors);
+				}
+			}
+
 			// Raw operation to pararellize in threads
-			inline void DisturbedConvolutionOperationByChunks(
-				const int start_chunk, const int end_chunk,
+			// Computes the tile of output channels [start_channel, end_channel) of a single output pixel
+			// The tile index is counted inside the sample
+			inline void DisturbedConvolutionOperationByTile(
+				const int tile,
+				const int batch, const int out_y, const int out_x,
+				const int start_channel, const int end_channel,
 				const int32_t* output_multiplier, const int32_t* output_shift,
-				const int batches, const int output_height, const int output_width, const int output_depth,
+				const int output_height, const int output_width, const int output_depth,
 				const int filter_height, const int filter_width, const int filter_input_depth,
 				const int stride_height, const int pad_height,
 				const int stride_width, const int pad_width,
@@ -446,104 +747,114 @@ namespace tflite {
 				const RuntimeShape& filter_shape, const int8_t* filter_data,
 				const RuntimeShape& bias_shape, const int32_t* bias_data,
 				const RuntimeShape& output_shape, int8_t* output_data,
-				const std::vector<int>& chunk_indexes,
+				const ConvIndirection& indirection,
+				const ConvSpecialization& specialization,
 				const MyDelegateOptions& options)
 			{
-				const int& dataset_index = options.dataset_index;
-				int idx_counter = chunk_indexes.size() - 1;
-				// 1 For some reason tensor allocate only allows 1 image to be analyzed
-				for (int batch = 0; batch < batches; ++batch)
+				// Error positions are relative to the sample
+				const int pixelPosition = out_y * output_width * output_depth + out_x * output_depth;
+				const int in_y_origin = (out_y * stride_height) - pad_height;
+				const int in_x_origin = (out_x * stride_width) - pad_width;
+				const int8_t* sample_input = input_data + Offset(input_shape, batch, 0, 0, 0);
+				const int pixel = out_y * output_width + out_x;
+				const int32_t origin = indirection.getOrigin(pixel);
+				const ConvTap* taps = indirection.getTaps(pixel);
+				const int tap_count = indirection.getTapCount(pixel);
+
+				// Only the error positions of this tile are visited, from the back because they are sorted in decreasing order
+				FaultList tile_errors;
+				int idx_first, idx_last;
+				if (options.bit_error_rate > 0.0)
 				{
-					// 
-					for (int out_y = 0; out_y < output_height; ++out_y)
-					{
-						const int in_y_origin = (out_y * stride_height) - pad_height;
-						// 
-						for (int out_x = 0; out_x < output_width; ++out_x)
-						{
-							const int in_x_origin = (out_x * stride_width) - pad_width;
-							// 
-							for (int out_channel = start_chunk; out_channel < end_chunk; ++out_channel)
-							{
-								int outputPosition = batch * output_height * output_width * output_depth + out_y * output_width * output_depth + out_x * output_depth + out_channel;
-
-								// Will always be 0!!!!!!! input channels = filter input channels then filters per group = number of filters (output channels) so group = 0
-								auto group = out_channel / filters_per_group;
-
-								int32_t acc = 0;
-								for (int filter_y = 0; filter_y < filter_height; ++filter_y)
-								{
-									const int in_y = in_y_origin + dilation_height_factor * filter_y;
-									for (int filter_x = 0; filter_x < filter_width; ++filter_x)
-									{
-										const int in_x = in_x_origin + dilation_width_factor * filter_x;
-
-										// Zero padding by omitting the areas outside the image.
-										const bool is_point_inside_image =
-											(in_x >= 0) && (in_x < input_width) &&
-											(in_y >= 0) && (in_y < input_height);
-
-										if (!is_point_inside_image)
-										{
-											continue;
-										}
-
-										for (int in_channel = 0; in_channel < filter_input_depth; ++in_channel)
-										{
-											int kernelPartialPosition = filter_y * filter_width * filter_input_depth + filter_x * filter_input_depth + in_channel;
-
-											int32_t input_val = input_data[Offset(input_shape, batch, in_y, in_x, in_channel + group * filter_input_depth)];
-											int32_t filter_val = filter_data[Offset(filter_shape, out_channel, filter_y, filter_x, in_channel)];
-
-											int32_t result = filter_val * (input_val + input_offset);
+					GetTileBitErrors(
+						options.dataset_index + batch, 0, tile, pixelPosition,
+						start_channel, end_channel,
+						in_y_origin, in_x_origin,
+						filter_height, filter_width, filter_input_depth,
+						dilation_width_factor, dilation_height_factor,
+						input_height, input_width,
+						options,
+						tile_errors);
+					idx_first = 0;
+					idx_last = tile_errors.getSpan().size;
+				}
+				else
+				{
+					options.getErrorRange(pixelPosition + start_channel, pixelPosition + end_channel, idx_first, idx_last, batch);
+				}
+				const FaultSpan error_positions = options.bit_error_rate > 0.0 ? tile_errors.getSpan() : options.getErrorPositions(batch);
+				FaultCursor cursor(error_positions, idx_first, idx_last);
 
-											if (idx_counter >= 0 && options.error_flat_positions[dataset_index][chunk_indexes[idx_counter]].first == outputPosition && options.error_flat_positions[dataset_index][chunk_indexes[idx_counter]].second == kernelPartialPosition)
-											{
-												//std::unique_lock<std::mutex> lock(coutMutex);
-												//if (dataset_index == 0)
-												//{
-												//	std::cout << "Index counter " << idx_counter << "\n";
-												//}
-												//lock.unlock();
-												std::bitset<32> bits(result);
-												bits.flip(options.bit_position);
-												result = static_cast<int>(bits.to_ulong());
-												idx_counter--;
-											}
+				// Fault epilogue, the faulty products of the output are flipped on top of the clean sum
+				auto flip_faults = [&](int out_channel, int32_t acc)
+				{
+					const int outputPosition = pixelPosition + out_channel;
+					while (cursor.getNextOutput() == outputPosition)
+					{
+						const int kernelPartialPosition = cursor.Pop();
+						acc = FlipFaultyProduct(
+							acc, kernelPartialPosition, out_channel, out_channel / filters_per_group,
+							in_y_origin, in_x_origin,
+							filter_width, filter_input_depth,
+							input_height, input_width,
+							dilation_width_factor, dilation_height_factor,
+							input_offset,
+							input_shape, sample_input,
+							filter_shape, filter_data,
+							options.bit_position);
+					}
+					return acc;
+				};
 
-											// Accumulate with 32 bits accumulator.
-											// In the nudging process during model quantization, we force
-											// real value of 0.0 be represented by a quantized value. This
-											// guarantees that the input_offset is a int8_t, even though
-											// it is represented using int32_t. int32_t += int8_t *
-											// (int8_t - int8_t) so the highest value we can get from each
-											// accumulation is [-127, 127] * ([-128, 127] -
-											// [-128, 127]), which is [-32512, 32512]. log2(32512)
-											// = 14.98, which means we can accumulate at least 2^16
-											// multiplications without overflow. The accumulator is
-											// applied to a filter so the accumulation logic will hold as
-											// long as the filter size (filter_y * filter_x * in_channel)
-											// does not exceed 2^16, which is the case in all the models
-											// we have seen so far.
-											// TODO(b/174275578): Add a check to make sure the
-											// accumulator depth is smaller than 2^16.
-											acc += result;
-										}
-									}
-								}
+				// Bias and requantization of the output
+				auto store = [&](int out_channel, int32_t acc)
+				{
+					if (bias_data)
+					{
+						acc += bias_data[out_channel];
+					}
+					acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
+					acc += output_offset;
+					acc = std::max(acc, output_activation_min);
+					acc = std::min(acc, output_activation_max);
+					output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] = static_cast<int8_t>(acc);
+				};
+
+				// Interior pixels use the specialized kernel, tiles without faults skip the fault cursor
+				if (specialization.getFilterSize() != 0 && indirection.isInteriorRow(out_y) &&
+					out_x >= indirection.getInteriorXBegin() && out_x < indirection.getInteriorXEnd())
+				{
+					if (cursor.hasFaults())
+					{
+						DispatchSpecializedRow(specialization, sample_input + origin, out_x, out_x + 1, start_channel, end_channel, input_width, filter_input_depth, filter_data,
+							[&](int, int out_channel, int32_t acc) { store(out_channel, flip_faults(out_channel, acc)); });
+					}
+					else
+					{
+						DispatchSpecializedRow(specialization, sample_input + origin, out_x, out_x + 1, start_channel, end_channel, input_width, filter_input_depth, filter_data,
+							[&](int, int out_channel, int32_t acc) { store(out_channel, acc); });
+					}
+					return;
+				}
 
-								if (bias_data)
-								{
-									acc += bias_data[out_channel];
-								}
-								acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
-								acc += output_offset;
-								acc = std::max(acc, output_activation_min);
-								acc = std::min(acc, output_activation_max);
-								output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] = static_cast<int8_t>(acc);
-							}
-						}
+				for (int out_channel = start_channel; out_channel < end_channel; ++out_channel)
+				{
+					// Will always be 0!!!!!!! input channels = filter input channels then filters per group = number of filters (output channels) so group = 0
+					auto group = out_channel / filters_per_group;
+
+					// Clean dot product of every tap inside the input, see DisturbedConvolutionOperation
+					const int8_t* filter_row = filter_data + Offset(filter_shape, out_channel, 0, 0, 0);
+					const int32_t channel_origin = origin + group * filter_input_depth;
+					int32_t acc = 0;
+					for (int tap = 0; tap < tap_count; ++tap)
+					{
+						acc += DotProductInt8(
+							sample_input + (channel_origin + taps[tap].input_offset),
+							filter_row + taps[tap].filter_offset,
+							filter_input_depth, input_offset);
 					}
+
+					store(out_channel, flip_faults(out_channel, acc));
 				}
 			}
 
@@ -562,83 +873,65 @@ namespace tflite {
 				const RuntimeShape& filter_shape, const int8_t* filter_data,
 				const RuntimeShape& bias_shape, const int32_t* bias_data,
 				const RuntimeShape& output_shape, int8_t* output_data,
+				const ConvIndirection& indirection,
+				const ConvSpecialization& specialization,
 				const MyDelegateOptions& options)
 			{
-				std::vector<std::thread> threadPool;
-				//std::mutex coutMutex;
-
-				for (int i = 0; i < options.num_threads; ++i)
-				{
-					const int start = i * options.chunk_size;
-					const int end = std::min(start + options.chunk_size, options.channels);
-
-#if LOGGER
-					//if (dataset_index == 2)
-					//{
-					//	std::cout << "Indexes size " << options.chunks_indexes.size() << "\n";
-					//	std::cout << "Indexes capacity " << options.chunks_indexes.capacity() << "\n";
-					//	std::cout << "Start: " << start << " End: " << end << "\n";
-					//	std::cout << "Indexes in chunk " << i << ": ";
-					//	for (const auto& val : options.chunks_indexes[dataset_index][i])
-					//	{
-					//		std::cout << val << " ";
-					//	}
-					//	std::cout << "\n";
-					//}
-					
-					//std::cout << "Real positions\n";
-					//for (const auto& val : options.error_vec_positions[dataset_index])
-					//{
-					//	for (const int& element : val.first)
-					//	{
-					//		std::cout << element << " ";
-					//	}
-					//	std::cout << "- ";
-					//	for (const int& element : val.second)
-					//	{
-					//		std::cout << element << " ";
-					//	}
-					//	std::cout << "\n";
-					//}
-					//std::cout << "\n";
-#endif // LOGGER
-
-					threadPool.emplace_back(
-						DisturbedConvolutionOperationByChunks,
-						start, end,
-						output_multiplier, output_shift,
-						batches, output_height, output_width, output_depth,
-						filter_height, filter_width, filter_input_depth,
-						stride_height, pad_height,
-						stride_width, pad_width,
-						input_height, input_width,
-						filters_per_group,
-						dilation_width_factor, dilation_height_factor,
-						input_offset, output_offset,
-						output_activation_min, output_activation_max,
-						std::cref(input_shape), input_data,
-						std::cref(filter_shape), filter_data,
-						std::cref(bias_shape), bias_data,
-						std::cref(output_shape), output_data,
-						std::cref(options.chunks_indexes[options.dataset_index][i]),
-						std::cref(options));
-				}
-
-				// Join all threads
-				for (auto& thread : threadPool)
-				{
-					thread.join();
-				}	
+				// Tiles are (batch, out_y, out_x, channel block), channel blocks are the fastest changing index
+				// so every thread writes whole cache lines of the NHWC output
+				const int channel_blocks = (output_depth + kChannelBlock - 1) / kChannelBlock;
+				const int tiles_per_sample = output_height * output_width * channel_blocks;
+				const int num_tiles = batches * tiles_per_sample;
+
+				options.thread_pool->ParallelFor(num_tiles, options.num_threads, 
+					[&](int tile)
+					{
+						const int channel_block = tile % channel_blocks;
+						const int out_x = (tile / channel_blocks) % output_width;
+						const int out_y = (tile / (channel_blocks * output_width)) % output_height;
+						const int batch = tile / (channel_blocks * output_width * output_height);
+						const int start_channel = channel_block * kChannelBlock;
+						const int end_channel = std::min(start_channel + kChannelBlock, output_depth);
+
+						DisturbedConvolutionOperationByTile(
+							tile % tiles_per_sample,
+							batch, out_y, out_x,
+							start_channel, end_channel,
+							output_multiplier, output_shift,
+							output_height, output_width, output_depth,
+							filter_height, filter_width, filter_input_depth,
+							stride_height, pad_height,
+							stride_width, pad_width,
+							input_height, input_width,
+							filters_per_group,
+							dilation_width_factor, dilation_height_factor,
+							input_offset, output_offset,
+							output_activation_min, output_activation_max,
+							input_shape, input_data,
+							filter_shape, filter_data,
+							bias_shape, bias_data,
+							output_shape, output_data,
+							indirection,
+							specialization,
+							options);
+					});
 			}
 
-			// Fixed-point per-channel-quantization convolution reference kernel.
-			inline void ConvPerChannelDisturbed(
-				const ConvParams& params, 
-				const int32_t* output_multiplier, const int32_t* output_shift, 
-				const RuntimeShape& input_shape, const int8_t* input_data, 
-				const RuntimeShape& filter_shape, const int8_t* filter_data, 
-				const RuntimeShape& bias_shape, const int32_t* bias_data, 
-				const RuntimeShape& output_shape, int8_t* output_data, 
+			// Expands the clean output of the first sample of every group of samples holding the same image
+			// into the outputs of every trial and bit position
+			// Samples of a group are ordered by trial and then by bit position, with bit k flipped
+			// when sweeping the bit positions and bit_position flipped otherwise
+			// The first sample of every group must hold the clean output and all the samples of a group the same image
+			// Every faulty output of a trial is accumulated once, flipping bit k changes a product by (product ^ 2^k) - product,
+			// so each bit position only adds its delta to the accumulator and requantizes it
+			// The result is bit-identical to ConvPerChannelDisturbed evaluated once per trial and bit position
+			inline void RecomputeGroupedOutputs(
+				const ConvParams& params,
+				const int32_t* output_multiplier, const int32_t* output_shift,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const RuntimeShape& bias_shape, const int32_t* bias_data,
+				const RuntimeShape& output_shape, int8_t* output_data,
 				const MyDelegateOptions& options)
 			{
 				// Get parameters.
@@ -655,34 +948,989 @@ namespace tflite {
 				const int32_t output_activation_min = params.quantized_activation_min;
 				const int32_t output_activation_max = params.quantized_activation_max;
 
-				// Consistency check.
-				TFLITE_DCHECK_LE(output_activation_min, output_activation_max);
-				TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
-				TFLITE_DCHECK_EQ(filter_shape.DimensionsCount(), 4);
-				TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
-				const int batches = MatchingDim(input_shape, 0, output_shape, 0);
 				const int input_depth = input_shape.Dims(3);
 				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
-				if (bias_data)
-				{
-					TFLITE_DCHECK_EQ(bias_shape.FlatSize(), output_depth);
-				}
-
-				// Check dimensions of the tensors.
 				const int input_height = input_shape.Dims(1);
 				const int input_width = input_shape.Dims(2);
 				const int filter_height = filter_shape.Dims(1);
 				const int filter_width = filter_shape.Dims(2);
 				const int filter_input_depth = filter_shape.Dims(3);
 				const int groups = input_depth / filter_input_depth;
-				TFLITE_DCHECK_NE(groups, 0);
-				TFLITE_DCHECK_EQ(input_depth % filter_input_depth, 0);
 				const int filters_per_group = output_depth / groups;
-				TFLITE_DCHECK_NE(filters_per_group, 0);
 				const int output_height = output_shape.Dims(1);
 				const int output_width = output_shape.Dims(2);
-				
-				if (options.is_threaded)
+				const int sample_size = output_height * output_width * output_depth;
+
+				const int samples_per_image = options.getSamplesPerImage();
+				const int bit_variants = options.getBitVariants();
+				const int images = MatchingDim(input_shape, 0, output_shape, 0) / samples_per_image;
+				FaultList bit_errors;
+				for (int image = 0; image < images; ++image)
+				{
+					// Every trial and bit position starts from the clean output
+					const int first_sample = image * samples_per_image;
+					int8_t* group_output = output_data + first_sample * sample_size;
+					for (int sample = 1; sample < samples_per_image; ++sample)
+					{
+						std::memcpy(group_output + sample * sample_size, group_output, sample_size);
+					}
+
+					for (int trial = 0; trial < options.trials_per_invoke; ++trial)
+					{
+						const int trial_sample = first_sample + trial * bit_variants;
+						if (options.bit_error_rate > 0.0)
+						{
+							GetSampleBitErrors(options.dataset_index + image, trial, params, input_shape, filter_shape, output_shape, options, bit_errors);
+						}
+
+						const FaultSpan error_positions = options.bit_error_rate > 0.0 ? bit_errors.getSpan() : options.getErrorPositions(image, trial);
+						FaultCursor cursor(error_positions, 0, error_positions.size);
+						while (cursor.hasFaults())
+						{
+							const int outputPosition = cursor.getNextOutput();
+
+							// Converting the flat position of the sample into the output position vector
+							const int out_channel = outputPosition % output_depth;
+							const int out_x = (outputPosition / output_depth) % output_width;
+							const int out_y = outputPosition / (output_depth * output_width);
+
+							const int in_y_origin = (out_y * stride_height) - pad_height;
+							const int in_x_origin = (out_x * stride_width) - pad_width;
+							auto group = out_channel / filters_per_group;
+
+							// Clean accumulator and the change of every bit position, wrapping like the int32 accumulator
+							int32_t acc = 0;
+							uint32_t deltas[MyDelegateOptions::num_bit_positions] = {};
+							for (int filter_y = 0; filter_y < filter_height; ++filter_y)
+							{
+								const int in_y = in_y_origin + dilation_height_factor * filter_y;
+								for (int filter_x = 0; filter_x < filter_width; ++filter_x)
+								{
+									const int in_x = in_x_origin + dilation_width_factor * filter_x;
+
+									// Zero padding by omitting the areas outside the image.
+									const bool is_point_inside_image =
+										(in_x >= 0) && (in_x < input_width) &&
+										(in_y >= 0) && (in_y < input_height);
+
+									if (!is_point_inside_image)
+									{
+										continue;
+									}
+
+									acc += DotProductInt8(
+										input_data + Offset(input_shape, first_sample, in_y, in_x, group * filter_input_depth),
+										filter_data + Offset(filter_shape, out_channel, filter_y, filter_x, 0),
+										filter_input_depth, input_offset);
+								}
+							}
+
+							// Fault epilogue, every bit position adds the change of the faulty products of the output
+							// Padded multiplications are not performed, so they can not be disturbed
+							while (cursor.getNextOutput() == outputPosition)
+							{
+								const int kernelPartialPosition = cursor.Pop();
+								const int in_channel = kernelPartialPosition % filter_input_depth;
+								const int filter_x = (kernelPartialPosition / filter_input_depth) % filter_width;
+								const int filter_y = kernelPartialPosition / (filter_input_depth * filter_width);
+								const int in_y = in_y_origin + dilation_height_factor * filter_y;
+								const int in_x = in_x_origin + dilation_width_factor * filter_x;
+								if (in_x < 0 || in_x >= input_width || in_y < 0 || in_y >= input_height)
+								{
+									continue;
+								}
+
+								int32_t input_val = input_data[Offset(input_shape, first_sample, in_y, in_x, in_channel + group * filter_input_depth)];
+								int32_t filter_val = filter_data[Offset(filter_shape, out_channel, filter_y, filter_x, in_channel)];
+								const uint32_t product = static_cast<uint32_t>(filter_val * (input_val + input_offset));
+								for (int variant = 0; variant < bit_variants; ++variant)
+								{
+									const int bit = options.sweep_bit_positions ? variant : options.bit_position;
+									deltas[variant] += (product ^ (1u << bit)) - product;
+								}
+							}
+
+							if (bias_data)
+							{
+								acc += bias_data[out_channel];
+							}
+							for (int variant = 0; variant < bit_variants; ++variant)
+							{
+								int32_t disturbed_acc = static_cast<int32_t>(static_cast<uint32_t>(acc) + deltas[variant]);
+								disturbed_acc = MultiplyByQuantizedMultiplier(disturbed_acc, output_multiplier[out_channel], output_shift[out_channel]);
+								disturbed_acc += output_offset;
+								disturbed_acc = std::max(disturbed_acc, output_activation_min);
+								disturbed_acc = std::min(disturbed_acc, output_activation_max);
+								output_data[Offset(output_shape, trial_sample + variant, out_y, out_x, out_channel)] = static_cast<int8_t>(disturbed_acc);
+							}
+						}
+					}
+				}
+			}
+
+			// Reference kernel of the grouped evaluation
+			// Only the first sample of every group is convolved, the trials and bit positions are expanded from it
+			inline void ConvPerChannelGrouped(
+				const ConvParams& params,
+				const int32_t* output_multiplier, const int32_t* output_shift,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const RuntimeShape& bias_shape, const int32_t* bias_data,
+				const RuntimeShape& output_shape, int8_t* output_data,
+				const MyDelegateOptions& options)
+			{
+				const int samples_per_image = options.getSamplesPerImage();
+				RuntimeShape input_sample_shape(input_shape);
+				input_sample_shape.SetDim(0, 1);
+				RuntimeShape output_sample_shape(output_shape);
+				output_sample_shape.SetDim(0, 1);
+
+				const int images = MatchingDim(input_shape, 0, output_shape, 0) / samples_per_image;
+				for (int image = 0; image < images; ++image)
+				{
+					ConvPerChannel(
+						params, output_multiplier, output_shift,
+						input_sample_shape, input_data + image * samples_per_image * input_sample_shape.FlatSize(),
+						filter_shape, filter_data,
+						bias_shape, bias_data,
+						output_sample_shape, output_data + image * samples_per_image * output_sample_shape.FlatSize(),
+						options);
+				}
+				RecomputeGroupedOutputs(
+					params, output_multiplier, output_shift,
+					input_shape, input_data,
+					filter_shape, filter_data,
+					bias_shape, bias_data,
+					output_shape, output_data,
+					options);
+			}
+
+			// Clean accumulators of a single sample with the blocked GEMM of the packed filter, bias included
+			// Every block of gemm::kBlockPixels output pixels is expanded into im2col rows and multiplied by every panel
+			// Padded taps take the input zero point, so their products are 0 like the omitted multiplications
+			// Blocks are split between the threads of the pool when the node is threaded
+			inline void ConvAccumulatorsGemm(
+				const ConvParams& params,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape,
+				const int32_t* bias_data,
+				const RuntimeShape& output_shape, int32_t* accumulators,
+				const PackedFilter& packed_filter,
+				const MyDelegateOptions& options)
+			{
+				const int32_t input_offset = params.input_offset;  // r = s(q - Z)
+				const int stride_width = params.stride_width;
+				const int stride_height = params.stride_height;
+				const int dilation_width_factor = params.dilation_width_factor;
+				const int dilation_height_factor = params.dilation_height_factor;
+				const int pad_width = params.padding_values.width;
+				const int pad_height = params.padding_values.height;
+
+				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+				const int input_height = input_shape.Dims(1);
+				const int input_width = input_shape.Dims(2);
+				const int filter_height = filter_shape.Dims(1);
+				const int filter_width = filter_shape.Dims(2);
+				const int filter_input_depth = filter_shape.Dims(3);
+				const int output_width = output_shape.Dims(2);
+				const int output_pixels = output_shape.Dims(1) * output_width;
+				const int padded_depth = packed_filter.padded_depth;
+				const int8_t padding_value = static_cast<int8_t>(-input_offset);
+
+				auto multiply_block = [&](int block)
+				{
+					// Every thread keeps its own im2col block
+					thread_local std::vector<int8_t> im2col;
+					im2col.resize(static_cast<size_t>(gemm::kBlockPixels) * padded_depth);
+
+					const int first_pixel = block * gemm::kBlockPixels;
+					const int rows = std::min(gemm::kBlockPixels, output_pixels - first_pixel);
+					for (int row = 0; row < rows; ++row)
+					{
+						const int out_y = (first_pixel + row) / output_width;
+						const int out_x = (first_pixel + row) % output_width;
+						const int in_y_origin = (out_y * stride_height) - pad_height;
+						const int in_x_origin = (out_x * stride_width) - pad_width;
+						int8_t* im2col_row = im2col.data() + static_cast<size_t>(row) * padded_depth;
+						for (int filter_y = 0; filter_y < filter_height; ++filter_y)
+						{
+							const int in_y = in_y_origin + dilation_height_factor * filter_y;
+							for (int filter_x = 0; filter_x < filter_width; ++filter_x)
+							{
+								const int in_x = in_x_origin + dilation_width_factor * filter_x;
+								if (in_x >= 0 && in_x < input_width && in_y >= 0 && in_y < input_height)
+								{
+									std::memcpy(im2col_row, input_data + Offset(input_shape, 0, in_y, in_x, 0), filter_input_depth);
+								}
+								else
+								{
+									std::memset(im2col_row, padding_value, filter_input_depth);
+								}
+								im2col_row += filter_input_depth;
+							}
+						}
+						// The padded depth meets zero weights
+						std::memset(im2col_row, 0, padded_depth - packed_filter.depth);
+					}
+
+					int32_t* block_accumulators = accumulators + static_cast<size_t>(first_pixel) * output_depth;
+					gemm::Multiply(im2col.data(), rows, packed_filter, input_offset, block_accumulators);
+					if (bias_data)
+					{
+						for (int row = 0; row < rows; ++row)
+						{
+							for (int out_channel = 0; out_channel < output_depth; ++out_channel)
+							{
+								block_accumulators[row * output_depth + out_channel] += bias_data[out_channel];
+							}
+						}
+					}
+				};
+
+				const int blocks = (output_pixels + gemm::kBlockPixels - 1) / gemm::kBlockPixels;
+				if (options.is_threaded && options.thread_pool)
+				{
+					options.thread_pool->ParallelFor(blocks, options.num_threads, multiply_block);
+				}
+				else
+				{
+					for (int block = 0; block < blocks; ++block)
+					{
+						multiply_block(block);
+					}
+				}
+			}
+
+			// Clean accumulators of a single sample before requantization, bias included
+			// Output rows are split between the threads of the pool when the node is threaded
+			// The GEMM backend computes them from the packed filter
+			inline void ConvAccumulators(
+				const ConvParams& params,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const int32_t* bias_data,
+				const RuntimeShape& output_shape, int32_t* accumulators,
+				const MyDelegateOptions& options)
+			{
+				const int32_t input_offset = params.input_offset;  // r = s(q - Z)
+
+				const int input_depth = input_shape.Dims(3);
+				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+				const int filter_input_depth = filter_shape.Dims(3);
+				const int groups = input_depth / filter_input_depth;
+				const int filters_per_group = output_depth / groups;
+				const int output_height = output_shape.Dims(1);
+				const int output_width = output_shape.Dims(2);
+
+				if (options.packed_filter && groups == 1)
+				{
+					ConvAccumulatorsGemm(
+						params,
+						input_shape, input_data,
+						filter_shape,
+						bias_data,
+						output_shape, accumulators,
+						*options.packed_filter,
+						options);
+					return;
+				}
+
+				// Taps of every output pixel inside the input, no tap is checked against the padding
+				const std::shared_ptr<const ConvIndirection> indirection = getConvIndirection(params, input_shape, filter_shape, output_shape, options);
+				const int8_t* sample_input = input_data;
+
+				auto accumulate_row = [&](int out_y)
+				{
+					for (int out_x = 0; out_x < output_width; ++out_x)
+					{
+						const int pixel = out_y * output_width + out_x;
+						const int32_t origin = indirection->getOrigin(pixel);
+						const ConvTap* taps = indirection->getTaps(pixel);
+						const int tap_count = indirection->getTapCount(pixel);
+						for (int out_channel = 0; out_channel < output_depth; ++out_channel)
+						{
+							auto group = out_channel / filters_per_group;
+							const int8_t* filter_row = filter_data + Offset(filter_shape, out_channel, 0, 0, 0);
+							const int32_t channel_origin = origin + group * filter_input_depth;
+							int32_t acc = 0;
+							for (int tap = 0; tap < tap_count; ++tap)
+							{
+								acc += DotProductInt8(
+									sample_input + (channel_origin + taps[tap].input_offset),
+									filter_row + taps[tap].filter_offset,
+									filter_input_depth, input_offset);
+							}
+							if (bias_data)
+							{
+								acc += bias_data[out_channel];
+							}
+							accumulators[Offset(output_shape, 0, out_y, out_x, out_channel)] = acc;
+						}
+					}
+				};
+
+				if (options.is_threaded && options.thread_pool)
+				{
+					options.thread_pool->ParallelFor(output_height, options.num_threads, accumulate_row);
+				}
+				else
+				{
+					for (int out_y = 0; out_y < output_height; ++out_y)
+					{
+						accumulate_row(out_y);
+					}
+				}
+			}
+
+			// Clean convolution of the GEMM backend, the accumulators of every sample are requantized
+			inline void ConvPerChannelGemm(
+				const ConvParams& params,
+				const int32_t* output_multiplier, const int32_t* output_shift,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const RuntimeShape& bias_shape, const int32_t* bias_data,
+				const RuntimeShape& output_shape, int8_t* output_data,
+				const MyDelegateOptions& options)
+			{
+				const int32_t output_offset = params.output_offset;
+				const int32_t output_activation_min = params.quantized_activation_min;
+				const int32_t output_activation_max = params.quantized_activation_max;
+				const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+
+				RuntimeShape input_sample_shape(input_shape);
+				input_sample_shape.SetDim(0, 1);
+				RuntimeShape output_sample_shape(output_shape);
+				output_sample_shape.SetDim(0, 1);
+				const int input_size = input_sample_shape.FlatSize();
+				const int sample_size = output_sample_shape.FlatSize();
+
+				std::vector<int32_t> accumulators(sample_size);
+				for (int batch = 0; batch < batches; ++batch)
+				{
+					ConvAccumulators(
+						params,
+						input_sample_shape, input_data + batch * input_size,
+						filter_shape, filter_data,
+						bias_data,
+						output_sample_shape, accumulators.data(),
+						options);
+
+					int8_t* sample_output = output_data + batch * sample_size;
+					for (int position = 0; position < sample_size; ++position)
+					{
+						const int out_channel = position % output_depth;
+						int32_t acc = MultiplyByQuantizedMultiplier(accumulators[position], output_multiplier[out_channel], output_shift[out_channel]);
+						acc += output_offset;
+						acc = std::max(acc, output_activation_min);
+						acc = std::min(acc, output_activation_max);
+						sample_output[position] = static_cast<int8_t>(acc);
+					}
+				}
+			}
+
+			// Kernel of the accumulator cache
+			// The clean accumulators of every image are taken from options.accumulator_cache, or computed and stored
+			// when the image is not cached for the same input sample
+			// The clean output is requantized from them and only the faulty outputs add the change of their faulty products,
+			// (product ^ 2^k) - product for bit k, so no multiplication is repeated except the faulty ones
+			// Groups of samples of the same image are expanded like ConvPerChannelGrouped
+			// Without cache the accumulators of every image are computed into a scratch buffer, the GEMM backend
+			// uses it as its sparse correction of the faulty products
+			// The result is bit-identical to ConvPerChannelDisturbed without cache
+			inline void ConvPerChannelCached(
+				const ConvParams& params,
+				const int32_t* output_multiplier, const int32_t* output_shift,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const RuntimeShape& bias_shape, const int32_t* bias_data,
+				const RuntimeShape& output_shape, int8_t* output_data,
+				const MyDelegateOptions& options)
+			{
+				// Get parameters.
+				const int32_t input_offset = params.input_offset;  // r = s(q - Z)
+				const int stride_width = params.stride_width;
+				const int stride_height = params.stride_height;
+				const int dilation_width_factor = params.dilation_width_factor;
+				const int dilation_height_factor = params.dilation_height_factor;
+				const int pad_width = params.padding_values.width;
+				const int pad_height = params.padding_values.height;
+				const int32_t output_offset = params.output_offset;
+
+				// Set min and max value of the output.
+				const int32_t output_activation_min = params.quantized_activation_min;
+				const int32_t output_activation_max = params.quantized_activation_max;
+
+				const int input_depth = input_shape.Dims(3);
+				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+				const int input_height = input_shape.Dims(1);
+				const int input_width = input_shape.Dims(2);
+				const int filter_width = filter_shape.Dims(2);
+				const int filter_input_depth = filter_shape.Dims(3);
+				const int groups = input_depth / filter_input_depth;
+				const int filters_per_group = output_depth / groups;
+				const int output_width = output_shape.Dims(2);
+
+				RuntimeShape input_sample_shape(input_shape);
+				input_sample_shape.SetDim(0, 1);
+				RuntimeShape output_sample_shape(output_shape);
+				output_sample_shape.SetDim(0, 1);
+				const int input_size = input_sample_shape.FlatSize();
+				const int sample_size = output_sample_shape.FlatSize();
+
+				auto requantize = [&](int32_t acc, int out_channel)
+				{
+					acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
+					acc += output_offset;
+					acc = std::max(acc, output_activation_min);
+					acc = std::min(acc, output_activation_max);
+					return static_cast<int8_t>(acc);
+				};
+
+				AccumulatorCache* cache = options.accumulator_cache.get();
+				const int samples_per_image = options.getSamplesPerImage();
+				const int bit_variants = options.getBitVariants();
+				const int trials = samples_per_image / bit_variants;
+				const int images = MatchingDim(input_shape, 0, output_shape, 0) / samples_per_image;
+				std::vector<int32_t> scratch;
+				FaultList bit_errors;
+				for (int image = 0; image < images; ++image)
+				{
+					const int first_sample = image * samples_per_image;
+					const int8_t* image_input = input_data + first_sample * input_size;
+					const int dataset_image = options.dataset_index + image;
+
+					// Images outside the dataset are computed without being stored
+					const uint64_t input_key = cache ? AccumulatorCache::Hash(image_input, input_size) : 0;
+					const int32_t* accumulators = cache ? cache->Find(dataset_image, input_key) : nullptr;
+					if (accumulators == nullptr)
+					{
+						int32_t* storage = cache ? cache->getStorage(dataset_image) : nullptr;
+						if (storage == nullptr)
+						{
+							scratch.resize(sample_size);
+							storage = scratch.data();
+						}
+						ConvAccumulators(
+							params,
+							input_sample_shape, image_input,
+							filter_shape, filter_data,
+							bias_data,
+							output_sample_shape, storage,
+							options);
+						if (cache)
+						{
+							cache->Store(dataset_image, input_key);
+						}
+						accumulators = storage;
+					}
+
+					// Every trial and bit position starts from the clean output
+					int8_t* group_output = output_data + first_sample * sample_size;
+					for (int position = 0; position < sample_size; ++position)
+					{
+						group_output[position] = requantize(accumulators[position], position % output_depth);
+					}
+					for (int sample = 1; sample < samples_per_image; ++sample)
+					{
+						std::memcpy(group_output + sample * sample_size, group_output, sample_size);
+					}
+
+					for (int trial = 0; trial < trials; ++trial)
+					{
+						if (options.bit_error_rate > 0.0)
+						{
+							GetSampleBitErrors(dataset_image, trial, params, input_shape, filter_shape, output_shape, options, bit_errors);
+						}
+
+						const FaultSpan error_positions = options.bit_error_rate > 0.0 ? bit_errors.getSpan() : options.getErrorPositions(image, trial);
+						int8_t* trial_output = group_output + trial * bit_variants * sample_size;
+						FaultCursor cursor(error_positions, 0, error_positions.size);
+						while (cursor.hasFaults())
+						{
+							const int outputPosition = cursor.getNextOutput();
+
+							// Converting the flat position of the sample into the output position vector
+							const int out_channel = outputPosition % output_depth;
+							const int out_x = (outputPosition / output_depth) % output_width;
+							const int out_y = outputPosition / (output_depth * output_width);
+							const int in_y_origin = (out_y * stride_height) - pad_height;
+							const int in_x_origin = (out_x * stride_width) - pad_width;
+							auto group = out_channel / filters_per_group;
+
+							// Change of every bit position, wrapping like the int32 accumulator
+							uint32_t deltas[MyDelegateOptions::num_bit_positions] = {};
+							while (cursor.getNextOutput() == outputPosition)
+							{
+								// Converting the kernel partial position into the filter position vector
+								const int kernelPartialPosition = cursor.Pop();
+								const int in_channel = kernelPartialPosition % filter_input_depth;
+								const int filter_x = (kernelPartialPosition / filter_input_depth) % filter_width;
+								const int filter_y = kernelPartialPosition / (filter_input_depth * filter_width);
+								const int in_y = in_y_origin + dilation_height_factor * filter_y;
+								const int in_x = in_x_origin + dilation_width_factor * filter_x;
+
+								// Padded multiplications are not performed, so they can not be disturbed
+								if (in_x < 0 || in_x >= input_width || in_y < 0 || in_y >= input_height)
+								{
+									continue;
+								}
+
+								int32_t input_val = image_input[Offset(input_sample_shape, 0, in_y, in_x, in_channel + group * filter_input_depth)];
+								int32_t filter_val = filter_data[Offset(filter_shape, out_channel, filter_y, filter_x, in_channel)];
+								const uint32_t product = static_cast<uint32_t>(filter_val * (input_val + input_offset));
+								for (int variant = 0; variant < bit_variants; ++variant)
+								{
+									const int bit = options.sweep_bit_positions ? variant : options.bit_position;
+									deltas[variant] += (product ^ (1u << bit)) - product;
+								}
+							}
+
+							for (int variant = 0; variant < bit_variants; ++variant)
+							{
+								const int32_t disturbed_acc = static_cast<int32_t>(static_cast<uint32_t>(accumulators[outputPosition]) + deltas[variant]);
+								trial_output[variant * sample_size + outputPosition] = requantize(disturbed_acc, out_channel);
+							}
+						}
+					}
+				}
+			}
+
+			// Kernel of the per-image weight faults
+			// Every trial of an image flips bit_position of its own weights, the error positions are pairs of output channel
+			// and position inside the row of the kernel of that channel
+			// The clean accumulators of an image are computed once, or taken from options.accumulator_cache, and requantized
+			// to every sample of the group, then every output channel with flipped weights adds (w' - w) * (input + input_offset)
+			// of its flipped taps to each of its output pixels, so no other output is computed again
+			// The result is bit-identical to the clean convolution with the flipped kernel
+			inline void ConvPerChannelWeightFaults(
+				const ConvParams& params,
+				const int32_t* output_multiplier, const int32_t* output_shift,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const RuntimeShape& bias_shape, const int32_t* bias_data,
+				const RuntimeShape& output_shape, int8_t* output_data,
+				const MyDelegateOptions& options)
+			{
+				// Get parameters.
+				const int32_t input_offset = params.input_offset;  // r = s(q - Z)
+				const int stride_width = params.stride_width;
+				const int stride_height = params.stride_height;
+				const int dilation_width_factor = params.dilation_width_factor;
+				const int dilation_height_factor = params.dilation_height_factor;
+				const int pad_width = params.padding_values.width;
+				const int pad_height = params.padding_values.height;
+				const int32_t output_offset = params.output_offset;
+
+				// Set min and max value of the output.
+				const int32_t output_activation_min = params.quantized_activation_min;
+				const int32_t output_activation_max = params.quantized_activation_max;
+
+				const int input_depth = input_shape.Dims(3);
+				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+				const int input_height = input_shape.Dims(1);
+				const int input_width = input_shape.Dims(2);
+				const int filter_width = filter_shape.Dims(2);
+				const int filter_input_depth = filter_shape.Dims(3);
+				const int groups = input_depth / filter_input_depth;
+				const int filters_per_group = output_depth / groups;
+				const int output_height = output_shape.Dims(1);
+				const int output_width = output_shape.Dims(2);
+
+				RuntimeShape input_sample_shape(input_shape);
+				input_sample_shape.SetDim(0, 1);
+				RuntimeShape output_sample_shape(output_shape);
+				output_sample_shape.SetDim(0, 1);
+				const int input_size = input_sample_shape.FlatSize();
+				const int sample_size = output_sample_shape.FlatSize();
+
+				auto requantize = [&](int32_t acc, int out_channel)
+				{
+					acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
+					acc += output_offset;
+					acc = std::max(acc, output_activation_min);
+					acc = std::min(acc, output_activation_max);
+					return static_cast<int8_t>(acc);
+				};
+
+				// Flipped taps of the output channel being corrected
+				struct WeightFault
+				{
+					int filter_y;
+					int filter_x;
+					int in_channel;
+					int32_t weight_change;
+				};
+
+				AccumulatorCache* cache = options.accumulator_cache.get();
+				const int samples_per_image = options.getSamplesPerImage();
+				const int images = MatchingDim(input_shape, 0, output_shape, 0) / samples_per_image;
+				std::vector<int32_t> scratch;
+				std::vector<WeightFault> weight_faults;
+				for (int image = 0; image < images; ++image)
+				{
+					const int first_sample = image * samples_per_image;
+					const int8_t* image_input = input_data + first_sample * input_size;
+					const int dataset_image = options.dataset_index + image;
+
+					// Images outside the dataset are computed without being stored
+					const uint64_t input_key = cache ? AccumulatorCache::Hash(image_input, input_size) : 0;
+					const int32_t* accumulators = cache ? cache->Find(dataset_image, input_key) : nullptr;
+					if (accumulators == nullptr)
+					{
+						int32_t* storage = cache ? cache->getStorage(dataset_image) : nullptr;
+						if (storage == nullptr)
+						{
+							scratch.resize(sample_size);
+							storage = scratch.data();
+						}
+						ConvAccumulators(
+							params,
+							input_sample_shape, image_input,
+							filter_shape, filter_data,
+							bias_data,
+							output_sample_shape, storage,
+							options);
+						if (cache)
+						{
+							cache->Store(dataset_image, input_key);
+						}
+						accumulators = storage;
+					}
+
+					// Every trial starts from the clean output
+					int8_t* group_output = output_data + first_sample * sample_size;
+					for (int position = 0; position < sample_size; ++position)
+					{
+						group_output[position] = requantize(accumulators[position], position % output_depth);
+					}
+					for (int sample = 1; sample < samples_per_image; ++sample)
+					{
+						std::memcpy(group_output + sample * sample_size, group_output, sample_size);
+					}
+
+					for (int trial = 0; trial < options.trials_per_invoke; ++trial)
+					{
+						const FaultSpan error_positions = options.getErrorPositions(image, trial);
+						int8_t* trial_output = group_output + trial * sample_size;
+						FaultCursor cursor(error_positions, 0, error_positions.size);
+						while (cursor.hasFaults())
+						{
+							const int out_channel = cursor.getNextOutput();
+							auto group = out_channel / filters_per_group;
+
+							weight_faults.clear();
+							while (cursor.getNextOutput() == out_channel)
+							{
+								// Converting the kernel partial position into the filter position vector
+								const int kernelPartialPosition = cursor.Pop();
+								const int in_channel = kernelPartialPosition % filter_input_depth;
+								const int filter_x = (kernelPartialPosition / filter_input_depth) % filter_width;
+								const int filter_y = kernelPartialPosition / (filter_input_depth * filter_width);
+								const int8_t filter_val = filter_data[Offset(filter_shape, out_channel, filter_y, filter_x, in_channel)];
+								const int8_t flipped_val = static_cast<int8_t>(static_cast<uint8_t>(filter_val) ^ (1u << options.bit_position));
+								weight_faults.push_back({ filter_y, filter_x, in_channel, static_cast<int32_t>(flipped_val) - filter_val });
+							}
+
+							// Every output pixel of the channel reads the flipped weights
+							for (int out_y = 0; out_y < output_height; ++out_y)
+							{
+								const int in_y_origin = (out_y * stride_height) - pad_height;
+								for (int out_x = 0; out_x < output_width; ++out_x)
+								{
+									const int in_x_origin = (out_x * stride_width) - pad_width;
+									const int outputPosition = Offset(output_sample_shape, 0, out_y, out_x, out_channel);
+									int32_t acc = accumulators[outputPosition];
+									for (const WeightFault& fault : weight_faults)
+									{
+										const int in_y = in_y_origin + dilation_height_factor * fault.filter_y;
+										const int in_x = in_x_origin + dilation_width_factor * fault.filter_x;
+
+										// Zero padding by omitting the areas outside the image.
+										if (in_x < 0 || in_x >= input_width || in_y < 0 || in_y >= input_height)
+										{
+											continue;
+										}
+
+										int32_t input_val = image_input[Offset(input_sample_shape, 0, in_y, in_x, fault.in_channel + group * filter_input_depth)];
+										acc += fault.weight_change * (input_val + input_offset);
+									}
+									trial_output[outputPosition] = requantize(acc, out_channel);
+								}
+							}
+						}
+					}
+				}
+			}
+
+			// Fixed-point per-channel-quantization convolution reference kernel.
+			// Kernel of a clean node with reference activations
+			// The first sample of an image computes its whole output with compute_sample and becomes the reference of the image
+			// Every other sample copies the reference output and only computes the output pixels whose receptive field
+			// holds an input pixel that differs from the reference input, e.g. the footprint of an upstream fault
+			// The result is bit-identical to the clean convolution
+			inline void ConvPerChannelIncremental(
+				const ConvParams& params,
+				const int32_t* output_multiplier, const int32_t* output_shift,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const RuntimeShape& bias_shape, const int32_t* bias_data,
+				const RuntimeShape& output_shape, int8_t* output_data,
+				const MyDelegateOptions& options,
+				const std::function<void(int)>& compute_sample)
+			{
+				// Get parameters.
+				const int32_t input_offset = params.input_offset;  // r = s(q - Z)
+				const int stride_width = params.stride_width;
+				const int stride_height = params.stride_height;
+				const int dilation_width_factor = params.dilation_width_factor;
+				const int dilation_height_factor = params.dilation_height_factor;
+				const int pad_width = params.padding_values.width;
+				const int pad_height = params.padding_values.height;
+				const int32_t output_offset = params.output_offset;
+				const int32_t output_activation_min = params.quantized_activation_min;
+				const int32_t output_activation_max = params.quantized_activation_max;
+
+				const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+				const int input_depth = input_shape.Dims(3);
+				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+				const int input_height = input_shape.Dims(1);
+				const int input_width = input_shape.Dims(2);
+				const int filter_height = filter_shape.Dims(1);
+				const int filter_width = filter_shape.Dims(2);
+				const int filter_input_depth = filter_shape.Dims(3);
+				const int groups = input_depth / filter_input_depth;
+				const int filters_per_group = output_depth / groups;
+				const int output_height = output_shape.Dims(1);
+				const int output_width = output_shape.Dims(2);
+				const int input_sample_size = input_height * input_width * input_depth;
+				const int output_sample_size = output_height * output_width * output_depth;
+
+				ReferenceActivations& references = *options.reference_activations;
+				const int samples_per_image = options.getSamplesPerImage();
+				std::vector<unsigned char> dirty_outputs(static_cast<size_t>(output_height) * output_width);
+				const int images = batches / samples_per_image;
+				for (int image = 0; image < images; ++image)
+				{
+					// Every sample of the group is keyed by the same image of the dataset
+					const int dataset_image = options.dataset_index + image;
+					for (int batch = image * samples_per_image; batch < (image + 1) * samples_per_image; ++batch)
+					{
+						const int8_t* sample_input = input_data + batch * input_sample_size;
+						int8_t* sample_output = output_data + batch * output_sample_size;
+						const int8_t* reference_input = reinterpret_cast<const int8_t*>(references.getInput(dataset_image));
+						if (reference_input == nullptr)
+						{
+							compute_sample(batch);
+							references.Store(dataset_image, sample_input, sample_output);
+							continue;
+						}
+						std::memcpy(sample_output, references.getResult(dataset_image), output_sample_size);
+
+						// Output pixels reached by every input pixel that differs from the reference
+						std::fill(dirty_outputs.begin(), dirty_outputs.end(), 0);
+						bool any_dirty = false;
+						for (int in_y = 0; in_y < input_height; ++in_y)
+						{
+							for (int in_x = 0; in_x < input_width; ++in_x)
+							{
+								const int pixel = (in_y * input_width + in_x) * input_depth;
+								if (std::memcmp(sample_input + pixel, reference_input + pixel, input_depth) == 0)
+									continue;
+								any_dirty = true;
+								for (int filter_y = 0; filter_y < filter_height; ++filter_y)
+								{
+									const int origin_y = in_y + pad_height - dilation_height_factor * filter_y;
+									if (origin_y < 0 || origin_y % stride_height != 0 || origin_y / stride_height >= output_height)
+										continue;
+									const int out_y = origin_y / stride_height;
+									for (int filter_x = 0; filter_x < filter_width; ++filter_x)
+									{
+										const int origin_x = in_x + pad_width - dilation_width_factor * filter_x;
+										if (origin_x < 0 || origin_x % stride_width != 0 || origin_x / stride_width >= output_width)
+											continue;
+										dirty_outputs[out_y * output_width + origin_x / stride_width] = 1;
+									}
+								}
+							}
+						}
+						if (!any_dirty)
+							continue;
+
+						for (int out_y = 0; out_y < output_height; ++out_y)
+						{
+							const int in_y_origin = (out_y * stride_height) - pad_height;
+							for (int out_x = 0; out_x < output_width; ++out_x)
+							{
+								if (dirty_outputs[out_y * output_width + out_x] == 0)
+									continue;
+								const int in_x_origin = (out_x * stride_width) - pad_width;
+								for (int out_channel = 0; out_channel < output_depth; ++out_channel)
+								{
+									auto group = out_channel / filters_per_group;
+									int32_t acc = 0;
+									for (int filter_y = 0; filter_y < filter_height; ++filter_y)
+									{
+										const int in_y = in_y_origin + dilation_height_factor * filter_y;
+										for (int filter_x = 0; filter_x < filter_width; ++filter_x)
+										{
+											const int in_x = in_x_origin + dilation_width_factor * filter_x;
+
+											// Zero padding by omitting the areas outside the image.
+											const bool is_point_inside_image =
+												(in_x >= 0) && (in_x < input_width) &&
+												(in_y >= 0) && (in_y < input_height);
+
+											if (!is_point_inside_image)
+											{
+												continue;
+											}
+
+											acc += DotProductInt8(
+												input_data + Offset(input_shape, batch, in_y, in_x, group * filter_input_depth),
+												filter_data + Offset(filter_shape, out_channel, filter_y, filter_x, 0),
+												filter_input_depth, input_offset);
+										}
+									}
+
+									if (bias_data)
+									{
+										acc += bias_data[out_channel];
+									}
+									acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
+									acc += output_offset;
+									acc = std::max(acc, output_activation_min);
+									acc = std::min(acc, output_activation_max);
+									output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] = static_cast<int8_t>(acc);
+								}
+							}
+						}
+					}
+				}
+			}
+
+			inline void ConvPerChannelDisturbed(
+				const ConvParams& params, 
+				const int32_t* output_multiplier, const int32_t* output_shift, 
+				const RuntimeShape& input_shape, const int8_t* input_data, 
+				const RuntimeShape& filter_shape, const int8_t* filter_data, 
+				const RuntimeShape& bias_shape, const int32_t* bias_data, 
+				const RuntimeShape& output_shape, int8_t* output_data, 
+				const MyDelegateOptions& options)
+			{
+				// A clean node only computes what changed since the reference of the image
+				if (options.reference_activations && options.operation_mode == OperationMode::none)
+				{
+					RuntimeShape input_sample_shape = input_shape;
+					input_sample_shape.SetDim(0, 1);
+					RuntimeShape output_sample_shape = output_shape;
+					output_sample_shape.SetDim(0, 1);
+					ConvPerChannelIncremental(
+						params, output_multiplier, output_shift,
+						input_shape, input_data,
+						filter_shape, filter_data,
+						bias_shape, bias_data,
+						output_shape, output_data,
+						options,
+						[&](int batch)
+						{
+							ConvPerChannel(
+								params, output_multiplier, output_shift,
+								input_sample_shape, input_data + batch * input_sample_shape.FlatSize(),
+								filter_shape, filter_data,
+								bias_shape, bias_data,
+								output_sample_shape, output_data + batch * output_sample_shape.FlatSize(),
+								options);
+						});
+					return;
+				}
+
+				// Every image flips its own weights, the clean output is only corrected
+				if (options.operation_mode == OperationMode::image_weights)
+				{
+					ConvPerChannelWeightFaults(
+						params, output_multiplier, output_shift,
+						input_shape, input_data,
+						filter_shape, filter_data,
+						bias_shape, bias_data,
+						output_shape, output_data,
+						options);
+					return;
+				}
+
+				// Clean accumulators reused from earlier trials
+				if (options.accumulator_cache)
+				{
+					ConvPerChannelCached(
+						params, output_multiplier, output_shift,
+						input_shape, input_data,
+						filter_shape, filter_data,
+						bias_shape, bias_data,
+						output_shape, output_data,
+						options);
+					return;
+				}
+
+				// Every trial and bit position of an image in a single pass
+				if (options.isGrouped())
+				{
+					ConvPerChannelGrouped(
+						params, output_multiplier, output_shift,
+						input_shape, input_data,
+						filter_shape, filter_data,
+						bias_shape, bias_data,
+						output_shape, output_data,
+						options);
+					return;
+				}
+
+				// Get parameters.
+				const int32_t input_offset = params.input_offset;  // r = s(q - Z)
+				const int stride_width = params.stride_width;
+				const int stride_height = params.stride_height;
+				const int dilation_width_factor = params.dilation_width_factor;
+				const int dilation_height_factor = params.dilation_height_factor;
+				const int pad_width = params.padding_values.width;
+				const int pad_height = params.padding_values.height;
+				const int32_t output_offset = params.output_offset;
+
+				// Set min and max value of the output.
+				const int32_t output_activation_min = params.quantized_activation_min;
+				const int32_t output_activation_max = params.quantized_activation_max;
+
+				// Consistency check.
+				TFLITE_DCHECK_LE(output_activation_min, output_activation_max);
+				TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+				TFLITE_DCHECK_EQ(filter_shape.DimensionsCount(), 4);
+				TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+				const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+				const int input_depth = input_shape.Dims(3);
+				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+				if (bias_data)
+				{
+					TFLITE_DCHECK_EQ(bias_shape.FlatSize(), output_depth);
+				}
+
+				// Check dimensions of the tensors.
+				const int input_height = input_shape.Dims(1);
+				const int input_width = input_shape.Dims(2);
+				const int filter_height = filter_shape.Dims(1);
+				const int filter_width = filter_shape.Dims(2);
+				const int filter_input_depth = filter_shape.Dims(3);
+				const int groups = input_depth / filter_input_depth;
+				TFLITE_DCHECK_NE(groups, 0);
+				TFLITE_DCHECK_EQ(input_depth % filter_input_depth, 0);
+				const int filters_per_group = output_depth / groups;
+				TFLITE_DCHECK_NE(filters_per_group, 0);
+				const int output_height = output_shape.Dims(1);
+				const int output_width = output_shape.Dims(2);
+
+				// Taps of every output pixel inside the input, no tap is checked against the padding
+				const std::shared_ptr<const ConvIndirection> indirection = getConvIndirection(params, input_shape, filter_shape, output_shape, options);
+				const std::shared_ptr<const ConvSpecialization> specialization = getConvSpecialization(params, input_shape, filter_shape, output_shape, filter_data, options);
+				
+				// Bit error rate faults are keyed by tile, so they always use the tiled version
+				if (options.is_threaded || options.bit_error_rate > 0.0)
 				{
 					// Parallel computing done here!
 					ParallelDisturbedConvolution(
@@ -700,6 +1948,8 @@ namespace tflite {
 						filter_shape, filter_data,
 						bias_shape, bias_data,
 						output_shape, output_data,
+						*indirection,
+						*specialization,
 						options);
 				}
 				else
@@ -719,104 +1969,126 @@ namespace tflite {
 						filter_shape, filter_data,
 						bias_shape, bias_data,
 						output_shape, output_data,
-						options.full_indexes,
+						*indirection,
+						*specialization,
 						options);
 				}
+			}
 
-				/*
-				// 1 For some reason tensor allocate only allows 1 image to be analyzed
-				int idx_counter = options.full_indexes.size() - 1;
-				for (int batch = 0; batch < batches; ++batch)
-				{
-					// 
-					for (int out_y = 0; out_y < output_height; ++out_y)
-					{
-						const int in_y_origin = (out_y * stride_height) - pad_height;
-						// 
-						for (int out_x = 0; out_x < output_width; ++out_x)
-						{
-							const int in_x_origin = (out_x * stride_width) - pad_width;
-							// 
-							//for (int out_channel = start; out_channel < end; ++out_channel)
-							for (int out_channel = 0; out_channel < output_depth; ++out_channel)
-							{
-								int outputPosition = batch * output_height * output_width * output_depth + out_y * output_width * output_depth + out_x * output_depth + out_channel;
-
-								// Will always be 0!!!!!!! input channels = filter input channels then filters per group = number of filters (output channels) so group = 0
-								auto group = out_channel / filters_per_group;
+			// Recomputes only the output elements that hold an error position for the images of the batch
+			// The rest of the output must have been already computed by a clean convolution
+			// The result is bit-identical to ConvPerChannelDisturbed
+			inline void RecomputeDisturbedOutputs(
+				const ConvParams& params,
+				const int32_t* output_multiplier, const int32_t* output_shift,
+				const RuntimeShape& input_shape, const int8_t* input_data,
+				const RuntimeShape& filter_shape, const int8_t* filter_data,
+				const RuntimeShape& bias_shape, const int32_t* bias_data,
+				const RuntimeShape& output_shape, int8_t* output_data,
+				const MyDelegateOptions& options)
+			{
+				// Get parameters.
+				const int32_t input_offset = params.input_offset;  // r = s(q - Z)
+				const int stride_width = params.stride_width;
+				const int stride_height = params.stride_height;
+				const int dilation_width_factor = params.dilation_width_factor;
+				const int dilation_height_factor = params.dilation_height_factor;
+				const int pad_width = params.padding_values.width;
+				const int pad_height = params.padding_values.height;
+				const int32_t output_offset = params.output_offset;
 
-								int32_t acc = 0;
-								for (int filter_y = 0; filter_y < filter_height; ++filter_y)
-								{
-									const int in_y = in_y_origin + dilation_height_factor * filter_y;
-									for (int filter_x = 0; filter_x < filter_width; ++filter_x)
-									{
-										const int in_x = in_x_origin + dilation_width_factor * filter_x;
+				// Set min and max value of the output.
+				const int32_t output_activation_min = params.quantized_activation_min;
+				const int32_t output_activation_max = params.quantized_activation_max;
 
-										// Zero padding by omitting the areas outside the image.
-										const bool is_point_inside_image =
-											(in_x >= 0) && (in_x < input_width) &&
-											(in_y >= 0) && (in_y < input_height);
+				const int input_depth = input_shape.Dims(3);
+				const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+				const int input_height = input_shape.Dims(1);
+				const int input_width = input_shape.Dims(2);
+				const int filter_height = filter_shape.Dims(1);
+				const int filter_width = filter_shape.Dims(2);
+				const int filter_input_depth = filter_shape.Dims(3);
+				const int groups = input_depth / filter_input_depth;
+				const int filters_per_group = output_depth / groups;
+				const int output_width = output_shape.Dims(2);
 
-										if (!is_point_inside_image)
-										{
-											continue;
-										}
+				// Every sample of the batch is a different image of the dataset with its own error positions
+				const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+				FaultList bit_errors;
+				for (int batch = 0; batch < batches; ++batch)
+				{
+					if (options.bit_error_rate > 0.0)
+					{
+						GetSampleBitErrors(options.dataset_index + batch, 0, params, input_shape, filter_shape, output_shape, options, bit_errors);
+					}
 
-										for (int in_channel = 0; in_channel < filter_input_depth; ++in_channel)
-										{
-											int kernelPartialPosition = filter_y * filter_width * filter_input_depth + filter_x * filter_input_depth + in_channel;
+					const FaultSpan error_positions = options.bit_error_rate > 0.0 ? bit_errors.getSpan() : options.getErrorPositions(batch);
+					FaultCursor cursor(error_positions, 0, error_positions.size);
+					while (cursor.hasFaults())
+					{
+						const int outputPosition = cursor.getNextOutput();
 
-											int32_t input_val = input_data[Offset(input_shape, batch, in_y, in_x, in_channel + group * filter_input_depth)];
-											int32_t filter_val = filter_data[Offset(filter_shape, out_channel, filter_y, filter_x, in_channel)];
+						// Converting the flat position of the sample into the output position vector
+						const int out_channel = outputPosition % output_depth;
+						const int out_x = (outputPosition / output_depth) % output_width;
+						const int out_y = outputPosition / (output_depth * output_width);
 
-											int32_t result = filter_val * (input_val + input_offset);
+						const int in_y_origin = (out_y * stride_height) - pad_height;
+						const int in_x_origin = (out_x * stride_width) - pad_width;
+						auto group = out_channel / filters_per_group;
 
-											if (idx_counter >= 0 && options.error_flat_positions[options.dataset_index][options.full_indexes[idx_counter]].first == outputPosition && options.error_flat_positions[options.dataset_index][options.full_indexes[idx_counter]].second == kernelPartialPosition)
-											{
-												std::bitset<32> bits(result);
-												bits.flip(options.bit_position);
-												result = static_cast<int>(bits.to_ulong());
-												idx_counter--;
-											}
+						int32_t acc = 0;
+						for (int filter_y = 0; filter_y < filter_height; ++filter_y)
+						{
+							const int in_y = in_y_origin + dilation_height_factor * filter_y;
+							for (int filter_x = 0; filter_x < filter_width; ++filter_x)
+							{
+								const int in_x = in_x_origin + dilation_width_factor * filter_x;
 
-											// Accumulate with 32 bits accumulator.
-											// In the nudging process during model quantization, we force
-											// real value of 0.0 be represented by a quantized value. This
-											// guarantees that the input_offset is a int8_t, even though
-											// it is represented using int32_t. int32_t += int8_t *
-											// (int8_t - int8_t) so the highest value we can get from each
-											// accumulation is [-127, 127] * ([-128, 127] -
-											// [-128, 127]), which is [-32512, 32512]. log2(32512)
-											// = 14.98, which means we can accumulate at least 2^16
-											// multiplications without overflow. The accumulator is
-											// applied to a filter so the accumulation logic will hold as
-											// long as the filter size (filter_y * filter_x * in_channel)
-											// does not exceed 2^16, which is the case in all the models
-											// we have seen so far.
-											// TODO(b/174275578): Add a check to make sure the
-											// accumulator depth is smaller than 2^16.
-											acc += result;
-										}
-									}
-								}
+								// Zero padding by omitting the areas outside the image.
+								const bool is_point_inside_image =
+									(in_x >= 0) && (in_x < input_width) &&
+									(in_y >= 0) && (in_y < input_height);
 
-								// Here is the point where the previous python flipper version carried the bit flipping
-								if (bias_data)
+								if (!is_point_inside_image)
 								{
-									acc += bias_data[out_channel];
+									continue;
 								}
-								acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
-								acc += output_offset;
-								acc = std::max(acc, output_activation_min);
-								acc = std::min(acc, output_activation_max);
-								output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] = static_cast<int8_t>(acc);
+
+								acc += DotProductInt8(
+									input_data + Offset(input_shape, batch, in_y, in_x, group * filter_input_depth),
+									filter_data + Offset(filter_shape, out_channel, filter_y, filter_x, 0),
+									filter_input_depth, input_offset);
 							}
 						}
+
+						// Fault epilogue, the faulty products of the output are flipped on top of the clean sum
+						while (cursor.getNextOutput() == outputPosition)
+						{
+							const int kernelPartialPosition = cursor.Pop();
+							acc = FlipFaultyProduct(
+								acc, kernelPartialPosition, out_channel, group,
+								in_y_origin, in_x_origin,
+								filter_width, filter_input_depth,
+								input_height, input_width,
+								dilation_width_factor, dilation_height_factor,
+								input_offset,
+								input_shape, input_data + Offset(input_shape, batch, 0, 0, 0),
+								filter_shape, filter_data,
+								options.bit_position);
+						}
+
+						if (bias_data)
+						{
+							acc += bias_data[out_channel];
+						}
+						acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_channel], output_shift[out_channel]);
+						acc += output_offset;
+						acc = std::max(acc, output_activation_min);
+						acc = std::min(acc, output_activation_max);
+						output_data[Offset(output_shape, batch, out_y, out_x, out_channel)] = static_cast<int8_t>(acc);
 					}
 				}
-				*/
-
 			}
 
 		}
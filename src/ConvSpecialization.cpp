@@ -0,0 +1,59 @@
+#include "ConvSpecialization.h"
+
+#include <cstddef>
+
+namespace tflite {
+	namespace custom_ops {
+
+		ConvSpecialization::ConvSpecialization(const ConvGeometry& geometry, const int8_t* filter_data, int output_depth, int32_t input_offset)
+			: geometry_(geometry), filter_data_(filter_data), input_offset_(input_offset)
+		{
+			const bool square_filter = geometry.filter_height == geometry.filter_width &&
+				(geometry.filter_height == 1 || geometry.filter_height == 3 || geometry.filter_height == 5);
+			const bool same_stride = geometry.stride_height == geometry.stride_width &&
+				(geometry.stride_height == 1 || geometry.stride_height == 2);
+			const bool no_dilation = geometry.dilation_height_factor == 1 && geometry.dilation_width_factor == 1;
+			const bool single_group = geometry.filter_input_depth == geometry.input_depth;
+			if (!square_filter || !same_stride || !no_dilation || !single_group)
+				return;
+
+			filter_size_ = geometry.filter_height;
+			stride_ = geometry.stride_height;
+
+			// Unsigned arithmetic wraps like the int32 accumulator
+			const int depth = geometry.filter_height * geometry.filter_width * geometry.filter_input_depth;
+			folded_offsets_.resize(output_depth);
+			for (int out_channel = 0; out_channel < output_depth; ++out_channel)
+			{
+				uint32_t filter_sum = 0;
+				for (int k = 0; k < depth; ++k)
+				{
+					filter_sum += static_cast<uint32_t>(filter_data[static_cast<size_t>(out_channel) * depth + k]);
+				}
+				folded_offsets_[out_channel] = static_cast<int32_t>(static_cast<uint32_t>(input_offset) * filter_sum);
+			}
+		}
+
+		bool ConvSpecialization::isBuiltFor(const ConvGeometry& geometry, const int8_t* filter_data, int output_depth, int32_t input_offset) const
+		{
+			return geometry_ == geometry && filter_data_ == filter_data && input_offset_ == input_offset &&
+				(filter_size_ == 0 || static_cast<int>(folded_offsets_.size()) == output_depth);
+		}
+
+		int ConvSpecialization::getFilterSize() const
+		{
+			return filter_size_;
+		}
+
+		int ConvSpecialization::getStride() const
+		{
+			return stride_;
+		}
+
+		const int32_t* ConvSpecialization::getFoldedOffsets() const
+		{
+			return folded_offsets_.data();
+		}
+
+	}
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ConvIndirection.h"
+
+namespace tflite {
+	namespace custom_ops {
+
+		// ConvSpecialization
+		// Kernel of a convolution selected when the node is prepared
+		// Square 1x1, 3x3 and 5x5 filters with stride 1 or 2, no dilation and a single group have kernels
+		// with the taps unrolled at compile time for the interior pixels, the rest use the generic kernels
+		// The input offset is folded into a single sum per output channel, so the unrolled taps only multiply the inputs
+		class ConvSpecialization
+		{
+		public:
+			// ConvSpecialization constructor, the kernel of the geometry and the folded input offset of every output channel
+			ConvSpecialization(const ConvGeometry& geometry, const int8_t* filter_data, int output_depth, int32_t input_offset);
+
+			// Whether the specialization was built for the geometry, the filter, the output channels and the input offset
+			bool isBuiltFor(const ConvGeometry& geometry, const int8_t* filter_data, int output_depth, int32_t input_offset) const;
+
+			// Filter height and width of the specialized kernel, 0 when the geometry has none
+			int getFilterSize() const;
+
+			// Stride of the specialized kernel
+			int getStride() const;
+
+			// input_offset * sum of the weights of every output channel, wrapping like the int32 accumulator
+			const int32_t* getFoldedOffsets() const;
+
+		private:
+			// Geometry the specialization was built for
+			ConvGeometry geometry_;
+
+			// Filter whose weights are summed
+			const int8_t* filter_data_;
+
+			// Input offset folded into the sums
+			int32_t input_offset_;
+
+			// Filter size of the specialized kernel, 0 for the generic kernels
+			int filter_size_ = 0;
+
+			// Stride of the specialized kernel
+			int stride_ = 0;
+
+			// Folded input offset of every output channel
+			std::vector<int32_t> folded_offsets_;
+		};
+
+	}
+}
\ No newline at end of file
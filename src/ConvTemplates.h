@@ -55,6 +55,12 @@ namespace tflite {
                     effective_kernel_type = kReference;
                 }
 
+                // The GEMM kernel multiplies the filter packed in MyDelegateNode::Prepare
+                if (effective_kernel_type == kGenericOptimized && !options.packed_filter)
+                {
+                    effective_kernel_type = kReference;
+                }
+
                 const int8_t* filter_data;
 
                 // Only invalid for Int4
@@ -104,20 +110,210 @@ namespace tflite {
                     break;
                 }
                 case kGenericOptimized:
+                    switch (filter->type) 
+                    {
+                    case kTfLiteInt4:
+                    case kTfLiteInt8: {
+                        if (options.reference_activations && options.operation_mode == OperationMode::none)
+                        {
+                            // The first sample of an image runs the GEMM, the rest only the outputs that changed
+                            RuntimeShape input_sample_shape = GetTensorShape(input);
+                            input_sample_shape.SetDim(0, 1);
+                            RuntimeShape output_sample_shape = GetTensorShape(output);
+                            output_sample_shape.SetDim(0, 1);
+                            ConvPerChannelIncremental(
+                                op_params,
+                                data->per_channel_output_multiplier.data(),
+                                data->per_channel_output_shift.data(),
+                                GetTensorShape(input), GetTensorData<int8>(input),
+                                GetTensorShape(filter), filter_data,
+                                GetTensorShape(bias), GetTensorData<int32>(bias),
+                                GetTensorShape(output), GetTensorData<int8>(output),
+                                options,
+                                [&](int batch)
+                                {
+                                    ConvPerChannelGemm(
+                                        op_params, data->per_channel_output_multiplier.data(),
+                                        data->per_channel_output_shift.data(), input_sample_shape,
+                                        GetTensorData<int8>(input) + batch * input_sample_shape.FlatSize(),
+                                        GetTensorShape(filter), filter_data,
+                                        GetTensorShape(bias), GetTensorData<int32>(bias),
+                                        output_sample_shape, GetTensorData<int8>(output) + batch * output_sample_shape.FlatSize(),
+                                        options);
+                                });
+                            break;
+                        }
+
+                        if (options.operation_mode == OperationMode::image_weights)
+                        {
+                            // The clean accumulators of the weight faults come from the GEMM
+                            ConvPerChannelWeightFaults(
+                                op_params,
+                                data->per_channel_output_multiplier.data(),
+                                data->per_channel_output_shift.data(),
+                                GetTensorShape(input), GetTensorData<int8>(input),
+                                GetTensorShape(filter), filter_data,
+                                GetTensorShape(bias), GetTensorData<int32>(bias),
+                                GetTensorShape(output), GetTensorData<int8>(output),
+                                options);
+                            break;
+                        }
+
+                        if (options.operation_mode == OperationMode::none)
+                        {
+                            ConvPerChannelGemm(
+                                op_params,
+                                data->per_channel_output_multiplier.data(),
+                                data->per_channel_output_shift.data(),
+                                GetTensorShape(input), GetTensorData<int8>(input),
+                                GetTensorShape(filter), filter_data,
+                                GetTensorShape(bias), GetTensorData<int32>(bias),
+                                GetTensorShape(output), GetTensorData<int8>(output),
+                                options);
+                            break;
+                        }
+
+                        // Clean accumulators from the GEMM or the cache, the faulty products are corrected on them
+                        ConvPerChannelCached(
+                            op_params,
+                            data->per_channel_output_multiplier.data(),
+                            data->per_channel_output_shift.data(),
+                            GetTensorShape(input), GetTensorData<int8>(input),
+                            GetTensorShape(filter), filter_data,
+                            GetTensorShape(bias), GetTensorData<int32>(bias),
+                            GetTensorShape(output), GetTensorData<int8>(output),
+                            options);
+                        break;
+                    }
+                    default: {
+                        TF_LITE_KERNEL_LOG(context,
+                            "Weight type %s (%d) not supported for filter.",
+                            TfLiteTypeGetName(filter->type), filter->type);
+                        break;
+                    }
+                    }
+                    break;
                 case kMultithreadOptimized:
                 case kCblasOptimized:
                     switch (filter->type) 
                     {
                     case kTfLiteInt4:
                     case kTfLiteInt8: {
-                        //optimized_integer_ops::ConvPerChannel(
-                        //    op_params, data->per_channel_output_multiplier.data(),
-                        //    data->per_channel_output_shift.data(), GetTensorShape(input),
-                        //    GetTensorData<int8>(input), GetTensorShape(filter), filter_data,
-                        //    GetTensorShape(bias), GetTensorData<int32>(bias),
-                        //    GetTensorShape(output), GetTensorData<int8>(output),
-                        //    GetTensorShape(im2col), GetTensorData<int8>(im2col),
-                        //    CpuBackendContext::GetFromContext(context));
+                        if (options.reference_activations && options.operation_mode == OperationMode::none)
+                        {
+                            // The first sample of an image runs the optimized kernel, the rest only the outputs that changed
+                            RuntimeShape input_sample_shape = GetTensorShape(input);
+                            input_sample_shape.SetDim(0, 1);
+                            RuntimeShape output_sample_shape = GetTensorShape(output);
+                            output_sample_shape.SetDim(0, 1);
+                            ConvPerChannelIncremental(
+                                op_params,
+                                data->per_channel_output_multiplier.data(),
+                                data->per_channel_output_shift.data(),
+                                GetTensorShape(input), GetTensorData<int8>(input),
+                                GetTensorShape(filter), filter_data,
+                                GetTensorShape(bias), GetTensorData<int32>(bias),
+                                GetTensorShape(output), GetTensorData<int8>(output),
+                                options,
+                                [&](int batch)
+                                {
+                                    optimized_integer_ops::ConvPerChannel(
+                                        op_params, data->per_channel_output_multiplier.data(),
+                                        data->per_channel_output_shift.data(), input_sample_shape,
+                                        GetTensorData<int8>(input) + batch * input_sample_shape.FlatSize(),
+                                        GetTensorShape(filter), filter_data,
+                                        GetTensorShape(bias), GetTensorData<int32>(bias),
+                                        output_sample_shape, GetTensorData<int8>(output) + batch * output_sample_shape.FlatSize(),
+                                        GetTensorShape(im2col), GetTensorData<int8>(im2col),
+                                        CpuBackendContext::GetFromContext(context));
+                                });
+                            break;
+                        }
+
+                        if (options.operation_mode == OperationMode::image_weights)
+                        {
+                            // The weight faults correct the clean accumulators, they replace the optimized clean pass
+                            ConvPerChannelWeightFaults(
+                                op_params,
+                                data->per_channel_output_multiplier.data(),
+                                data->per_channel_output_shift.data(),
+                                GetTensorShape(input), GetTensorData<int8>(input),
+                                GetTensorShape(filter), filter_data,
+                                GetTensorShape(bias), GetTensorData<int32>(bias),
+                                GetTensorShape(output), GetTensorData<int8>(output),
+                                options);
+                            break;
+                        }
+
+                        if (options.accumulator_cache)
+                        {
+                            // The cached accumulators replace the optimized clean pass
+                            ConvPerChannelCached(
+                                op_params,
+                                data->per_channel_output_multiplier.data(),
+                                data->per_channel_output_shift.data(),
+                                GetTensorShape(input), GetTensorData<int8>(input),
+                                GetTensorShape(filter), filter_data,
+                                GetTensorShape(bias), GetTensorData<int32>(bias),
+                                GetTensorShape(output), GetTensorData<int8>(output),
+                                options);
+                            break;
+                        }
+
+                        if (options.isGrouped())
+                        {
+                            // Clean pass of the first sample of every group, the trials and bit positions are expanded from it
+                            RuntimeShape input_sample_shape = GetTensorShape(input);
+                            input_sample_shape.SetDim(0, 1);
+                            RuntimeShape output_sample_shape = GetTensorShape(output);
+                            output_sample_shape.SetDim(0, 1);
+                            const int samples_per_image = options.getSamplesPerImage();
+                            const int images = MatchingDim(GetTensorShape(input), 0, GetTensorShape(output), 0) / samples_per_image;
+                            for (int image = 0; image < images; ++image)
+                            {
+                                optimized_integer_ops::ConvPerChannel(
+                                    op_params, data->per_channel_output_multiplier.data(),
+                                    data->per_channel_output_shift.data(), input_sample_shape,
+                                    GetTensorData<int8>(input) + image * samples_per_image * input_sample_shape.FlatSize(),
+                                    GetTensorShape(filter), filter_data,
+                                    GetTensorShape(bias), GetTensorData<int32>(bias),
+                                    output_sample_shape, GetTensorData<int8>(output) + image * samples_per_image * output_sample_shape.FlatSize(),
+                                    GetTensorShape(im2col), GetTensorData<int8>(im2col),
+                                    CpuBackendContext::GetFromContext(context));
+                            }
+
+                            RecomputeGroupedOutputs(
+                                op_params,
+                                data->per_channel_output_multiplier.data(),
+                                data->per_channel_output_shift.data(),
+                                GetTensorShape(input), GetTensorData<int8>(input),
+                                GetTensorShape(filter), filter_data,
+                                GetTensorShape(bias), GetTensorData<int32>(bias),
+                                GetTensorShape(output), GetTensorData<int8>(output),
+                                options);
+                            break;
+                        }
+
+                        // Clean pass with the optimized kernel
+                        optimized_integer_ops::ConvPerChannel(
+                            op_params, data->per_channel_output_multiplier.data(),
+                            data->per_channel_output_shift.data(), GetTensorShape(input),
+                            GetTensorData<int8>(input), GetTensorShape(filter), filter_data,
+                            GetTensorShape(bias), GetTensorData<int32>(bias),
+                            GetTensorShape(output), GetTensorData<int8>(output),
+                            GetTensorShape(im2col), GetTensorData<int8>(im2col),
+                            CpuBackendContext::GetFromContext(context));
+
+                        // Only the faulty output elements are computed again
+                        RecomputeDisturbedOutputs(
+                            op_params,
+                            data->per_channel_output_multiplier.data(),
+                            data->per_channel_output_shift.data(),
+                            GetTensorShape(input), GetTensorData<int8>(input),
+                            GetTensorShape(filter), filter_data,
+                            GetTensorShape(bias), GetTensorData<int32>(bias),
+                            GetTensorShape(output), GetTensorData<int8>(output),
+                            options);
                         break;
                     }
                     default: {
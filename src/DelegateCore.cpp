@@ -5,20 +5,13 @@ namespace tflite {
 	// MyDelegateKernel Methods
 
 	MyDelegateKernel::MyDelegateKernel()
-		: operation_data_conv_(nullptr), 
-		conv_params_(new TfLiteConvParams),
-		operation_data_fully_(nullptr),
-		fully_params_(new TfLiteFullyConnectedParams)
 	{
 
 	}
 
-	MyDelegateKernel::MyDelegateKernel(const MyDelegateOptions& options)
+	MyDelegateKernel::MyDelegateKernel(const MyDelegateOptions& options, const std::shared_ptr<ThreadPool>& thread_pool)
 		: options_(options), 
-		operation_data_conv_(nullptr), 
-		conv_params_(new TfLiteConvParams),
-		operation_data_fully_(nullptr),
-		fully_params_(new TfLiteFullyConnectedParams)
+		thread_pool_(thread_pool)
 	{
 		// Constructor with initializer options
 #if LOGGER
@@ -28,12 +21,6 @@ namespace tflite {
 
 	MyDelegateKernel::~MyDelegateKernel()
 	{
-		// Frees the memory created in Init of type OpData
-		custom_ops::conv::Free(nullptr, operation_data_conv_);
-		delete conv_params_;
-
-		custom_ops::fully_connected::Free(nullptr, operation_data_fully_);
-		delete fully_params_;
 		//std::cout << "\nMyDelegateKernel destructor called\n\n";
 	}
 
@@ -60,487 +47,1058 @@ namespace tflite {
 		// output shape is number_nodes x number of outputs per node 
 		//outputs_.resize(params->nodes_to_replace->size);
 
+		bool has_prefix = false;
+		bool has_activation_node = false;
 		for (int i = 0; i < params->nodes_to_replace->size; ++i)
 		{
+			// Layers before the first delegated node are not executed, its input is replayed
 			const int node_index = params->nodes_to_replace->data[i];
-			// This is why options_ should be a vector of options in the future for every node
-			options_.node_index = node_index;
-			// Get this node information.
-			TfLiteNode* delegated_node = nullptr;
-			TfLiteRegistration* delegated_node_registration = nullptr;
-			TF_LITE_ENSURE_EQ(
-				context,
-				context->GetNodeAndRegistration(context, node_index, &delegated_node,
-					&delegated_node_registration), kTfLiteOk);
-
-			int input_index, bias_index, filter_index;
-			// Warning: ASSUMING THAT THERE IS ONLY ONE OUTPUT!!!
-			int output_index = 0;
-			for (int j = 0; j < delegated_node->inputs->size; j++)
-			{
-				//inputs_[i].push_back(delegated_node->inputs->data[j]);
-				custom_ops::GetTensorIndexes(context, delegated_node, &bias_index, &filter_index, &input_index);
-				
-			}
-			//for (int j = 0; j < delegated_node->outputs->size; j++)
-			//{
-			//	outputs_[i].push_back(delegated_node->outputs->data[j]);
-			//}
-
-			const auto& input_tensor = context->tensors[delegated_node->inputs->data[input_index]];
-			const auto& filter_tensor = context->tensors[delegated_node->inputs->data[filter_index]];
-			const auto& output_tensor = context->tensors[delegated_node->outputs->data[output_index]];
-			
-			for (int k = 0; k < input_tensor.dims->size; k++)
+			if (std::find(options_.prefix_nodes.begin(), options_.prefix_nodes.end(), node_index) != options_.prefix_nodes.end())
+			{
+				has_prefix = true;
+				continue;
+			}
+			has_activation_node = has_activation_node || node_index == options_.activation_node;
+
+			// Layers after the last faulty node run their own kernels
+			if (std::find(options_.suffix_nodes.begin(), options_.suffix_nodes.end(), node_index) != options_.suffix_nodes.end())
+			{
+				downstream_.push_back(std::make_unique<MyBuiltinNode>());
+				TF_LITE_ENSURE_STATUS(downstream_.back()->Init(context, node_index));
+				continue;
+			}
+
+			// Every node keeps its own options, operation data and fault plan
+			nodes_.push_back(std::make_unique<MyDelegateNode>(options_, thread_pool_));
+			TF_LITE_ENSURE_STATUS(nodes_.back()->Init(context, node_index));
+			if (node_index == options_.golden_node)
+				golden_position_ = static_cast<int>(nodes_.size()) - 1;
+		}
+		if (has_prefix && !has_activation_node)
+		{
+			TF_LITE_KERNEL_LOG(context, "The skipped layers are not in the partition of node %d", options_.activation_node);
+			return kTfLiteError;
+		}
+		if (downstream_.empty())
+			return kTfLiteOk;
+		if (golden_position_ < 0)
+		{
+			TF_LITE_KERNEL_LOG(context, "The layers after node %d are not in its partition", options_.golden_node);
+			return kTfLiteError;
+		}
+
+		// The layers after the golden node only depend on the tensors computed before them,
+		// when those match the golden capture so do the outputs of the subgraph
+		std::unordered_set<int> downstream_tensors;
+		for (const auto& downstream_node : downstream_)
+		{
+			const TfLiteIntArray* outputs = downstream_node->getOutputs();
+			downstream_tensors.insert(outputs->data, outputs->data + outputs->size);
+		}
+		for (const auto& downstream_node : downstream_)
+		{
+			const TfLiteIntArray* inputs = downstream_node->getInputs();
+			for (int j = 0; j < inputs->size; j++)
+			{
+				const int tensor = inputs->data[j];
+				if (tensor < 0 || downstream_tensors.count(tensor) != 0 || context->tensors[tensor].allocation_type == kTfLiteMmapRo)
+					continue;
+				if (std::find(golden_inputs_.begin(), golden_inputs_.end(), tensor) == golden_inputs_.end())
+					golden_inputs_.push_back(tensor);
+			}
+		}
+		for (int i = 0; i < params->output_tensors->size; i++)
+		{
+			if (downstream_tensors.count(params->output_tensors->data[i]) != 0)
+				golden_outputs_.push_back(params->output_tensors->data[i]);
+		}
+		return kTfLiteOk;
+	}
+	
+	TfLiteStatus MyDelegateKernel::Prepare(TfLiteContext* context, TfLiteNode* node)
+	{
+		// This method gets called once when creating the Interpreter and once again when allocating the tensors PER NODE????
+		// This function forbbids the use of the function context->GetNodeAndRegistration when runnning from the interpreter
+		// CAREFUL!
+		// DON'T USE THE NODE RECEIVED HERE!
+		// The node received here is different than the node at context
+		// This node is a corrupted copy of the node registered for this operation
+		// They do not share the same memory address
+		// Reassigning the pointer of OpData makes the program to crash!!!!!!!!!!
+		// Has absolutely insane values stored, changing it crashes the program
+		// using new or malloc doesn't work
+
+#if LOGGER
+		// Logging
+		//std::cout << std::endl << "MyDelegateKernel::Prepare function!" << std::endl;
+		//if (prepared_)
+		//{
+		//	std::cout << "Already prepared! This convolution does not need allocation again." << std::endl;
+		//}
+#endif // LOGGER
+	
+		// Calling the Custom Preparation
+		// Careful the order of inputs in the receiving node is not the same as the standard order
+		// The nodes are prepared every time, so the output tensors follow a resized input
+		TfLiteStatus prepared_success = kTfLiteOk;
+
+		// A replayed input follows the batch of the inputs of the partition
+		int batch = 0;
+		for (int i = 0; i < node->inputs->size && batch == 0; i++)
+		{
+			const TfLiteTensor& tensor = context->tensors[node->inputs->data[i]];
+			if (tensor.allocation_type != kTfLiteMmapRo && tensor.dims->size > 0)
+				batch = tensor.dims->data[0];
+		}
+		for (auto& delegated_node : nodes_)
+		{
+			if (batch > 0)
 			{
-				options_.input_dimensions.push_back(input_tensor.dims->data[k]);
+				TF_LITE_ENSURE_STATUS(delegated_node->ResizeReplayedInput(context, batch));
 			}
-			for (int k = 0; k < filter_tensor.dims->size; k++)
+			prepared_success = delegated_node->Prepare(context);
+			if (prepared_success != kTfLiteOk)
+				break;
+		}
+		// The layers after the golden node follow the outputs of the delegated nodes
+		for (size_t i = 0; i < downstream_.size() && prepared_success == kTfLiteOk; i++)
+		{
+			prepared_success = downstream_[i]->Prepare(context);
+		}
+		// The temporaries of every node and the tensors passed between nodes of the partition
+		// become temporaries of the delegate node, so the interpreter allocates them
+		if (prepared_success == kTfLiteOk)
+		{
+			std::vector<int> temporaries;
+			for (size_t i = 0; i < nodes_.size(); i++)
 			{
-				options_.kernel_dimensions.push_back(filter_tensor.dims->data[k]);
+				const TfLiteIntArray* node_temporaries = nodes_[i]->getTemporaries();
+				temporaries.insert(temporaries.end(), node_temporaries->data, node_temporaries->data + node_temporaries->size);
+				if (nodes_[i]->getReplayedInput() >= 0)
+					temporaries.push_back(nodes_[i]->getReplayedInput());
+				const TfLiteIntArray* node_outputs = nodes_[i]->getOutputs();
+				for (int j = 0; j < node_outputs->size; j++)
+				{
+					if (std::find(node->outputs->data, node->outputs->data + node->outputs->size, node_outputs->data[j]) == node->outputs->data + node->outputs->size)
+						temporaries.push_back(node_outputs->data[j]);
+				}
 			}
-			for (int k = 0; k < output_tensor.dims->size; k++)
+			for (const auto& downstream_node : downstream_)
 			{
-				options_.output_dimensions.push_back(output_tensor.dims->data[k]);
+				const TfLiteIntArray* node_temporaries = downstream_node->getTemporaries();
+				temporaries.insert(temporaries.end(), node_temporaries->data, node_temporaries->data + node_temporaries->size);
+				const TfLiteIntArray* node_outputs = downstream_node->getOutputs();
+				for (int j = 0; j < node_outputs->size; j++)
+				{
+					if (std::find(node->outputs->data, node->outputs->data + node->outputs->size, node_outputs->data[j]) == node->outputs->data + node->outputs->size)
+						temporaries.push_back(node_outputs->data[j]);
+				}
 			}
+			TfLiteIntArrayFree(node->temporaries);
+			node->temporaries = TfLiteIntArrayCreate(static_cast<int>(temporaries.size()));
+			std::copy(temporaries.begin(), temporaries.end(), node->temporaries->data);
 
-			options_.builtin_code = delegated_node_registration->builtin_code;
+			// The samples of the golden capture follow the sizes of the tensors
+			prepared_success = BuildGoldenCache(context, batch);
+		}
+
+		if (prepared_)
+		{
+			// Resets the dataset index whenever a new dataset is evaluated
+			new_call_ = true;
+		}
+		prepared_ = true;
 
 #if LOGGER
-			//std::cout << "Input size\n";
-			//for (const int& val : options_.input_dimensions)
-			//{
-			//	std::cout << val << " ";
-			//}
-			//std::cout << "\n";
-			//std::cout << "Filter size\n";
-			//for (const int& val : options_.kernel_dimensions)
-			//{
-			//	std::cout << val << " ";
-			//}
-			//std::cout << "\n";
-			//std::cout << "Output size\n";
-			//for (const int& val : options_.output_dimensions)
-			//{
-			//	std::cout << val << " ";
-			//}
-			//std::cout << "\n";
-
-			//std::cout << "Registration type: " << custom_logger::get_builtin_code(options_.builtin_code) << "\n";
+		/*std::cout << "Special logging!\n";*/
+		//custom_logger::LogTfLiteContext(context);
+		//std::cout << "New node: " << std::endl;
+		//std::cout << "Memory address of node: " << reinterpret_cast<void*>(node) << std::endl;
+		//custom_logger::LogTfLiteNode(node);
+		//custom_logger::LogTfLiteConvParams(reinterpret_cast<TfLiteConvParams*>(node->builtin_data));
+		//std::cout<< std::endl;
+		//std::cout << "Preparation result: " << custom_logger::get_TfLiteStatus(prepared_success) << std::endl;
 #endif // LOGGER
 
-			// Stores the Convolution Operation Options
-			// can add more options later
-			// Heap allocated, should be freed in the destructor
-			operation_data_conv_ = reinterpret_cast<custom_ops::conv::OpData*>(custom_ops::conv::Init(context, nullptr, 0));
+		return prepared_success;
+	}
+	
+	TfLiteStatus MyDelegateKernel::Eval(TfLiteContext* context, TfLiteNode* node)
+	{
+		// This is called whenever a session is active, so static variables here will be initialized only once for all the lifetime of tflite in python
+		// Evaluate the delegated graph.
+		// Here we loop over all the delegated nodes.
+		// The number of nodes equals ''inputs_.size()'' and inputs[i] is a list of
+		// tensor indices for inputs to node ''i'', while outputs_[i] is the list of
+		// outputs for node
+		// ''i''. Note, that it is intentional we have simple implementation as this
+		// is for demonstration.
 
-			// Stores the Fully Connected Operation Options
-			// can add more options later
-			// Heap allocated, should be freed in the destructor
-			operation_data_fully_ = reinterpret_cast<custom_ops::fully_connected::OpData*>(custom_ops::fully_connected::Init(context, nullptr, 0));
+#if LOGGER
+		// Logging
+		//std::cout << std::endl << "MyDelegateKernel::Eval function!" << std::endl;
+		//std::cout << "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%" << std::endl;
+		//std::cout << "New node?? : " << std::endl;
+		//std::cout << "Memory address of node: " << reinterpret_cast<void*>(node) << std::endl;
+		//custom_logger::LogTfLiteNode(node);
+		//options_.Log();
+		//custom_logger::LogTfLiteContext(context);
+#endif // LOGGER
 
-			// Modify this to accept more than 1 node
-			// For the moment it only stores 1 node's information
-			// This operation fails for dense layer!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-			switch (options_.builtin_code)
+		if (new_call_)
+		{
+			// Checks first evaluation of the dataset being evaluated
+			for (auto& delegated_node : nodes_)
 			{
-			case kTfLiteBuiltinConv2d: {
-				GetConvOperationData(*reinterpret_cast<custom_ops::conv::OpData*>(delegated_node->user_data));
-				GetConvParams(*reinterpret_cast<TfLiteConvParams*>(delegated_node->builtin_data));
+				delegated_node->ResetDatasetIndex();
+			}
+			new_call_ = false;
+		}
 
-				//custom_logger::LogTfLiteConvParams(conv_params_);
-				//custom_logger::conv::LogTfLiteOpData(operation_data_conv_);
+		// The claimed layers after the golden node are never disturbed
+		if (!downstream_.empty() && options_.runtime && options_.runtime->epoch.load(std::memory_order_acquire) != runtime_epoch_)
+		{
+			runtime_epoch_ = options_.runtime->epoch.load(std::memory_order_acquire);
+			if (options_.runtime->faulty_layer != options_.faulty_layer)
+			{
+				TF_LITE_KERNEL_LOG(context, "The faulty layers can not change while the layers after node %d are claimed", options_.golden_node);
+				return kTfLiteError;
 			}
+		}
+
+		// The caller groups the batch for the whole model, so a clean node follows the same images as a disturbed one
+		const int samples_per_image = options_.getGroupSize(options_.runtime ? options_.runtime->operation_mode : options_.operation_mode);
+		for (auto& delegated_node : nodes_)
+		{
+			delegated_node->setSamplesPerImage(samples_per_image);
+		}
+
+		// The golden capture is indexed by the images of the batch, read before the node moves to the next ones
+		const int dataset_index = golden_cache_ ? nodes_[golden_position_]->getDatasetIndex() : 0;
+
+		// Nodes are stored in execution order
+		TfLiteStatus evalued_success = kTfLiteOk;
+		for (auto& delegated_node : nodes_)
+		{
+			evalued_success = delegated_node->Eval(context);
+			if (evalued_success != kTfLiteOk)
 				break;
-			case kTfLiteBuiltinFullyConnected: {
-				GetFullyOperationData(*reinterpret_cast<custom_ops::fully_connected::OpData*>(delegated_node->user_data));
-				GetFullyParams(*reinterpret_cast<TfLiteFullyConnectedParams*>(delegated_node->builtin_data));
+		}
 
-				//custom_logger::LogTfLiteFullyConnectedParams(fully_params_);
-				//custom_logger::fully_connected::LogTfLiteOpData(operation_data_fully_);
+		if (evalued_success == kTfLiteOk && !downstream_.empty())
+		{
+			// A fault masked by every sample leaves the rest of the model clean
+			if (golden_cache_ && options_.golden_caching == GoldenCaching::replay && MatchesGolden(context, dataset_index, samples_per_image))
+			{
+				CopyGolden(context, dataset_index, samples_per_image);
+				return kTfLiteOk;
 			}
-				break;
-			default:
-				break;
+			for (auto& downstream_node : downstream_)
+			{
+				evalued_success = downstream_node->Eval(context);
+				if (evalued_success != kTfLiteOk)
+					break;
 			}
-			
-			int output_flat_size = custom_ops::getFlatSize(output_tensor.dims);
-			int kernel_partial_flat_size = custom_ops::getFlatSize(filter_tensor.dims, 1);
-
-			/// Random variables generation!
-			std::random_device random_device;
-			std::mt19937 mt_generator(random_device());
-			std::uniform_int_distribution<int> output_dist(0, output_flat_size - 1);
-			std::uniform_int_distribution<int> kernel_dist(0, kernel_partial_flat_size - 1);
+			if (evalued_success == kTfLiteOk && golden_cache_ && options_.golden_caching == GoldenCaching::capture)
+			{
+				StoreGolden(context, dataset_index, samples_per_image);
+			}
+		}
 
-			// Get partial sizes, first element of the kernel size is not needed
-			std::vector<int> kernel_partial_dimensions(options_.kernel_dimensions.begin() + 1, options_.kernel_dimensions.end());
-			
 #if LOGGER
-			//std::cout << "output size " << output_flat_size << "\n";
-			//std::cout << "kernel partial size " << kernel_partial_flat_size << "\n";
-			//std::cout << "Kernel dimensions: ";
-			//for (const auto& val : kernel_partial_dimensions)
-			//{
-			//	std::cout << val << " ";
-			//}
-			//std::cout << "\n";
+		//std::cout << "Evaluation result: " << custom_logger::get_TfLiteStatus(evalued_success) << std::endl;
 #endif // LOGGER
 
-			int stride_height;
-			int stride_width;
-			int dilation_height_factor;
-			int dilation_width_factor;
-			int pad_height;
-			int pad_width;
-			int input_height;
-			int input_width;
-			if (options_.builtin_code == kTfLiteBuiltinConv2d)
-			{
-				// Gathering the variables of convolution
-				stride_height = conv_params_->stride_height;
-				stride_width = conv_params_->stride_width;
-				dilation_height_factor = conv_params_->dilation_height_factor;
-				dilation_width_factor = conv_params_->dilation_width_factor;
-
-				pad_height = operation_data_conv_->padding.height;
-				pad_width = operation_data_conv_->padding.width;
-
-				input_height = options_.input_dimensions[1];
-				input_width = options_.input_dimensions[2];
-			}
-
-			// Here organize the indexes of the chunks of the channels
-			options_.full_indexes.resize(options_.number_flips);
-			// Fill values with increasing order from 0 to size of indexes
-			std::iota(options_.full_indexes.begin(), options_.full_indexes.end(), 0);
-
-			// Constants for accelerating the threaded version
-			// channels are always the position 0 of the kernel dimensions
-			int number_operations = getNumberOperations(options_.output_dimensions, options_.kernel_dimensions);
-			options_.num_threads = number_operations / options_.max_operations_per_thread;
-			if (options_.num_threads == 0)
-				options_.num_threads = 1;
-			options_.num_threads = std::min(options_.num_threads, options_.max_number_threads); // Ensuring the number of threads doesn't exceed the number of channels
-			options_.channels = options_.kernel_dimensions[0];
-			options_.chunk_size = options_.channels / options_.num_threads;
-			// Here determine if it will be threaded or not
-			if (options_.num_threads != 1)
-			{
-				options_.is_threaded = true;
+		return evalued_success;
+	}
+
+	TfLiteStatus MyDelegateKernel::BuildGoldenCache(TfLiteContext* context, int batch)
+	{
+		golden_cache_.reset();
+		golden_sample_bytes_.clear();
+		golden_batch_ = batch;
+		if (options_.golden_caching == GoldenCaching::none || golden_position_ < 0)
+			return kTfLiteOk;
+		if (options_.dataset_size <= 0)
+		{
+			std::cout << "Warning: the golden cache needs the dataset size, golden outputs are not cached\n";
+			return kTfLiteOk;
+		}
+
+		// Every sample of the golden tensors belongs to a single image
+		size_t sample_bytes = 0;
+		std::vector<int> golden_tensors = golden_inputs_;
+		golden_tensors.insert(golden_tensors.end(), golden_outputs_.begin(), golden_outputs_.end());
+		for (int tensor_index : golden_tensors)
+		{
+			const TfLiteTensor& tensor = context->tensors[tensor_index];
+			if (batch <= 0 || tensor.dims->size == 0 || tensor.dims->data[0] != batch)
+			{
+				std::cout << "Warning: tensor " << tensor_index << " is not split by samples, golden outputs are not cached\n";
+				golden_sample_bytes_.clear();
+				return kTfLiteOk;
+			}
+			golden_sample_bytes_.push_back(tensor.bytes / batch);
+			sample_bytes += golden_sample_bytes_.back();
+		}
+		golden_sample_.resize(sample_bytes);
+
+		auto golden_cache = std::make_unique<ActivationCache>(options_.dataset_size, sample_bytes, options_.model_key);
+		if (options_.golden_caching == GoldenCaching::capture)
+		{
+			if (!golden_cache->Create(options_.golden_cache_file, options_.golden_node))
+			{
+				TF_LITE_KERNEL_LOG(context, "Golden cache file %s can not be mapped", options_.golden_cache_file.c_str());
+				return kTfLiteError;
 			}
+		}
+		else if (!golden_cache->Open(options_.golden_cache_file, options_.golden_node))
+		{
+			TF_LITE_KERNEL_LOG(context, "Golden cache file %s can not be opened or was captured for a different model", options_.golden_cache_file.c_str());
+			return kTfLiteError;
+		}
+		golden_cache_ = std::move(golden_cache);
+		return kTfLiteOk;
+	}
 
+	bool MyDelegateKernel::MatchesGolden(TfLiteContext* context, int dataset_index, int samples_per_image) const
+	{
+		for (int sample = 0; sample < golden_batch_; sample++)
+		{
+			const unsigned char* golden = golden_cache_->getSample(dataset_index + sample / samples_per_image);
+			if (golden == nullptr)
+				return false;
+			for (size_t i = 0; i < golden_inputs_.size(); i++)
+			{
+				const TfLiteTensor& tensor = context->tensors[golden_inputs_[i]];
+				const size_t bytes = golden_sample_bytes_[i];
+				if (std::memcmp(tensor.data.raw_const + bytes * sample, golden, bytes) != 0)
+					return false;
+				golden += bytes;
+			}
+		}
+		return true;
+	}
+
+	void MyDelegateKernel::StoreGolden(TfLiteContext* context, int dataset_index, int samples_per_image)
+	{
+		// The first sample of every image, all of them are clean when capturing
+		for (int sample = 0; sample < golden_batch_; sample += samples_per_image)
+		{
+			unsigned char* golden = golden_sample_.data();
+			for (size_t i = 0; i < golden_inputs_.size() + golden_outputs_.size(); i++)
+			{
+				const int tensor_index = i < golden_inputs_.size() ? golden_inputs_[i] : golden_outputs_[i - golden_inputs_.size()];
+				const size_t bytes = golden_sample_bytes_[i];
+				std::memcpy(golden, context->tensors[tensor_index].data.raw_const + bytes * sample, bytes);
+				golden += bytes;
+			}
+			golden_cache_->Store(dataset_index + sample / samples_per_image, golden_sample_.data());
+		}
+	}
+
+	void MyDelegateKernel::CopyGolden(TfLiteContext* context, int dataset_index, int samples_per_image) const
+	{
+		for (int sample = 0; sample < golden_batch_; sample++)
+		{
+			// Checked by MatchesGolden
+			const unsigned char* golden = golden_cache_->getSample(dataset_index + sample / samples_per_image);
+			for (size_t i = 0; i < golden_inputs_.size(); i++)
+			{
+				golden += golden_sample_bytes_[i];
+			}
+			for (size_t i = 0; i < golden_outputs_.size(); i++)
+			{
+				const size_t bytes = golden_sample_bytes_[golden_inputs_.size() + i];
+				std::memcpy(context->tensors[golden_outputs_[i]].data.raw + bytes * sample, golden, bytes);
+				golden += bytes;
+			}
+		}
+	}
+
+	// MyDelegateNode Methods
+
+	MyDelegateNode::MyDelegateNode(const MyDelegateOptions& options, const std::shared_ptr<ThreadPool>& thread_pool)
+		: options_(options), 
+		thread_pool_(thread_pool),
+		operation_data_conv_(nullptr), 
+		conv_params_(new TfLiteConvParams),
+		operation_data_fully_(nullptr),
+		fully_params_(new TfLiteFullyConnectedParams)
+	{
+		// Constructor with initializer options
+		options_.thread_pool = thread_pool_.get();
 #if LOGGER
-			std::cout << "Is threaded?: " << (options_.is_threaded ? "true" : "false") << "\n";
-			std::cout << "Number of threads " << options_.num_threads << "\n";
-			//std::cout << "Number of operations " << number_operations << "\n";
-			//std::cout << "Chunk size: " << options_.chunk_size << "\n";
+		//std::cout << "MyDelegateNode constructor with options\n";
 #endif // LOGGER
+	}
 
+	MyDelegateNode::~MyDelegateNode()
+	{
+		// Frees the memory created in Init of type OpData
+		custom_ops::conv::Free(nullptr, operation_data_conv_);
+		delete conv_params_;
 
-			// Put everything that follows on a loop to generate the whole dataset random positions beforehand
-			// For MNIST Fashion options_.dataset_size = 10000
-			for (int j = 0; j < options_.dataset_size; j++)
-			{
-				// MUST BE RESERVE not RESIZE
-				options_.error_flat_positions[j].reserve(options_.number_flips);
-				options_.error_vec_positions[j].reserve(options_.number_flips);
+		custom_ops::fully_connected::Free(nullptr, operation_data_fully_);
+		delete fully_params_;
 
-				// Generating the output error positions
-				for (int k = 0; k < options_.number_flips; ++k)
-				{
-					std::vector<int> output_error_vec_pos;
-					std::vector<int> kernel_error_vec_pos;
-					output_error_vec_pos.reserve(options_.output_dimensions.size());
-					kernel_error_vec_pos.reserve(options_.kernel_dimensions.size());
-
-					// Generating the output error position
-					int output_error_flat_pos = output_dist(mt_generator);
-					int kernel_partial_flat_pos;
-					options_.convertPositionInt2Vec(output_error_flat_pos, output_flat_size, options_.output_dimensions, output_error_vec_pos);
-					
-					int input_y, input_x;
-					int in_y_origin;
-					int in_x_origin;
-					if (options_.builtin_code == kTfLiteBuiltinConv2d)
-					{
-						in_y_origin = (output_error_vec_pos[1] * stride_height) - pad_height;
-						in_x_origin = (output_error_vec_pos[2] * stride_width) - pad_width;
-					}
-					bool flag_valid_pos = false;
-					do
-					{
-						// This has to be done in a do while loop, to make certain it is inside the input
-						kernel_error_vec_pos.clear();
-						
-						// Push the last element of out position = channels
-						// It is the first element of the kernel position
-						kernel_error_vec_pos.push_back(output_error_vec_pos.back());
+		// Arrays of the copy of the original node
+		TfLiteIntArrayFree(node_.inputs);
+		TfLiteIntArrayFree(node_.outputs);
+		TfLiteIntArrayFree(node_.temporaries);
+	}
 
-						// Generating the random number
-						kernel_partial_flat_pos = kernel_dist(mt_generator);
+	TfLiteStatus MyDelegateNode::Init(TfLiteContext* context, int node_index)
+	{
+		// Stores the neccessary information of a single delegated node
+		// Only gets called ONCE!!!
+		options_.node_index = node_index;
+		// Get this node information.
+		TfLiteNode* delegated_node = nullptr;
+		TfLiteRegistration* delegated_node_registration = nullptr;
+		TF_LITE_ENSURE_EQ(
+			context,
+			context->GetNodeAndRegistration(context, node_index, &delegated_node,
+				&delegated_node_registration), kTfLiteOk);
+
+		int input_index, bias_index, filter_index;
+		// Warning: ASSUMING THAT THERE IS ONLY ONE OUTPUT!!!
+		int output_index = 0;
+		for (int j = 0; j < delegated_node->inputs->size; j++)
+		{
+			//inputs_[i].push_back(delegated_node->inputs->data[j]);
+			custom_ops::GetTensorIndexes(context, delegated_node, &bias_index, &filter_index, &input_index);
+			
+		}
+		//for (int j = 0; j < delegated_node->outputs->size; j++)
+		//{
+		//	outputs_[i].push_back(delegated_node->outputs->data[j]);
+		//}
 
-						// Convert the number to position values
-						options_.convertPositionInt2Vec(kernel_partial_flat_pos, kernel_partial_flat_size, kernel_partial_dimensions, kernel_error_vec_pos);
+		const auto& input_tensor = context->tensors[delegated_node->inputs->data[input_index]];
+		const auto& filter_tensor = context->tensors[delegated_node->inputs->data[filter_index]];
+		const auto& output_tensor = context->tensors[delegated_node->outputs->data[output_index]];
+		
+		for (int k = 0; k < input_tensor.dims->size; k++)
+		{
+			options_.input_dimensions.push_back(input_tensor.dims->data[k]);
+		}
+		for (int k = 0; k < filter_tensor.dims->size; k++)
+		{
+			options_.kernel_dimensions.push_back(filter_tensor.dims->data[k]);
+		}
+		for (int k = 0; k < output_tensor.dims->size; k++)
+		{
+			options_.output_dimensions.push_back(output_tensor.dims->data[k]);
+		}
 
-						if (options_.builtin_code == kTfLiteBuiltinConv2d)
-						{
-							// Verify that the values are in range!!! Only happens if there is padding present
-							// output : batch   output_y    output_x    output_channel
-							//          0       1           2           3
-							// kernel:  output_channel  kernel_y    kernel_x    input_channel
-							//          0               1           2           3
+		options_.builtin_code = delegated_node_registration->builtin_code;
 
-							input_y = in_y_origin + dilation_height_factor * kernel_error_vec_pos[1];
-							input_x = in_x_origin + dilation_width_factor * kernel_error_vec_pos[2];
+		// The node is evaluated through a copy of its inputs and outputs, the delegate node only holds the ones of the whole partition
+		node_.inputs = TfLiteIntArrayCopy(delegated_node->inputs);
+		node_.outputs = TfLiteIntArrayCopy(delegated_node->outputs);
+		node_.temporaries = TfLiteIntArrayCreate(0);
+
+		// Claimed nodes that do not match the faulty layers run without faults, and so does every node capturing golden outputs
+		layer_name_ = filter_tensor.name != nullptr ? filter_tensor.name : "";
+		if (!MyDelegateOptions::matchLayerName(layer_name_.c_str(), options_.faulty_layer) || options_.golden_caching == GoldenCaching::capture)
+		{
+			options_.operation_mode = OperationMode::none;
+			options_.bit_error_rate = 0.0;
+		}
 
-							//std::cout << "input_y: " << input_y << " input_x: " << input_x << "\n";
-						}
-						
-						std::pair<int, int> candidate_position = { output_error_flat_pos, kernel_partial_flat_pos };
-						auto it = std::find(options_.error_flat_positions[j].begin(), options_.error_flat_positions[j].end(), candidate_position);
-						bool repeated_pos = false;
-						if (it != options_.error_flat_positions[j].end()) 
-						{
-							repeated_pos = true;
 #if LOGGER
-							//std::cout << "Repeated pos: " << candidate_position.first << " - " << candidate_position.second << "\n";
-							//std::cout << "Element found at index " << std::distance(options_.error_flat_positions[j].begin(), it) << "\n";
+		//std::cout << "Input size\n";
+		//for (const int& val : options_.input_dimensions)
+		//{
+		//	std::cout << val << " ";
+		//}
+		//std::cout << "\n";
+		//std::cout << "Filter size\n";
+		//for (const int& val : options_.kernel_dimensions)
+		//{
+		//	std::cout << val << " ";
+		//}
+		//std::cout << "\n";
+		//std::cout << "Output size\n";
+		//for (const int& val : options_.output_dimensions)
+		//{
+		//	std::cout << val << " ";
+		//}
+		//std::cout << "\n";
+
+		//std::cout << "Registration type: " << custom_logger::get_builtin_code(options_.builtin_code) << "\n";
 #endif // LOGGER
-						}
 
-						bool is_inside = input_y >= 0 && input_y < input_height && input_x >= 0 && input_x < input_width;
+		// Stores the Convolution Operation Options
+		// can add more options later
+		// Heap allocated, should be freed in the destructor
+		operation_data_conv_ = reinterpret_cast<custom_ops::conv::OpData*>(custom_ops::conv::Init(context, nullptr, 0));
 
-						if (not repeated_pos && (options_.builtin_code == kTfLiteBuiltinFullyConnected || is_inside))
-							flag_valid_pos = true;
-						// Check not repeated positions
-					} while (!flag_valid_pos);
+		// Stores the Fully Connected Operation Options
+		// can add more options later
+		// Heap allocated, should be freed in the destructor
+		operation_data_fully_ = reinterpret_cast<custom_ops::fully_connected::OpData*>(custom_ops::fully_connected::Init(context, nullptr, 0));
 
-					// After the verification
-					options_.error_flat_positions[j].emplace_back(output_error_flat_pos, kernel_partial_flat_pos);
-					options_.error_vec_positions[j].emplace_back(output_error_vec_pos, kernel_error_vec_pos);
+		// This operation fails for dense layer!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+		switch (options_.builtin_code)
+		{
+		case kTfLiteBuiltinConv2d: {
+			GetConvOperationData(*reinterpret_cast<custom_ops::conv::OpData*>(delegated_node->user_data));
+			GetConvParams(*reinterpret_cast<TfLiteConvParams*>(delegated_node->builtin_data));
 
+			//custom_logger::LogTfLiteConvParams(conv_params_);
+			//custom_logger::conv::LogTfLiteOpData(operation_data_conv_);
+		}
+			break;
+		case kTfLiteBuiltinFullyConnected: {
+			GetFullyOperationData(*reinterpret_cast<custom_ops::fully_connected::OpData*>(delegated_node->user_data));
+			GetFullyParams(*reinterpret_cast<TfLiteFullyConnectedParams*>(delegated_node->builtin_data));
+
+			//custom_logger::LogTfLiteFullyConnectedParams(fully_params_);
+			//custom_logger::fully_connected::LogTfLiteOpData(operation_data_fully_);
+		}
+			break;
+		default:
+			break;
+		}
+		
+		// Constants for accelerating the threaded version
+		// channels are always the position 0 of the kernel dimensions
+		int number_operations = getNumberOperations(options_.output_dimensions, options_.kernel_dimensions);
+		options_.num_threads = number_operations / options_.max_operations_per_thread;
+		if (options_.num_threads == 0)
+			options_.num_threads = 1;
+		options_.num_threads = std::min(options_.num_threads, options_.max_number_threads);
+		// Ensuring the number of threads doesn't exceed the size of the thread pool
+		options_.num_threads = thread_pool_ ? std::min(options_.num_threads, thread_pool_->getNumThreads()) : 1;
+		// Here determine if it will be threaded or not
+		if (options_.num_threads != 1)
+		{
+			options_.is_threaded = true;
+		}
+
+#if LOGGER
+		std::cout << "Is threaded?: " << (options_.is_threaded ? "true" : "false") << "\n";
+		std::cout << "Number of threads " << options_.num_threads << "\n";
+		//std::cout << "Number of operations " << number_operations << "\n";
+#endif // LOGGER
+
+		// Valid taps of the convolution, needed to sample only the multiplications that are performed
+		BuildValidTaps();
+
+		// Error positions of the dataset
+		TF_LITE_ENSURE_STATUS(BuildFaultPlan(context));
+
+		// Clean accumulators reused by every trial
+		TF_LITE_ENSURE_STATUS(BuildAccumulatorCache(context));
+
+		// Reference activations of a clean node, reached by the faults of the upstream nodes
+		BuildReferenceActivations();
+
+		// Input captured or replayed for the layers before the node
+		TF_LITE_ENSURE_STATUS(BuildActivationCache(context));
+
+		if (!options_.fault_plan_out.empty())
+		{
+			if (options_.bit_error_rate > 0.0)
+			{
+				std::cout << "Warning: bit error rate faults have no fault plan, " << options_.fault_plan_out << " is not written\n";
+			}
+			else if (fault_plan_ && !SaveFaultPlan(getNodePath(options_.fault_plan_out)))
+			{
+				TF_LITE_KERNEL_LOG(context, "Fault plan file %s can not be written", getNodePath(options_.fault_plan_out).c_str());
+				return kTfLiteError;
+			}
+		}
+
+#if LOGGER
+		//options_.Log();
+
+		//int j = 0;
+		//std::cout << "Error flat positions\n";
+		//FaultSpan span = fault_plan_->getImage(j);
+		//for (int k = 0; k < span.size; k++)
+		//{
+		//	std::cout << span.output_positions[k] << " - " << span.kernel_positions[k] << "\n";
+		//}
+		
+		//std::cout << "Special logging! To be delegated node index: " << node_index << std::endl;
+		//std::cout << "Memory address of node: " << reinterpret_cast<void*>(delegated_node) << std::endl;
+		//custom_logger::LogTfLiteRegistration(delegated_node_registration);
+		//custom_logger::LogTfLiteContext(context);
+		//custom_logger::LogTfLiteNode(delegated_node);
+#endif // LOGGER
+		return kTfLiteOk;
+	}
+
+	TfLiteStatus MyDelegateNode::Prepare(TfLiteContext* context)
+	{
+		// Calling the Custom Preparation on the copy of the original node
+		TfLiteStatus prepared_success;
+		if (options_.builtin_code == kTfLiteBuiltinConv2d)
+		{
+			// The hybrid backend needs the im2col temporary tensor of the optimized kernel
+			// The GEMM backend expands its own im2col blocks, so it is prepared like the reference kernel
+			if (options_.kernel_backend == KernelBackend::hybrid)
+			{
+				prepared_success = custom_ops::conv::Prepare<tflite::custom_ops::conv::kMultithreadOptimized>(context, &node_, conv_params_, operation_data_conv_);
+			}
+			else
+			{
+				prepared_success = custom_ops::conv::Prepare<tflite::custom_ops::conv::kReference>(context, &node_, conv_params_, operation_data_conv_);
+			}
+		}
+		else
+		{
+			prepared_success = custom_ops::fully_connected::Prepare<tflite::custom_ops::fully_connected::kReference>(context, &node_, fully_params_, operation_data_fully_);
+		}
+		TF_LITE_ENSURE_STATUS(prepared_success);
+
+		if ((options_.kernel_backend == KernelBackend::gemm || options_.builtin_code == kTfLiteBuiltinFullyConnected) && !options_.packed_filter)
+		{
+			BuildPackedFilter(context);
+		}
+
+		// Dimensions after ResizeInputTensor, the output tensor has just been resized by the custom preparation
+		int input_index, bias_index, filter_index;
+		custom_ops::GetTensorIndexes(context, &node_, &bias_index, &filter_index, &input_index);
+		const TfLiteIntArray* input_dims = context->tensors[node_.inputs->data[input_index]].dims;
+		const TfLiteIntArray* output_dims = context->tensors[node_.outputs->data[0]].dims;
+		std::vector<int> input_dimensions(input_dims->data, input_dims->data + input_dims->size);
+		std::vector<int> output_dimensions(output_dims->data, output_dims->data + output_dims->size);
+
+		// Init already knows the dimensions, so the taps and the specialized kernel are built here even when the shapes are kept
+		BuildConvIndirection(context);
+		BuildConvSpecialization(context);
+		if (input_dimensions == options_.input_dimensions && output_dimensions == options_.output_dimensions)
+			return kTfLiteOk;
+
+		// Error positions are relative to the sample, so a new batch size keeps them
+		// Only the samples stored by lazy generation and replay change
+		const int previous_output_size = getOutputSize();
+		const std::vector<int> previous_input_dimensions = options_.input_dimensions;
+		options_.input_dimensions = std::move(input_dimensions);
+		options_.output_dimensions = std::move(output_dimensions);
+		const bool sample_changed = getOutputSize() != previous_output_size ||
+			!std::equal(options_.input_dimensions.begin() + 1, options_.input_dimensions.end(), previous_input_dimensions.begin() + 1, previous_input_dimensions.end());
+		if (sample_changed)
+		{
+			BuildValidTaps();
+			options_.accumulator_cache.reset();
+			TF_LITE_ENSURE_STATUS(BuildAccumulatorCache(context));
+			BuildReferenceActivations();
+			TF_LITE_ENSURE_STATUS(BuildActivationCache(context));
+			return BuildFaultPlan(context);
+		}
+		if (options_.fault_generation != FaultGeneration::precomputed)
+		{
+			return BuildFaultPlan(context);
+		}
+		return kTfLiteOk;
+	}
+
+	TfLiteStatus MyDelegateNode::Eval(TfLiteContext* context)
+	{
+		TfLiteStatus evalued_success;
+
+		// Options changed through the C API since the last evaluation
+		if (options_.runtime && options_.runtime->epoch.load(std::memory_order_acquire) != runtime_epoch_)
+		{
+			TF_LITE_ENSURE_STATUS(ApplyRuntimeOptions(context));
+		}
+
+		// Every sample of the batch is a different image of the dataset, starting at dataset_index
+		// When sweeping the bit positions or running several trials every image fills a group of samples,
+		// one per trial and bit
+		const int samples_per_image = options_.getSamplesPerImage();
+		if (getBatchSize() % samples_per_image != 0)
+		{
+			TF_LITE_KERNEL_LOG(context, "Grouped evaluation needs a batch size multiple of %d, got %d", samples_per_image, getBatchSize());
+			return kTfLiteError;
+		}
+		const int images = getBatchSize() / samples_per_image;
+
+		// Lazy generation only keeps the error positions of the images being evaluated
+		// The fault sets are stored in the order of getFaultSetIndex, every trial of an image after the other
+		if (!fault_plan_)
+		{
+			// No table of positions, bit error rate faults or faults disabled
+		}
+		else if (options_.fault_generation == FaultGeneration::lazy)
+		{
+			fault_plan_->Clear();
+			for (int image = 0; image < images; image++)
+			{
+				for (int trial = 0; trial < options_.trials_per_invoke; trial++)
+				{
+					GenerateErrorPositions(options_.dataset_index + image, trial, error_positions_);
+					fault_plan_->AppendImage(error_positions_);
 				}
-				
-				std::sort(options_.error_flat_positions[j].begin(), 
-					options_.error_flat_positions[j].end(), 
-					[this](const std::pair<int, int>& pair1, const std::pair<int, int>& pair2) 
-					{ 
-						return options_.getPairIntGreater(pair1, pair2); 
-					});
-				std::sort(options_.error_vec_positions[j].begin(), 
-					options_.error_vec_positions[j].end(), 
-					[this](const std::pair<std::vector<int>, std::vector<int>>& pair1, const std::pair<std::vector<int>, std::vector<int>>& pair2) 
-					{ 
-						return options_.getPairVecGreater(pair1, pair2, options_.output_dimensions, options_.kernel_dimensions); 
-					});
-
-				// For threaded computation
-				// Separates the indexes by chunks
-				std::vector<int> chunk_indexes;
-				for (int k = 0; k < options_.num_threads; ++k)
+			}
+		}
+		else if (options_.fault_generation == FaultGeneration::replay)
+		{
+			// Only the pages of the images being evaluated are touched
+			fault_plan_->Clear();
+			for (int image = 0; image < images; image++)
+			{
+				for (int trial = 0; trial < options_.trials_per_invoke; trial++)
 				{
-					const int start = k * options_.chunk_size;
-					const int end = std::min(start + options_.chunk_size, options_.channels);
-					getChunkIndexes(start, end, options_.error_vec_positions[j], chunk_indexes);
-
-					//std::cout << "Start: " << start << " End: " << end << "\n";
-					//std::cout << "Indexes in chunk " << k << ": ";
-					//for (const auto& val : chunk_indexes)
-					//{
-					//	std::cout << val << " ";
-					//}
-					//std::cout << "\n";
-
-					options_.chunks_indexes[j].emplace_back(chunk_indexes);
+					const int fault_set = options_.getFaultSetIndex(options_.dataset_index + image, trial);
+					if (!plan_file_.ReadImage(fault_set, error_positions_))
+					{
+						TF_LITE_KERNEL_LOG(context, "Fault set %d of fault plan file %s is corrupted", fault_set, options_.fault_plan_in.c_str());
+						return kTfLiteError;
+					}
+					fault_plan_->AppendImage(error_positions_);
 				}
+			}
+		}
+
+		// The layers before the node see the same images on every trial
+		if (activation_cache_)
+		{
+			TF_LITE_ENSURE_STATUS(CacheActivations(context, images, samples_per_image));
+		}
+
+		if (options_.builtin_code == kTfLiteBuiltinConv2d)
+		{
+			// The kernels only check the taps and the specialization in debug builds,
+			// a tensor resized without a new Prepare gets both of them here
+			// Only the geometry, the filter and the zero point are compared when the ones of Prepare are kept
+			BuildConvIndirection(context);
+			BuildConvSpecialization(context);
+			if (options_.kernel_backend == KernelBackend::hybrid)
+			{
+				evalued_success = custom_ops::conv::Eval<custom_ops::conv::kMultithreadOptimized>(context, &node_, conv_params_, operation_data_conv_, options_);
+			}
+			else if (options_.kernel_backend == KernelBackend::gemm)
+			{
+				evalued_success = custom_ops::conv::Eval<custom_ops::conv::kGenericOptimized>(context, &node_, conv_params_, operation_data_conv_, options_);
+			}
+			else
+			{
+				evalued_success = custom_ops::conv::Eval<custom_ops::conv::kReference>(context, &node_, conv_params_, operation_data_conv_, options_);
+			}
+		}
+		else
+		{
+			evalued_success = custom_ops::fully_connected::Eval<custom_ops::fully_connected::kReference>(context, &node_, fully_params_, operation_data_fully_, options_);
+		}
+
+		// Most important part, whenever this is called the index of the dataset is incremented
+		// by the number of images of the batch
+		options_.dataset_index += images;
+
+		return evalued_success;
+	}
+
+	void MyDelegateNode::ResetDatasetIndex()
+	{
+		options_.dataset_index = 0;
+	}
+
+	const TfLiteIntArray* MyDelegateNode::getOutputs() const
+	{
+		return node_.outputs;
+	}
+
+	const TfLiteIntArray* MyDelegateNode::getTemporaries() const
+	{
+		return node_.temporaries;
+	}
+
+	int MyDelegateNode::getDatasetIndex() const
+	{
+		return options_.dataset_index;
+	}
+
+	void MyDelegateNode::setSamplesPerImage(int samples_per_image)
+	{
+		options_.samples_per_image = samples_per_image;
+	}
+
+	int MyDelegateNode::getReplayedInput() const
+	{
+		if (!activation_cache_ || options_.activation_caching != ActivationCaching::replay)
+			return -1;
+		return node_.inputs->data[0];
+	}
+
+	TfLiteStatus MyDelegateNode::ResizeReplayedInput(TfLiteContext* context, int batch)
+	{
+		const int replayed_input = getReplayedInput();
+		if (replayed_input < 0)
+			return kTfLiteOk;
+		TfLiteTensor& tensor = context->tensors[replayed_input];
+		if (tensor.dims->size == 0 || tensor.dims->data[0] == batch)
+			return kTfLiteOk;
+		TfLiteIntArray* dims = TfLiteIntArrayCopy(tensor.dims);
+		dims->data[0] = batch;
+		return context->ResizeTensor(context, &tensor, dims);
+	}
+
+	std::string MyDelegateNode::getNodePath(const std::string& path) const
+	{
+		// "{node}" is replaced by the node index, so every node of a campaign can have its own file
+		std::string node_path = path;
+		const size_t position = node_path.find("{node}");
+		if (position != std::string::npos)
+			node_path.replace(position, 6, std::to_string(options_.node_index));
+		return node_path;
+	}
+
+	TfLiteStatus MyDelegateNode::BuildFaultPlan(TfLiteContext* context)
+	{
+		// There can not be more faults than multiplications, or weights in image_weights mode
+		const int number_flips = static_cast<int>(std::max<long long>(0, std::min<long long>(options_.number_flips, getNumberFaultSites())));
+
+		fault_plan_.reset();
+		if (!options_.isDelegatedMode())
+		{
+			// Disabled at runtime, the node runs without faults
+		}
+		else if (options_.bit_error_rate > 0.0)
+		{
+			// Bit error rate faults are drawn by the kernels, there is no table of positions
+		}
+		else if (options_.fault_generation == FaultGeneration::precomputed)
+		{
+			// Put everything that follows on a loop to generate the whole dataset random positions beforehand
+			// For MNIST Fashion options_.dataset_size = 10000
+			// A single allocation holds the positions of the whole dataset
+			// Every image has the same number of positions, so each one has a fixed place in the plan
+			// Every trial of an image has its own fault set, stored in the order of getFaultSetIndex
+			const int fault_sets = options_.dataset_size * options_.trials_per_invoke;
+			fault_plan_ = std::make_shared<FaultPlan>(fault_sets, static_cast<long long>(fault_sets) * number_flips);
+			fault_plan_->AppendUniformImages(fault_sets, number_flips);
+
+			// Images are independent streams of the generator, so they are generated in parallel
+			// and the plan is the same for any number of threads
+			auto generate_image = [this](int j)
+			{
+				thread_local std::vector<std::pair<int, int>> error_positions;
+				GenerateErrorPositions(j / options_.trials_per_invoke, j % options_.trials_per_invoke, error_positions);
+				fault_plan_->SetImage(j, error_positions);
 
 #if LOGGER
 				//std::cout << "Item " << j << "\n";
-				//for (int k = 0; k < options_.chunks_indexes[j].size(); k++)
-				//{
-				//	std::cout << "Chunk " << k << "\n";
-				//	for (const auto& val : options_.chunks_indexes[j][k])
-				//	{
-				//		std::cout << val << " ";
-				//	}
-				//	std::cout << "\n";
-				//}
 				//std::cout << "Error flat positions\n";
-				//for (const auto& val : options_.error_flat_positions[j])
+				//for (const auto& val : error_positions)
 				//{
 				//	std::cout << val.first << " - " << val.second << "\n";
 				//}
-				//std::cout << "Error vector positions\n";
-				//for (const auto& val : options_.error_vec_positions[j])
-				//{
-				//	for (const int& element : val.first)
-				//	{
-				//		std::cout << element << " ";
-				//	}
-				//	std::cout << "- ";
-				//	for (const int& element : val.second)
-				//	{
-				//		std::cout << element << " ";
-				//	}
-				//	std::cout << "\n";
-				//}
 #endif // LOGGER
-			
+			};
+			if (thread_pool_)
+			{
+				thread_pool_->ParallelFor(fault_sets, thread_pool_->getNumThreads(), generate_image);
+			}
+			else
+			{
+				for (int j = 0; j < fault_sets; j++)
+				{
+					generate_image(j);
+				}
+			}
+		}
+		else if (options_.fault_generation == FaultGeneration::replay)
+		{
+			// The positions of each image are decoded in Eval from the mapped file
+			const std::string path = getNodePath(options_.fault_plan_in);
+			if (!plan_file_.Open(path))
+			{
+				TF_LITE_KERNEL_LOG(context, "Fault plan file %s can not be opened or is not a valid fault plan", path.c_str());
+				return kTfLiteError;
+			}
+			const FaultPlanFileHeader& header = plan_file_.getHeader();
+			if (header.node_index != options_.node_index || header.output_size != getFaultOutputSize() || header.kernel_size != getKernelSize())
+			{
+				TF_LITE_KERNEL_LOG(context, "Fault plan file %s was saved for a different node", path.c_str());
+				return kTfLiteError;
 			}
+			// Files saved before trials existed hold a single trial per image
+			const int file_trials = std::max(1, header.trials);
+			if (file_trials != options_.trials_per_invoke)
+			{
+				TF_LITE_KERNEL_LOG(context, "Fault plan file %s has %d trials per image, %d are evaluated", path.c_str(), file_trials, options_.trials_per_invoke);
+				return kTfLiteError;
+			}
+			if (header.num_images < options_.dataset_size * file_trials)
+			{
+				std::cout << "Warning: fault plan file " << path << " only has " << header.num_images / file_trials << " images, the rest are not disturbed\n";
+			}
+			// The saved campaign flips its own bit unless another one is given
+			if (options_.bit_position < 0)
+			{
+				options_.bit_position = header.bit_position;
+			}
+			const int fault_sets = getBatchSize() * options_.trials_per_invoke;
+			fault_plan_ = std::make_shared<FaultPlan>(fault_sets, static_cast<long long>(fault_sets) * header.number_flips);
+		}
+		else
+		{
+			// Lazy generation, the positions of the images of each batch are generated in Eval
+			const int fault_sets = getBatchSize() * options_.trials_per_invoke;
+			fault_plan_ = std::make_shared<FaultPlan>(fault_sets, static_cast<long long>(fault_sets) * number_flips);
+		}
 
-#if LOGGER
-			//options_.Log();
-
-			//std::cout << "Indexes\n";
-			//for (const auto& val : options_.full_indexes)
-			//{
-			//	std::cout << val << " ";
-			//}
-			//std::cout << "\n";
-
-			//int j = 0;
-			//std::cout << "Error flat positions\n";
-			//for (const auto& val : options_.error_flat_positions[j])
-			//{
-			//	std::cout << val.first << " - " << val.second << "\n";
-			//}
-			//std::cout << "Error vector positions\n";
-			//for (const auto& val : options_.error_vec_positions[j])
-			//{
-			//	for (const int& element : val.first)
-			//	{
-			//		std::cout << element << " ";
-			//	}
-			//	std::cout << "- ";
-			//	for (const int& element : val.second)
-			//	{
-			//		std::cout << element << " ";
-			//	}
-			//	std::cout << "\n";
-			//}
-			
-			//std::cout << "Special logging! To be delegated node index: " << node_index << std::endl;
-			//std::cout << "Memory address of node: " << reinterpret_cast<void*>(delegated_node) << std::endl;
-			//custom_logger::LogTfLiteRegistration(delegated_node_registration);
-			//custom_logger::LogTfLiteContext(context);
-			//custom_logger::LogTfLiteNode(delegated_node);
-#endif // LOGGER
+		// Weight faults flip a bit of the int8 weights
+		if (fault_plan_ && options_.operation_mode == OperationMode::image_weights && (options_.bit_position < 0 || options_.bit_position > 7))
+		{
+			TF_LITE_KERNEL_LOG(context, "Image weights mode flips a bit of the int8 weights, bit position %d is not in [0, 7]", options_.bit_position);
+			return kTfLiteError;
 		}
+		options_.fault_plan = fault_plan_;
 		return kTfLiteOk;
 	}
-	
-	TfLiteStatus MyDelegateKernel::Prepare(TfLiteContext* context, TfLiteNode* node)
+
+	void MyDelegateNode::BuildReferenceActivations()
 	{
-		// This method gets called once when creating the Interpreter and once again when allocating the tensors PER NODE????
-		// This function forbbids the use of the function context->GetNodeAndRegistration when runnning from the interpreter
-		// CAREFUL!
-		// DON'T USE THE NODE RECEIVED HERE!
-		// The node received here is different than the node at context
-		// This node is a corrupted copy of the node registered for this operation
-		// They do not share the same memory address
-		// Reassigning the pointer of OpData makes the program to crash!!!!!!!!!!
-		// Has absolutely insane values stored, changing it crashes the program
-		// using new or malloc doesn't work
+		options_.reference_activations.reset();
+		if (!options_.incremental_propagation)
+			return;
+		if (options_.dataset_size <= 0)
+		{
+			std::cout << "Warning: incremental propagation needs the dataset size, node " << options_.node_index << " is fully computed\n";
+			return;
+		}
+
+		// Convolutions keep their int8 output, fully connected nodes their int32 accumulators
+		const size_t input_bytes = std::accumulate(options_.input_dimensions.begin() + 1, options_.input_dimensions.end(), size_t(1), std::multiplies<size_t>());
+		const size_t result_bytes = options_.builtin_code == kTfLiteBuiltinConv2d ? getOutputSize() * sizeof(int8_t) : getOutputSize() * sizeof(int32_t);
+		options_.reference_activations = std::make_shared<ReferenceActivations>(options_.dataset_size, input_bytes, result_bytes);
+	}
+
+	TfLiteStatus MyDelegateNode::BuildActivationCache(TfLiteContext* context)
+	{
+		activation_cache_.reset();
+		if (options_.activation_caching == ActivationCaching::none || options_.node_index != options_.activation_node)
+			return kTfLiteOk;
+		// Nothing to replay when every layer before the node has to run
+		if (options_.activation_caching == ActivationCaching::replay && options_.prefix_nodes.empty())
+			return kTfLiteOk;
+		if (options_.dataset_size <= 0)
+		{
+			std::cout << "Warning: the activation cache needs the dataset size, activations are not cached\n";
+			return kTfLiteOk;
+		}
+
+		// The input of the node is int8
+		const size_t sample_bytes = std::accumulate(options_.input_dimensions.begin() + 1, options_.input_dimensions.end(), size_t(1), std::multiplies<size_t>());
+		auto activation_cache = std::make_unique<ActivationCache>(options_.dataset_size, sample_bytes, options_.model_key);
+		const std::string path = getNodePath(options_.activation_cache_file);
+		if (options_.activation_caching == ActivationCaching::capture)
+		{
+			if (!activation_cache->Create(path, options_.node_index))
+			{
+				TF_LITE_KERNEL_LOG(context, "Activation cache file %s can not be mapped", path.c_str());
+				return kTfLiteError;
+			}
+		}
+		else if (!activation_cache->Open(path, options_.node_index))
+		{
+			TF_LITE_KERNEL_LOG(context, "Activation cache file %s can not be opened or was captured for a different model", path.c_str());
+			return kTfLiteError;
+		}
+		activation_cache_ = std::move(activation_cache);
+		return kTfLiteOk;
+	}
 
-#if LOGGER
-		// Logging
-		//std::cout << std::endl << "MyDelegateKernel::Prepare function!" << std::endl;
-		//if (prepared_)
-		//{
-		//	std::cout << "Already prepared! This convolution does not need allocation again." << std::endl;
-		//}
-#endif // LOGGER
-	
-		TfLiteStatus prepared_success;
-		if (!prepared_)
+	TfLiteStatus MyDelegateNode::CacheActivations(TfLiteContext* context, int images, int samples_per_image)
+	{
+		// Every sample of a group holds the same image, the first one is captured and the replayed image fills all of them
+		const TfLiteTensor& input = context->tensors[node_.inputs->data[0]];
+		const size_t sample_bytes = activation_cache_->getSampleBytes();
+		for (int image = 0; image < images; image++)
 		{
-			// Calling the Custom Preparation
-			// Careful the order of inputs in the receiving node is not the same as the standard order
-			prepared_ = true;
-			if (options_.builtin_code == kTfLiteBuiltinConv2d)
+			unsigned char* image_input = reinterpret_cast<unsigned char*>(input.data.raw) + sample_bytes * image * samples_per_image;
+			const int dataset_image = options_.dataset_index + image;
+			if (options_.activation_caching == ActivationCaching::capture)
 			{
-				prepared_success = custom_ops::conv::Prepare<tflite::custom_ops::conv::kReference>(context, node, conv_params_, operation_data_conv_);
+				activation_cache_->Store(dataset_image, image_input);
+				continue;
 			}
-			else
+
+			const unsigned char* sample = activation_cache_->getSample(dataset_image);
+			if (sample == nullptr)
 			{
-				prepared_success = custom_ops::fully_connected::Prepare<tflite::custom_ops::fully_connected::kReference>(context, node, fully_params_, operation_data_fully_);
+				TF_LITE_KERNEL_LOG(context, "Image %d was not captured in activation cache file %s", dataset_image, options_.activation_cache_file.c_str());
+				return kTfLiteError;
 			}
-		}
-		else
-		{
-			prepared_success = kTfLiteOk;
-			// Resets the new call variable whenever a new dataset is evaluated
-			if (!MyDelegateOptions::new_call)
+			for (int s = 0; s < samples_per_image; s++)
 			{
-				MyDelegateOptions::new_call = true;
+				std::memcpy(image_input + sample_bytes * s, sample, sample_bytes);
 			}
 		}
-
-#if LOGGER
-		/*std::cout << "Special logging!\n";*/
-		//custom_logger::LogTfLiteContext(context);
-		//std::cout << "New node: " << std::endl;
-		//std::cout << "Memory address of node: " << reinterpret_cast<void*>(node) << std::endl;
-		//custom_logger::LogTfLiteNode(node);
-		//custom_logger::LogTfLiteConvParams(reinterpret_cast<TfLiteConvParams*>(node->builtin_data));
-		//std::cout<< std::endl;
-		//std::cout << "Preparation result: " << custom_logger::get_TfLiteStatus(prepared_success) << std::endl;
-#endif // LOGGER
-
-		return prepared_success;
+		return kTfLiteOk;
 	}
-	
-	TfLiteStatus MyDelegateKernel::Eval(TfLiteContext* context, TfLiteNode* node)
+
+	TfLiteStatus MyDelegateNode::ApplyRuntimeOptions(TfLiteContext* context)
 	{
-		// This is called whenever a session is active, so static variables here will be initialized only once for all the lifetime of tflite in python
-		// Evaluate the delegated graph.
-		// Here we loop over all the delegated nodes.
-		// The number of nodes equals ''inputs_.size()'' and inputs[i] is a list of
-		// tensor indices for inputs to node ''i'', while outputs_[i] is the list of
-		// outputs for node
-		// ''i''. Note, that it is intentional we have simple implementation as this
-		// is for demonstration.
+		const RuntimeOptions& runtime = *options_.runtime;
+		runtime_epoch_ = runtime.epoch.load(std::memory_order_acquire);
+		// Only the nodes matching the faulty layers are disturbed
+		const bool faulty = (runtime.operation_mode == OperationMode::convolution || runtime.operation_mode == OperationMode::image_weights) &&
+			MyDelegateOptions::matchLayerName(layer_name_.c_str(), runtime.faulty_layer) && options_.golden_caching != GoldenCaching::capture;
+		options_.operation_mode = faulty ? runtime.operation_mode : OperationMode::none;
+		options_.bit_position = runtime.bit_position;
+		options_.number_flips = runtime.number_flips;
+		// Weight faults always come from the error positions
+		options_.bit_error_rate = faulty && runtime.operation_mode == OperationMode::convolution ? runtime.bit_error_rate : 0.0;
+		options_.seed = runtime.seed;
+
+		// A new campaign starts from the first image of the dataset
+		options_.dataset_index = 0;
+		TF_LITE_ENSURE_STATUS(BuildAccumulatorCache(context));
+		return BuildFaultPlan(context);
+	}
 
-#if LOGGER
-		// Logging
-		//std::cout << std::endl << "MyDelegateKernel::Eval function!" << std::endl;
-		//std::cout << "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%" << std::endl;
-		//std::cout << "New node?? : " << std::endl;
-		//std::cout << "Memory address of node: " << reinterpret_cast<void*>(node) << std::endl;
-		//custom_logger::LogTfLiteNode(node);
-		//options_.Log();
-		//custom_logger::LogTfLiteContext(context);
-#endif // LOGGER
+	TfLiteStatus MyDelegateNode::BuildAccumulatorCache(TfLiteContext* context)
+	{
+		// Only the disturbed nodes keep their accumulators, a node that is disturbed later builds them then
+		if (options_.accumulator_caching == AccumulatorCaching::none || !options_.isDelegatedMode() || options_.accumulator_cache)
+			return kTfLiteOk;
+		if (options_.dataset_size <= 0)
+		{
+			std::cout << "Warning: the accumulator cache needs the dataset size, accumulators are not cached\n";
+			return kTfLiteOk;
+		}
 
-		TfLiteStatus evalued_success;
-		if (MyDelegateOptions::new_call)
+		// The accumulators depend on the weights, the bias and the zero points of the node
+		int input_index = -1, bias_index = -1, filter_index = -1;
+		custom_ops::GetTensorIndexes(context, &node_, &bias_index, &filter_index, &input_index);
+		const TfLiteTensor& input_tensor = context->tensors[node_.inputs->data[input_index]];
+		const TfLiteTensor& filter_tensor = context->tensors[node_.inputs->data[filter_index]];
+		const int32_t zero_points[2] = { input_tensor.params.zero_point, filter_tensor.params.zero_point };
+		uint64_t weights_key = AccumulatorCache::Hash(zero_points, sizeof(zero_points));
+		weights_key = AccumulatorCache::Hash(filter_tensor.data.raw_const, filter_tensor.bytes, weights_key);
+		if (bias_index >= 0)
 		{
-			options_.dataset_index = 0;
-			// Checks first evaluation of the dataset being evaluated
-			MyDelegateOptions::new_call = false;
+			const TfLiteTensor& bias_tensor = context->tensors[node_.inputs->data[bias_index]];
+			weights_key = AccumulatorCache::Hash(bias_tensor.data.raw_const, bias_tensor.bytes, weights_key);
 		}
 
-		if (options_.builtin_code == kTfLiteBuiltinConv2d)
+		auto accumulator_cache = std::make_shared<AccumulatorCache>(options_.dataset_size, getOutputSize(), weights_key);
+		if (options_.accumulator_caching == AccumulatorCaching::mapped)
 		{
-			evalued_success = custom_ops::conv::Eval<custom_ops::conv::kReference>(context, node, conv_params_, operation_data_conv_, options_);
+			const std::string path = getNodePath(options_.accumulator_cache_file);
+			if (!accumulator_cache->Map(path, options_.node_index))
+			{
+				TF_LITE_KERNEL_LOG(context, "Accumulator cache file %s can not be mapped", path.c_str());
+				return kTfLiteError;
+			}
 		}
 		else
 		{
-			evalued_success = custom_ops::fully_connected::Eval<custom_ops::fully_connected::kReference>(context, node, fully_params_, operation_data_fully_, options_);
+			accumulator_cache->Allocate();
 		}
-
-		// Most important part, whenever this is called the index of the dataset is incremented
-		options_.dataset_index++;
-
-#if LOGGER
-		//std::cout << "Evaluation result: " << custom_logger::get_TfLiteStatus(evalued_success) << std::endl;
-#endif // LOGGER
-
-		return evalued_success;
+		options_.accumulator_cache = std::move(accumulator_cache);
+		return kTfLiteOk;
 	}
 
-	void MyDelegateKernel::GetConvOperationData(const custom_ops::conv::OpData& operation_data)
+	void MyDelegateNode::GetConvOperationData(const custom_ops::conv::OpData& operation_data)
 	{
 		operation_data_conv_->im2col_id = operation_data.im2col_id;
 		operation_data_conv_->hwcn_weights_id = operation_data.hwcn_weights_id;
@@ -583,7 +1141,7 @@ namespace tflite {
 		operation_data_conv_->quantized_bias_type = operation_data.quantized_bias_type;
 	}
 	
-	void MyDelegateKernel::GetConvParams(const TfLiteConvParams& params)
+	void MyDelegateNode::GetConvParams(const TfLiteConvParams& params)
 	{
 		conv_params_->padding = params.padding;
 		conv_params_->stride_width = params.stride_width;
@@ -594,7 +1152,7 @@ namespace tflite {
 		conv_params_->quantized_bias_type = params.quantized_bias_type;
 	}
 
-	void MyDelegateKernel::GetFullyOperationData(const custom_ops::fully_connected::OpData& operation_data)
+	void MyDelegateNode::GetFullyOperationData(const custom_ops::fully_connected::OpData& operation_data)
 	{
 		operation_data_fully_->output_multiplier = operation_data.output_multiplier;
 		operation_data_fully_->output_shift = operation_data.output_shift;
@@ -613,7 +1171,7 @@ namespace tflite {
 		operation_data_fully_->quantized_bias_type = operation_data.quantized_bias_type;
 	}
 
-	void MyDelegateKernel::GetFullyParams(const TfLiteFullyConnectedParams& params)
+	void MyDelegateNode::GetFullyParams(const TfLiteFullyConnectedParams& params)
 	{
 		fully_params_->activation = params.activation;
 		fully_params_->weights_format = params.weights_format;
@@ -622,22 +1180,288 @@ namespace tflite {
 		fully_params_->quantized_bias_type = params.quantized_bias_type;
 	}
 
-	void MyDelegateKernel::getChunkIndexes(int start, int end, const std::vector<std::pair<std::vector<int>, std::vector<int>>>& error_vec_positions, std::vector<int>& indexes)
+	void MyDelegateNode::BuildPackedFilter(TfLiteContext* context)
+	{
+		// Grouped convolutions fall back to the reference kernel
+		if (options_.builtin_code == kTfLiteBuiltinConv2d && operation_data_conv_->groups != 1)
+			return;
+
+		int input_index = -1, bias_index = -1, filter_index = -1;
+		custom_ops::GetTensorIndexes(context, &node_, &bias_index, &filter_index, &input_index);
+		const TfLiteTensor& filter_tensor = context->tensors[node_.inputs->data[filter_index]];
+		if (filter_tensor.type != kTfLiteInt8)
+			return;
+
+		// Convolution filters are [output_depth][height][width][input_depth], fully connected weights [output_depth][accum_depth]
+		const int output_depth = filter_tensor.dims->data[0];
+		int depth = 1;
+		for (int dim = 1; dim < filter_tensor.dims->size; ++dim)
+			depth *= filter_tensor.dims->data[dim];
+
+		auto packed_filter = std::make_shared<custom_ops::PackedFilter>();
+		custom_ops::gemm::PackFilter(filter_tensor.data.int8, output_depth, depth, *packed_filter);
+		options_.packed_filter = std::move(packed_filter);
+	}
+
+	void MyDelegateNode::BuildConvIndirection(TfLiteContext* context)
+	{
+		if (options_.builtin_code != kTfLiteBuiltinConv2d)
+			return;
+
+		// The padding has just been computed by the custom preparation
+		int input_index = -1, bias_index = -1, filter_index = -1;
+		custom_ops::GetTensorIndexes(context, &node_, &bias_index, &filter_index, &input_index);
+		const TfLiteIntArray* input_dims = context->tensors[node_.inputs->data[input_index]].dims;
+		const TfLiteIntArray* filter_dims = context->tensors[node_.inputs->data[filter_index]].dims;
+		const TfLiteIntArray* output_dims = context->tensors[node_.outputs->data[0]].dims;
+		custom_ops::ConvGeometry geometry;
+		geometry.input_height = input_dims->data[1];
+		geometry.input_width = input_dims->data[2];
+		geometry.input_depth = input_dims->data[3];
+		geometry.filter_height = filter_dims->data[1];
+		geometry.filter_width = filter_dims->data[2];
+		geometry.filter_input_depth = filter_dims->data[3];
+		geometry.output_height = output_dims->data[1];
+		geometry.output_width = output_dims->data[2];
+		geometry.stride_height = conv_params_->stride_height;
+		geometry.stride_width = conv_params_->stride_width;
+		geometry.dilation_height_factor = conv_params_->dilation_height_factor;
+		geometry.dilation_width_factor = conv_params_->dilation_width_factor;
+		geometry.pad_height = operation_data_conv_->padding.height;
+		geometry.pad_width = operation_data_conv_->padding.width;
+		if (options_.conv_indirection && options_.conv_indirection->getGeometry() == geometry)
+			return;
+		options_.conv_indirection = std::make_shared<const custom_ops::ConvIndirection>(geometry);
+	}
+
+	void MyDelegateNode::BuildConvSpecialization(TfLiteContext* context)
+	{
+		if (!options_.conv_indirection)
+			return;
+
+		// The filter and the input zero point are constant, the geometry is the one of the indirection
+		int input_index = -1, bias_index = -1, filter_index = -1;
+		custom_ops::GetTensorIndexes(context, &node_, &bias_index, &filter_index, &input_index);
+		const TfLiteTensor& input_tensor = context->tensors[node_.inputs->data[input_index]];
+		const TfLiteTensor& filter_tensor = context->tensors[node_.inputs->data[filter_index]];
+		const custom_ops::ConvGeometry& geometry = options_.conv_indirection->getGeometry();
+		const int output_depth = filter_tensor.dims->data[0];
+		const int32_t input_offset = -input_tensor.params.zero_point;
+		if (options_.conv_specialization && options_.conv_specialization->isBuiltFor(geometry, filter_tensor.data.int8, output_depth, input_offset))
+			return;
+		options_.conv_specialization = std::make_shared<const custom_ops::ConvSpecialization>(geometry, filter_tensor.data.int8, output_depth, input_offset);
+	}
+
+	void MyDelegateNode::BuildValidTaps()
+	{
+		// Rows and columns of the filter that fall inside the input for every output row and column
+		// Taps in the padding are never multiplied, so they can not be faulty
+		valid_rows_.clear();
+		valid_columns_.clear();
+		if (options_.builtin_code != kTfLiteBuiltinConv2d)
+			return;
+
+		// output : batch   output_y    output_x    output_channel
+		//          0       1           2           3
+		// kernel:  output_channel  kernel_y    kernel_x    input_channel
+		//          0               1           2           3
+		const int input_height = options_.input_dimensions[1];
+		const int input_width = options_.input_dimensions[2];
+		for (int out_y = 0; out_y < options_.output_dimensions[1]; ++out_y)
+		{
+			const int in_y_origin = (out_y * conv_params_->stride_height) - operation_data_conv_->padding.height;
+			for (int filter_y = 0; filter_y < options_.kernel_dimensions[1]; ++filter_y)
+			{
+				const int in_y = in_y_origin + conv_params_->dilation_height_factor * filter_y;
+				if (in_y >= 0 && in_y < input_height)
+					valid_rows_.emplace_back(out_y, filter_y);
+			}
+		}
+		for (int out_x = 0; out_x < options_.output_dimensions[2]; ++out_x)
+		{
+			const int in_x_origin = (out_x * conv_params_->stride_width) - operation_data_conv_->padding.width;
+			for (int filter_x = 0; filter_x < options_.kernel_dimensions[2]; ++filter_x)
+			{
+				const int in_x = in_x_origin + conv_params_->dilation_width_factor * filter_x;
+				if (in_x >= 0 && in_x < input_width)
+					valid_columns_.emplace_back(out_x, filter_x);
+			}
+		}
+	}
+
+	long long MyDelegateNode::getNumberValidMacs() const
+	{
+		if (options_.builtin_code == kTfLiteBuiltinConv2d)
+		{
+			// output channel x valid rows x valid columns x input channel
+			return static_cast<long long>(options_.output_dimensions[3]) *
+				valid_rows_.size() * valid_columns_.size() * options_.kernel_dimensions[3];
+		}
+		// Fully connected: every output multiplies every element of the kernel row
+		return static_cast<long long>(getOutputSize()) * options_.kernel_dimensions.back();
+	}
+
+	std::pair<int, int> MyDelegateNode::getMacPosition(long long mac) const
+	{
+		if (options_.builtin_code == kTfLiteBuiltinConv2d)
+		{
+			// mac = ((out_channel * valid rows + row) * valid columns + column) * input_depth + in_channel
+			const int input_depth = options_.kernel_dimensions[3];
+			const int filter_width = options_.kernel_dimensions[2];
+			const int output_width = options_.output_dimensions[2];
+			const int output_depth = options_.output_dimensions[3];
+
+			const int in_channel = static_cast<int>(mac % input_depth);
+			mac /= input_depth;
+			const auto& column = valid_columns_[mac % valid_columns_.size()];
+			mac /= valid_columns_.size();
+			const auto& row = valid_rows_[mac % valid_rows_.size()];
+			mac /= valid_rows_.size();
+			const int out_channel = static_cast<int>(mac);
+
+			// Relative to the sample, the same positions are used for every image of a batch
+			const int output_position = (row.first * output_width + column.first) * output_depth + out_channel;
+			const int kernel_partial_position = (row.second * filter_width + column.second) * input_depth + in_channel;
+			return { output_position, kernel_partial_position };
+		}
+		const int accum_depth = options_.kernel_dimensions.back();
+		return { static_cast<int>(mac / accum_depth), static_cast<int>(mac % accum_depth) };
+	}
+
+	long long MyDelegateNode::getNumberFaultSites() const
+	{
+		// Every weight of the kernel can be flipped
+		if (options_.operation_mode == OperationMode::image_weights)
+			return static_cast<long long>(options_.kernel_dimensions[0]) * getKernelSize();
+		return getNumberValidMacs();
+	}
+
+	std::pair<int, int> MyDelegateNode::getFaultSite(long long site) const
+	{
+		// Output channel and position inside its row of the kernel
+		if (options_.operation_mode == OperationMode::image_weights)
+			return { static_cast<int>(site / getKernelSize()), static_cast<int>(site % getKernelSize()) };
+		return getMacPosition(site);
+	}
+
+	void MyDelegateNode::GenerateErrorPositions(int image_index, int trial, std::vector<std::pair<int, int>>& error_positions)
 	{
-		indexes.clear();
-		for (int i = 0; i < error_vec_positions.size(); i++)
+		/// Random variables generation!
+		// Counter-based generator keyed by the seed of the trial, the stream is identified by node and image
+		// Any image can be reproduced without generating the previous ones
+		PhiloxRandom generator(options_.getTrialSeed(trial), options_.node_index, image_index);
+
+		// Faults are drawn uniformly from the multiplications that are really performed, or from the weights in image_weights mode
+		// There can not be more faults than multiplications
+		const long long number_macs = getNumberFaultSites();
+		const int number_flips = static_cast<int>(std::min<long long>(options_.number_flips, number_macs));
+
+		error_positions.clear();
+		// MUST BE RESERVE not RESIZE
+		error_positions.reserve(number_flips);
+
+		// Floyd's algorithm, number_flips different multiplications without retries
+		std::unordered_set<long long> selected_macs;
+		selected_macs.reserve(2 * static_cast<size_t>(number_flips));
+		for (long long j = number_macs - number_flips; j < number_macs; ++j)
 		{
-			// We are checking the channel of the channel output of the first position 
-			const int& output_channel = error_vec_positions[i].first.back();
-			// Range does not include end
-			if (output_channel >= start && output_channel < end)
+			long long mac = generator.Uniform64(j + 1);
+			if (!selected_macs.insert(mac).second)
 			{
-				indexes.push_back(i);
+				// Already selected, j itself has never been a candidate before
+				mac = j;
+				selected_macs.insert(mac);
 			}
+			error_positions.push_back(getFaultSite(mac));
 		}
+
+#if LOGGER
+		//std::cout << "Number of valid multiplications " << number_macs << "\n";
+#endif // LOGGER
+
+		std::sort(error_positions.begin(), 
+			error_positions.end(), 
+			[this](const std::pair<int, int>& pair1, const std::pair<int, int>& pair2) 
+			{ 
+				return options_.getPairIntGreater(pair1, pair2); 
+			});
+	}
+
+	bool MyDelegateNode::SaveFaultPlan(const std::string& path)
+	{
+		FaultPlanFileHeader header;
+		header.seed = options_.seed;
+		header.node_index = options_.node_index;
+		header.builtin_code = options_.builtin_code;
+		header.bit_position = options_.bit_position;
+		header.output_size = getFaultOutputSize();
+		header.kernel_size = getKernelSize();
+		header.trials = options_.trials_per_invoke;
+
+		std::function<void(int, std::vector<std::pair<int, int>>&)> get_image;
+		switch (options_.fault_generation)
+		{
+		case FaultGeneration::precomputed:
+			header.number_flips = static_cast<int>(std::min<long long>(options_.number_flips, getNumberFaultSites()));
+			header.num_images = fault_plan_->getNumImages();
+			get_image = [this](int image, std::vector<std::pair<int, int>>& positions)
+			{
+				const FaultSpan span = fault_plan_->getImage(image);
+				for (int k = 0; k < span.size; k++)
+				{
+					positions.emplace_back(span.output_positions[k], span.kernel_positions[k]);
+				}
+			};
+			break;
+		case FaultGeneration::replay:
+			header.number_flips = plan_file_.getHeader().number_flips;
+			header.num_images = plan_file_.getHeader().num_images;
+			get_image = [this](int image, std::vector<std::pair<int, int>>& positions)
+			{
+				plan_file_.ReadImage(image, positions);
+			};
+			break;
+		default:
+			// Lazy generation has no table, the images are generated while they are written
+			header.number_flips = static_cast<int>(std::min<long long>(options_.number_flips, getNumberFaultSites()));
+			header.num_images = options_.dataset_size * options_.trials_per_invoke;
+			get_image = [this](int fault_set, std::vector<std::pair<int, int>>& positions)
+			{
+				GenerateErrorPositions(fault_set / options_.trials_per_invoke, fault_set % options_.trials_per_invoke, positions);
+			};
+			break;
+		}
+		return FaultPlanFile::Write(path, header, get_image);
+	}
+
+	int MyDelegateNode::getOutputSize() const
+	{
+		// Convolution samples are the output images, fully connected samples are the rows of the output
+		if (options_.builtin_code == kTfLiteBuiltinConv2d)
+			return std::accumulate(options_.output_dimensions.begin() + 1, options_.output_dimensions.end(), 1, std::multiplies<int>());
+		return options_.output_dimensions.back();
+	}
+
+	int MyDelegateNode::getFaultOutputSize() const
+	{
+		// Weight faults are placed by output channel
+		if (options_.operation_mode == OperationMode::image_weights)
+			return options_.kernel_dimensions[0];
+		return getOutputSize();
+	}
+
+	int MyDelegateNode::getBatchSize() const
+	{
+		return std::accumulate(options_.output_dimensions.begin(), options_.output_dimensions.end(), 1, std::multiplies<int>()) / getOutputSize();
 	}
 
-	int MyDelegateKernel::getNumberOperations(const std::vector<int>& output_dimensions, const std::vector<int>& kernel_dimensions)
+	int MyDelegateNode::getKernelSize() const
+	{
+		// Every dimension of the kernel but the output channel
+		return std::accumulate(options_.kernel_dimensions.begin() + 1, options_.kernel_dimensions.end(), 1, std::multiplies<int>());
+	}
+
+	int MyDelegateNode::getNumberOperations(const std::vector<int>& output_dimensions, const std::vector<int>& kernel_dimensions)
 	{
 		// It is assumed the last dimension of the output coincides with the first of the kernel
 		int acc = 1;
@@ -652,15 +1476,82 @@ namespace tflite {
 		return acc;
 	}
 
+	// MyBuiltinNode Methods
+
+	MyBuiltinNode::~MyBuiltinNode()
+	{
+		// The operation data and the parameters belong to the original node
+		TfLiteIntArrayFree(node_.inputs);
+		TfLiteIntArrayFree(node_.outputs);
+		TfLiteIntArrayFree(node_.intermediates);
+		TfLiteIntArrayFree(node_.temporaries);
+	}
+
+	TfLiteStatus MyBuiltinNode::Init(TfLiteContext* context, int node_index)
+	{
+		TfLiteNode* original_node = nullptr;
+		TfLiteRegistration* original_registration = nullptr;
+		TF_LITE_ENSURE_EQ(
+			context,
+			context->GetNodeAndRegistration(context, node_index, &original_node,
+				&original_registration), kTfLiteOk);
+
+		// The registration is copied, the node table of the interpreter grows when the partitions are replaced
+		registration_ = *original_registration;
+		node_.inputs = TfLiteIntArrayCopy(original_node->inputs);
+		node_.outputs = TfLiteIntArrayCopy(original_node->outputs);
+		node_.intermediates = original_node->intermediates != nullptr ? TfLiteIntArrayCopy(original_node->intermediates) : nullptr;
+		node_.temporaries = TfLiteIntArrayCreate(0);
+		node_.user_data = original_node->user_data;
+		node_.builtin_data = original_node->builtin_data;
+		node_.custom_initial_data = original_node->custom_initial_data;
+		node_.custom_initial_data_size = original_node->custom_initial_data_size;
+		return kTfLiteOk;
+	}
+
+	TfLiteStatus MyBuiltinNode::Prepare(TfLiteContext* context)
+	{
+		if (registration_.prepare == nullptr)
+			return kTfLiteOk;
+		return registration_.prepare(context, &node_);
+	}
+
+	TfLiteStatus MyBuiltinNode::Eval(TfLiteContext* context)
+	{
+		if (registration_.invoke == nullptr)
+		{
+			TF_LITE_KERNEL_LOG(context, "The kernel of builtin code %d can not be invoked", registration_.builtin_code);
+			return kTfLiteError;
+		}
+		return registration_.invoke(context, &node_);
+	}
+
+	const TfLiteIntArray* MyBuiltinNode::getInputs() const
+	{
+		return node_.inputs;
+	}
+
+	const TfLiteIntArray* MyBuiltinNode::getOutputs() const
+	{
+		return node_.outputs;
+	}
+
+	const TfLiteIntArray* MyBuiltinNode::getTemporaries() const
+	{
+		return node_.temporaries;
+	}
+
 	// MyDelegate Methods
 
 	MyDelegate::MyDelegate()
 	{
 		// This calls the default constructor of options_ (MyDelegateOptions)
+		CreateRuntimeOptions();
 	}
 	MyDelegate::MyDelegate(const MyDelegateOptions& options)
 		: options_(options)
 	{
+		CreateRuntimeOptions();
 		// Called from the entry point by creating an unique pointer there
 		// MyDelegate is created before the MyDelegateKernel
 		// The initialization list calls the copy constructor of options_ MyDelegateOptions
@@ -672,7 +1563,7 @@ namespace tflite {
 	{
 		//std::cout << "\nMyDelegate destructor called\n\n";
 	}
-	bool MyDelegate::IsNodeSupportedByDelegate(const TfLiteRegistration* registration, const TfLiteNode* node, TfLiteContext* context) const
+	bool MyDelegate::MatchesLayer(const TfLiteRegistration* registration, const TfLiteNode* node, TfLiteContext* context) const
 	{
 		// Checking the TfLiteRegistration
 		// Only supports 2D convolution operations.
@@ -716,36 +1607,49 @@ namespace tflite {
 #if LOGGER
 		//std::cout << "Kernel tensor name: " << kernel_tensor.name << "\n";
 #endif // LOGGER
-		// By this criteria only one node will be accepted!
-		if (strstr(kernel_tensor.name, options_.layer_name.c_str()) == nullptr)
+		// Every node matching one of the patterns of layer_name is accepted
+		return MyDelegateOptions::matchLayerName(kernel_tensor.name, options_.layer_name);
+	}
+	bool MyDelegate::IsNodeSupportedByDelegate(const TfLiteRegistration* registration, const TfLiteNode* node, TfLiteContext* context) const
+	{
+		// Layers before the first delegated node are claimed when their result is replayed from the activation cache,
+		// and so are the layers after the last faulty node when golden outputs are cached
+		if (claimed_node_set_.count(node) != 0)
+			return true;
+
+		if (!MatchesLayer(registration, node, context))
 			return false;
-		
+		auto& kernel_tensor = context->tensors[node->inputs->data[1]];
+
 		// Checking if it affects the weights or the convolution
 		if (options_.operation_mode == OperationMode::weights)
 		{
 			// Generate random number here to affect the weights of the kernel
+			// The tensor is kept, so its weights can be restored or flipped again without reloading the model
+			// A tensor shared by several nodes, or seen again when the graph is partitioned again, is only flipped once
 			signed char* tensor_ptr = reinterpret_cast<signed char*>(kernel_tensor.data.data);
-			int size = custom_ops::getFlatSize(kernel_tensor.dims);
-			std::random_device random_device;
-			std::mt19937 mt_generator(random_device());
-			std::uniform_int_distribution<int> dist(0, size - 1);
-			int random_position = 0;
-			for (int i = 0; i < options_.number_flips; i++)
+			const bool is_known = std::any_of(weight_tensors_.begin(), weight_tensors_.end(),
+				[tensor_ptr](const WeightTensor& weight_tensor) { return weight_tensor.data == tensor_ptr; });
+			if (!is_known)
 			{
-				random_position = dist(mt_generator);
-				*(tensor_ptr + random_position) = (signed char)(*(tensor_ptr + random_position) ^ (1 << options_.bit_position));
+				WeightTensor weight_tensor;
+				weight_tensor.tensor_index = node->inputs->data[1];
+				weight_tensor.data = tensor_ptr;
+				weight_tensor.size = custom_ops::getFlatSize(kernel_tensor.dims);
+				weight_tensors_.push_back(weight_tensor);
+				FlipTensorWeights(weight_tensor, options_.bit_position, options_.number_flips, options_.seed);
 			}
 #if LOGGER
-			//std::cout << "Random random_position: " << random_position << std::endl;
 			//std::cout << "Bit position: " << options_.bit_position << std::endl;
-			//std::cout << "Tensor " << node->inputs->data[1] << " original value " << +*(tensor_ptr + random_position) << std::endl;
+			//std::cout << "Tensor " << node->inputs->data[1] << " flipped weights " << weight_snapshot_.size() << std::endl;
 #endif // LOGGER
 			
 			// Should not delegate but it has modified the context
 			return false;
 		}
 
-		if (options_.operation_mode != OperationMode::convolution)
+		// A delegate created without faults leaves the graph to TFLite unless the layers are named
+		if (!claimsLayers())
 		{
 			return false;
 		}
@@ -761,15 +1665,205 @@ namespace tflite {
 	}
 	TfLiteStatus MyDelegate::Initialize(TfLiteContext* context)
 	{
+		// The thread pool lives as long as the delegate, so threads are not created on every Eval
+		if (!thread_pool_)
+		{
+			int pool_size = std::min<int>(options_.max_number_threads, std::max(1u, std::thread::hardware_concurrency()));
+			// Avoid oversubscribing the threads requested to the interpreter
+			if (context->recommended_num_threads > 0)
+				pool_size = std::min(pool_size, context->recommended_num_threads);
+			thread_pool_ = std::make_shared<ThreadPool>(pool_size);
+		}
+
+		// The nodes around the faulty layers that are claimed are found before the nodes are claimed
+		claimed_node_set_.clear();
+		if ((options_.activation_caching != ActivationCaching::none || options_.golden_caching != GoldenCaching::none) &&
+			options_.isDelegatedMode())
+		{
+			// A capture is only valid for the model it was taken from
+			uint64_t model_key = AccumulatorCache::Hash(nullptr, 0);
+			for (size_t t = 0; t < context->tensors_size; t++)
+			{
+				const TfLiteTensor& tensor = context->tensors[t];
+				if (tensor.allocation_type == kTfLiteMmapRo && tensor.data.raw_const != nullptr)
+					model_key = AccumulatorCache::Hash(tensor.data.raw_const, tensor.bytes, model_key);
+			}
+			options_.model_key = model_key;
+		}
+		if (options_.activation_caching != ActivationCaching::none && options_.isDelegatedMode())
+		{
+			TF_LITE_ENSURE_STATUS(FindActivationPrefix(context));
+		}
+		if (options_.golden_caching != GoldenCaching::none && options_.isDelegatedMode())
+		{
+			TF_LITE_ENSURE_STATUS(FindGoldenSuffix(context));
+		}
 
 #if LOGGER
 		//std::cout << std::endl << "Variables in MyDelegate::Initialize" << std::endl;
 		//custom_logger::LogTfLiteContext(context);
 		//options_.Log();
+		std::cout << "Int8 dot product: " << custom_ops::dot_product::getSelectedName() << std::endl;
 #endif // LOGGER
 
 		return kTfLiteOk;
 	}
+	TfLiteStatus MyDelegate::FindActivationPrefix(TfLiteContext* context)
+	{
+		options_.activation_node = -1;
+		options_.prefix_nodes.clear();
+
+		TfLiteIntArray* execution_plan = nullptr;
+		TF_LITE_ENSURE_STATUS(context->GetExecutionPlan(context, &execution_plan));
+
+		// Producer and consumers of every tensor, the first claimed node is the one whose input is cached
+		std::vector<TfLiteNode*> nodes(execution_plan->size);
+		std::unordered_map<int, int> producers;
+		std::unordered_map<int, std::vector<int>> consumers;
+		for (int i = 0; i < execution_plan->size; i++)
+		{
+			TfLiteRegistration* registration = nullptr;
+			TF_LITE_ENSURE_STATUS(context->GetNodeAndRegistration(context, execution_plan->data[i], &nodes[i], &registration));
+			if (options_.activation_node < 0 && MatchesLayer(registration, nodes[i], context))
+				options_.activation_node = execution_plan->data[i];
+			for (int j = 0; j < nodes[i]->outputs->size; j++)
+				producers[nodes[i]->outputs->data[j]] = i;
+			for (int j = 0; j < nodes[i]->inputs->size; j++)
+				if (nodes[i]->inputs->data[j] >= 0)
+					consumers[nodes[i]->inputs->data[j]].push_back(i);
+		}
+		if (options_.activation_node < 0 || options_.activation_caching != ActivationCaching::replay)
+			return kTfLiteOk;
+
+		// Ancestors of the node, every layer its input depends on
+		const int target = static_cast<int>(std::find(execution_plan->data, execution_plan->data + execution_plan->size, options_.activation_node) - execution_plan->data);
+		const int target_input = nodes[target]->inputs->data[0];
+		std::vector<bool> skipped(nodes.size(), false);
+		std::vector<int> pending;
+		auto add_producer = [&](int tensor)
+		{
+			auto producer = producers.find(tensor);
+			if (producer != producers.end() && !skipped[producer->second])
+			{
+				skipped[producer->second] = true;
+				pending.push_back(producer->second);
+			}
+		};
+		add_producer(target_input);
+		while (!pending.empty())
+		{
+			const int i = pending.back();
+			pending.pop_back();
+			for (int j = 0; j < nodes[i]->inputs->size; j++)
+				add_producer(nodes[i]->inputs->data[j]);
+		}
+
+		// A layer whose result is read by another layer, or is an output of the model, must run,
+		// and so must every layer before it
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (size_t i = 0; i < nodes.size(); i++)
+			{
+				if (!skipped[i])
+					continue;
+				bool needed = false;
+				for (int j = 0; j < nodes[i]->outputs->size && !needed; j++)
+				{
+					const auto tensor_consumers = consumers.find(nodes[i]->outputs->data[j]);
+					if (tensor_consumers == consumers.end())
+					{
+						needed = true;
+						break;
+					}
+					for (int consumer : tensor_consumers->second)
+					{
+						if (consumer != target && !skipped[consumer])
+							needed = true;
+					}
+				}
+				if (!needed)
+					continue;
+
+				skipped[i] = false;
+				changed = true;
+				pending.push_back(static_cast<int>(i));
+				while (!pending.empty())
+				{
+					const int k = pending.back();
+					pending.pop_back();
+					for (int j = 0; j < nodes[k]->inputs->size; j++)
+					{
+						auto producer = producers.find(nodes[k]->inputs->data[j]);
+						if (producer != producers.end() && skipped[producer->second])
+						{
+							skipped[producer->second] = false;
+							pending.push_back(producer->second);
+						}
+					}
+				}
+			}
+		}
+
+		// Nothing can be skipped when the layer computing the cached input has to run
+		auto producer = producers.find(target_input);
+		if (producer == producers.end() || !skipped[producer->second])
+		{
+			std::cout << "Warning: the input of node " << options_.activation_node << " is needed by other layers, no layer is skipped\n";
+			return kTfLiteOk;
+		}
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			if (skipped[i])
+			{
+				options_.prefix_nodes.push_back(execution_plan->data[i]);
+				claimed_node_set_.insert(nodes[i]);
+			}
+		}
+		return kTfLiteOk;
+	}
+	TfLiteStatus MyDelegate::FindGoldenSuffix(TfLiteContext* context)
+	{
+		options_.golden_node = -1;
+		options_.suffix_nodes.clear();
+
+		TfLiteIntArray* execution_plan = nullptr;
+		TF_LITE_ENSURE_STATUS(context->GetExecutionPlan(context, &execution_plan));
+
+		// Only the faulty nodes can make the outputs differ from the golden ones
+		int golden = -1;
+		std::vector<TfLiteNode*> nodes(execution_plan->size);
+		for (int i = 0; i < execution_plan->size; i++)
+		{
+			TfLiteRegistration* registration = nullptr;
+			TF_LITE_ENSURE_STATUS(context->GetNodeAndRegistration(context, execution_plan->data[i], &nodes[i], &registration));
+			if (!MatchesLayer(registration, nodes[i], context))
+				continue;
+			const char* layer_name = context->tensors[nodes[i]->inputs->data[1]].name;
+			if (MyDelegateOptions::matchLayerName(layer_name != nullptr ? layer_name : "", options_.faulty_layer))
+				golden = i;
+		}
+		if (golden < 0)
+		{
+			std::cout << "Warning: no node matches the faulty layers, golden outputs are not cached\n";
+			return kTfLiteOk;
+		}
+		options_.golden_node = execution_plan->data[golden];
+		if (golden + 1 == execution_plan->size)
+		{
+			std::cout << "Warning: node " << options_.golden_node << " is the last layer of the model, no layer is skipped\n";
+			return kTfLiteOk;
+		}
+
+		// Every later layer is claimed, so the outputs of the model are computed inside the delegate
+		for (int i = golden + 1; i < execution_plan->size; i++)
+		{
+			options_.suffix_nodes.push_back(execution_plan->data[i]);
+			claimed_node_set_.insert(nodes[i]);
+		}
+		return kTfLiteOk;
+	}
 	const char* MyDelegate::Name() const
 	{
 		static constexpr char kName[] = "DelegateSET";
@@ -782,7 +1876,72 @@ namespace tflite {
 #if LOGGER
 		//std::cout << "Created Simple Interface\n";
 #endif // LOGGER
-		return std::make_unique<MyDelegateKernel>(options_);
+		return std::make_unique<MyDelegateKernel>(options_, thread_pool_);
+	}
+	RuntimeOptions& MyDelegate::getRuntimeOptions()
+	{
+		return *options_.runtime;
+	}
+	bool MyDelegate::claimsLayers() const
+	{
+		return options_.isDelegatedMode() || (options_.operation_mode == OperationMode::none && !options_.layer_name.empty());
+	}
+	void MyDelegate::RestoreWeights()
+	{
+		// Backwards, so a weight flipped twice ends with its first value
+		for (auto it = weight_snapshot_.rbegin(); it != weight_snapshot_.rend(); ++it)
+		{
+			*it->first = it->second;
+		}
+		weight_snapshot_.clear();
+	}
+	TfLiteStatus MyDelegate::FlipWeights()
+	{
+		// Weights are int8
+		const RuntimeOptions& runtime = *options_.runtime;
+		if (runtime.bit_position < 0 || runtime.bit_position > 7 || runtime.number_flips < 0)
+			return kTfLiteError;
+
+		RestoreWeights();
+		for (const WeightTensor& weight_tensor : weight_tensors_)
+		{
+			FlipTensorWeights(weight_tensor, runtime.bit_position, runtime.number_flips, runtime.seed);
+		}
+		return kTfLiteOk;
+	}
+	void MyDelegate::FlipTensorWeights(const WeightTensor& weight_tensor, int bit_position, int number_flips, unsigned long long seed) const
+	{
+		// Counter-based generator keyed by the seed, every tensor is its own stream
+		PhiloxRandom generator(seed, static_cast<uint32_t>(weight_tensor.tensor_index), 0);
+		number_flips = std::min(number_flips, weight_tensor.size);
+
+		// Floyd's algorithm, number_flips different weights without retries
+		std::unordered_set<int> selected_positions;
+		selected_positions.reserve(2 * static_cast<size_t>(std::max(number_flips, 0)));
+		for (int j = weight_tensor.size - number_flips; j < weight_tensor.size; ++j)
+		{
+			int position = generator.Uniform(j + 1);
+			if (!selected_positions.insert(position).second)
+			{
+				// Already selected, j itself has never been a candidate before
+				position = j;
+				selected_positions.insert(position);
+			}
+			signed char* weight = weight_tensor.data + position;
+			weight_snapshot_.emplace_back(weight, *weight);
+			*weight = (signed char)(*weight ^ (1 << bit_position));
+		}
+	}
+	void MyDelegate::CreateRuntimeOptions()
+	{
+		// Starts with the values given when the delegate was created
+		options_.runtime = std::make_shared<RuntimeOptions>();
+		options_.runtime->operation_mode = options_.operation_mode;
+		options_.runtime->bit_position = options_.bit_position;
+		options_.runtime->number_flips = options_.number_flips;
+		options_.runtime->bit_error_rate = options_.bit_error_rate;
+		options_.runtime->seed = options_.seed;
+		options_.runtime->faulty_layer = options_.faulty_layer;
 	}
 	SimpleDelegateInterface::Options MyDelegate::DelegateOptions() const
 	{
@@ -4,28 +4,267 @@
 #include <vector>
 #include <random>
 #include <numeric>
+#include <memory>
+#include <unordered_set>
+#include <unordered_map>
+#include <functional>
 #include <tensorflow/lite/delegates/utils/simple_delegate.h>
 #include <tensorflow/lite/builtin_ops.h>
 #include <tensorflow/lite/kernels/kernel_util.h>
 #include <tensorflow/lite/kernels/internal/tensor_ctypes.h>
 
 #include "Options.h"
+#include "ThreadPool.h"
+#include "Philox.h"
+#include "FaultPlan.h"
+#include "FaultPlanFile.h"
+#include "ActivationCache.h"
 #include "ConvOps.h"
 #include "FullyConnectedOps.h"
 #include "Logger.h"
 
 namespace tflite {
 
+	// MyDelegateNode
+	// Each instance represents a single TFLite node replaced by the delegate
+	// It is evaluated through a copy of the original node, so the nodes of a partition can be chained
+	class MyDelegateNode
+	{
+	public:
+		/// <summary>
+		/// MyDelegateNode constructor<para/>
+		///	&#009; - Called from MyDelegateKernel::Init for every node to replace
+		/// </summary>
+		/// <param name="options">: Options of the delegate</param>
+		/// <param name="thread_pool">: Thread pool owned by MyDelegate</param>
+		MyDelegateNode(const MyDelegateOptions& options, const std::shared_ptr<ThreadPool>& thread_pool);
+
+		// MyDelegateNode destructor
+		~MyDelegateNode();
+
+		MyDelegateNode(const MyDelegateNode&) = delete;
+		MyDelegateNode& operator=(const MyDelegateNode&) = delete;
+		
+		// Steals the information of the original node and builds its fault plan
+		TfLiteStatus Init(TfLiteContext* context, int node_index);
+
+		// Prepares the copy of the original node
+		// Called again when an input is resized, the dimensions of the node are refreshed
+		TfLiteStatus Prepare(TfLiteContext* context);
+
+		// Evaluates the node for the images of the batch and moves to the next ones
+		TfLiteStatus Eval(TfLiteContext* context);
+
+		// Restarts the evaluation from the first image of the dataset
+		void ResetDatasetIndex();
+
+		// Output tensors of the original node
+		const TfLiteIntArray* getOutputs() const;
+
+		// Temporary tensors requested by the node in Prepare
+		const TfLiteIntArray* getTemporaries() const;
+
+		// Input tensor copied from the activation cache, -1 if the input is computed by the layers before the node
+		int getReplayedInput() const;
+
+		// The layers computing a replayed input are skipped, so the node resizes it to the batch of the partition
+		TfLiteStatus ResizeReplayedInput(TfLiteContext* context, int batch);
+
+		// Image of the dataset of the first sample of the next Eval
+		int getDatasetIndex() const;
+
+		// Sets the number of samples filled by every image, the same for every node of the partition
+		void setSamplesPerImage(int samples_per_image);
+
+	private:
+		// MyDelegateOptions to determine the behaviour of the node
+		MyDelegateOptions options_;
+
+		// Copy of the original node with its own inputs, outputs and temporaries
+		TfLiteNode node_{};
+
+		// Name of the kernel tensor, matched against the faulty layers
+		std::string layer_name_;
+
+		// Thread pool shared with MyDelegate and the rest of its kernels
+		std::shared_ptr<ThreadPool> thread_pool_;
+
+		// Error positions of the delegated node, also referenced by options_.fault_plan
+		std::shared_ptr<FaultPlan> fault_plan_;
+
+		// Mapped fault plan file of a replayed campaign
+		FaultPlanFile plan_file_;
+
+		// Captured inputs of the first delegated node, only for options_.activation_node
+		std::unique_ptr<ActivationCache> activation_cache_;
+
+		// Epoch of the runtime options applied to options_
+		// Starts at 0, so changes made before the first Eval are also applied
+		unsigned long long runtime_epoch_ = 0;
+
+		// Scratch buffer of the error positions of a single image before they are stored in the plan
+		std::vector<std::pair<int, int>> error_positions_;
+
+		// Pairs (output row, filter row) whose input row is inside the image
+		std::vector<std::pair<int, int>> valid_rows_;
+
+		// Pairs (output column, filter column) whose input column is inside the image
+		std::vector<std::pair<int, int>> valid_columns_;
+
+		// Operation Data from convolutional operations
+		custom_ops::conv::OpData* operation_data_conv_;
+
+		// Operation Data from convolutional operations
+		custom_ops::fully_connected::OpData* operation_data_fully_;
+
+		// Convolution Parameters
+		TfLiteConvParams* conv_params_;
+
+		// Fully Connected Parameters
+		TfLiteFullyConnectedParams* fully_params_;
+
+		// Steals the Convolution Operation Data from the to-be-replaced node
+		void GetConvOperationData(const custom_ops::conv::OpData&);
+
+		// Steals the Fully Connected Operation Data from the to-be-replaced node
+		void GetFullyOperationData(const custom_ops::fully_connected::OpData&);
+
+		// Steals the Convolution Parameters from the to-be-replaced node
+		void GetConvParams(const TfLiteConvParams&);
+
+		// Steals the Fully Connected Parameters from the to-be-replaced node
+		void GetFullyParams(const TfLiteFullyConnectedParams&);
+
+		// Generates the sorted error positions of a trial of the image image_index
+		// The positions only depend on the seed, the node index, the image index and the trial
+		void GenerateErrorPositions(int image_index, int trial, std::vector<std::pair<int, int>>& error_positions);
+
+		// Builds the error positions of the dataset for the current options
+		// Called from Init and whenever the runtime options change
+		TfLiteStatus BuildFaultPlan(TfLiteContext* context);
+
+		// Builds the accumulator cache of a disturbed node, keyed by the hash of its weights
+		// Kept when the faults change, the clean accumulators do not depend on them
+		TfLiteStatus BuildAccumulatorCache(TfLiteContext* context);
+
+		// Builds the reference activations of the node when incremental_propagation is set
+		// Kept when the faults change, only the nodes that are not disturbed use them
+		void BuildReferenceActivations();
+
+		// Maps the activation cache file when the node is options_.activation_node
+		TfLiteStatus BuildActivationCache(TfLiteContext* context);
+
+		// Writes the input of every image of the batch to the activation cache, or reads it when replaying
+		// The images fill groups of samples_per_image samples, the value shared by the nodes of the partition
+		TfLiteStatus CacheActivations(TfLiteContext* context, int images, int samples_per_image);
+
+		// Copies the runtime options, restarts the dataset index and rebuilds the fault plan
+		TfLiteStatus ApplyRuntimeOptions(TfLiteContext* context);
+
+		// Replaces "{node}" in a fault plan or accumulator cache path by the index of the node
+		std::string getNodePath(const std::string& path) const;
+
+		// Writes the error positions of every image to a fault plan file
+		bool SaveFaultPlan(const std::string& path);
+
+		// Gets the number of elements of a single sample of the output tensor
+		int getOutputSize() const;
+
+		// Gets the range of the output positions of the error positions, output channels in image_weights mode
+		int getFaultOutputSize() const;
+
+		// Gets the number of samples of the output tensor, each one is a different image of the dataset
+		int getBatchSize() const;
+
+		// Gets the number of multiplications of a single output element
+		int getKernelSize() const;
+
+		// Fills valid_rows_ and valid_columns_ for convolutions
+		void BuildValidTaps();
+
+		// Packs the filter of a convolution for the GEMM backend or the weights of a fully connected layer, they are constant so they are packed once
+		void BuildPackedFilter(TfLiteContext* context);
+
+		// Builds the taps of every output pixel of a convolution, kept while the geometry does not change
+		void BuildConvIndirection(TfLiteContext* context);
+
+		// Selects the specialized kernel of a convolution and folds the input offset into the sums of the filter
+		void BuildConvSpecialization(TfLiteContext* context);
+
+		// Gets the number of multiplications performed by the node for a single sample, padded taps excluded
+		long long getNumberValidMacs() const;
+
+		// Converts the index of a valid multiplication into its pair of output and kernel partial positions
+		std::pair<int, int> getMacPosition(long long mac) const;
+
+		// Gets the number of places a fault can be drawn from, multiplications or weights in image_weights mode
+		long long getNumberFaultSites() const;
+
+		// Converts the index of a fault site into its pair of error positions
+		std::pair<int, int> getFaultSite(long long site) const;
+
+		// Gets number of operations to be performed
+		int getNumberOperations(const std::vector<int>& output_dimensions, const std::vector<int>& kernel_dimensions);
+	};
+
+	// MyBuiltinNode
+	// A node after the last faulty node, evaluated by its original TFLite kernel
+	// It is evaluated through a copy of the original node, like MyDelegateNode
+	class MyBuiltinNode
+	{
+	public:
+		// MyBuiltinNode constructor
+		MyBuiltinNode() = default;
+
+		// MyBuiltinNode destructor
+		~MyBuiltinNode();
+
+		MyBuiltinNode(const MyBuiltinNode&) = delete;
+		MyBuiltinNode& operator=(const MyBuiltinNode&) = delete;
+
+		// Copies the original node and its registration
+		// The operation data created by the interpreter is shared with the original node
+		TfLiteStatus Init(TfLiteContext* context, int node_index);
+
+		// Calls the prepare function of the original kernel
+		TfLiteStatus Prepare(TfLiteContext* context);
+
+		// Calls the invoke function of the original kernel
+		TfLiteStatus Eval(TfLiteContext* context);
+
+		// Input tensors of the original node
+		const TfLiteIntArray* getInputs() const;
+
+		// Output tensors of the original node
+		const TfLiteIntArray* getOutputs() const;
+
+		// Temporary tensors requested by the kernel in Prepare
+		const TfLiteIntArray* getTemporaries() const;
+
+	private:
+		// Copy of the original node with its own inputs, outputs and temporaries
+		TfLiteNode node_{};
+
+		// Copy of the registration of the original kernel
+		TfLiteRegistration registration_{};
+	};
+
 	// MyDelegateKernel
 	// Each instance represents a single part of the graph (subgraph).
+	// The nodes of the subgraph are evaluated in order, each one with its own state
 	class MyDelegateKernel : public SimpleDelegateKernelInterface
 	{
 	public:
 		// MyDelegateKernel constructor
 		MyDelegateKernel();
 
-		// MyDelegateKernel constructor
-		MyDelegateKernel(const MyDelegateOptions& options);
+		/// <summary>
+		/// MyDelegateKernel constructor<para/>
+		///	&#009; - Called from MyDelegate::CreateDelegateKernelInterface
+		/// </summary>
+		/// <param name="options">: Options of the delegate</param>
+		/// <param name="thread_pool">: Thread pool owned by MyDelegate</param>
+		MyDelegateKernel(const MyDelegateOptions& options, const std::shared_ptr<ThreadPool>& thread_pool);
 
 		// MyDelegateKernel destructor
 		~MyDelegateKernel();
@@ -45,52 +284,59 @@ namespace tflite {
 		// the implementation of this method needs to take that into account.
 		TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) override;
 	private:
-		// Holds the indices of the input/output tensors.
-		// inputs_[i] is a vector of all indexes of the input tensors for the context for node i.
-		// outputs_[i] is a vector of all indexes of the output tensors for the context for node i.
-		// inputs_, outputs_ must have a size of number-of-nodes-to-replace
-		//std::vector<std::vector<int>> inputs_, outputs_;
-
-		// Must be converted to vector if there will be multiple nodes that match the pattern
-		// MyDelegateOptions to determine the behaviour of the delegate
+		// MyDelegateOptions given to every node
 		MyDelegateOptions options_;
 
-		// Must be converted to vector if there will be multiple nodes that match the pattern
-		// Operation Data from convolutional operations
-		custom_ops::conv::OpData* operation_data_conv_;
+		// Thread pool shared with MyDelegate and the rest of its kernels
+		std::shared_ptr<ThreadPool> thread_pool_;
 
-		// Must be converted to vector if there will be multiple nodes that match the pattern
-		// Operation Data from convolutional operations
-		custom_ops::fully_connected::OpData* operation_data_fully_;
+		// Nodes of the subgraph in execution order
+		std::vector<std::unique_ptr<MyDelegateNode>> nodes_;
 
-		// Must be converted to vector if there will be multiple nodes that match the pattern
-		// Convolution Parameters
-		TfLiteConvParams* conv_params_;
+		// Nodes after the last faulty node in execution order, skipped when its output matches the golden capture
+		std::vector<std::unique_ptr<MyBuiltinNode>> downstream_;
 
-		// Must be converted to vector if there will be multiple nodes that match the pattern
-		// Fully Connected Parameters
-		TfLiteFullyConnectedParams* fully_params_;
+		// Position of options_.golden_node in nodes_
+		int golden_position_ = -1;
+
+		// Tensors read by downstream_ and computed before it, compared against the golden capture
+		std::vector<int> golden_inputs_;
+
+		// Outputs of the subgraph computed by downstream_, copied from the golden capture
+		std::vector<int> golden_outputs_;
+
+		// Bytes of a single sample of golden_inputs_ followed by golden_outputs_
+		std::vector<size_t> golden_sample_bytes_;
+
+		// Batch of the golden tensors when the cache was built
+		int golden_batch_ = 0;
+
+		// Scratch buffer of a single golden sample before it is stored
+		std::vector<unsigned char> golden_sample_;
+
+		// Clean golden_inputs_ and golden_outputs_ of every image of the dataset
+		std::unique_ptr<ActivationCache> golden_cache_;
+
+		// Epoch of the runtime options checked against the claimed downstream layers
+		unsigned long long runtime_epoch_ = 0;
 
 		// Prepared flag
 		bool prepared_ = false;
-		
-		// Steals the Convolution Operation Data from the to-be-replaced node
-		void GetConvOperationData(const custom_ops::conv::OpData&);
 
-		// Steals the Fully Connected Operation Data from the to-be-replaced node
-		void GetFullyOperationData(const custom_ops::fully_connected::OpData&);
+		// Set when the interpreter prepares the subgraph again, the next Eval restarts the dataset
+		bool new_call_ = false;
 
-		// Steals the Convolution Parameters from the to-be-replaced node
-		void GetConvParams(const TfLiteConvParams&);
+		// Maps the golden cache file for the sizes of the samples of a batch
+		TfLiteStatus BuildGoldenCache(TfLiteContext* context, int batch);
 
-		// Steals the Fully Connected Parameters from the to-be-replaced node
-		void GetFullyParams(const TfLiteFullyConnectedParams&);
+		// True when every sample of the batch matches the golden capture of its image
+		bool MatchesGolden(TfLiteContext* context, int dataset_index, int samples_per_image) const;
 
-		// Gets the indexes that belong to the initial and final channel chunk
-		void getChunkIndexes(int start, int end, const std::vector<std::pair<std::vector<int>, std::vector<int>>>& error_vec_positions, std::vector<int>& indexes);
+		// Writes the golden inputs and outputs of the first sample of every image of the batch
+		void StoreGolden(TfLiteContext* context, int dataset_index, int samples_per_image);
 
-		// Gets number of operations to be performed
-		int getNumberOperations(const std::vector<int>& output_dimensions, const std::vector<int>& kernel_dimensions);
+		// Copies the golden outputs of its image to every sample of the batch
+		void CopyGolden(TfLiteContext* context, int dataset_index, int samples_per_image) const;
 	};
 
 	// MyDelegate
@@ -132,9 +378,72 @@ namespace tflite {
 		// relevant for graph partitioning.
 		SimpleDelegateInterface::Options DelegateOptions() const override;
 
+		// Options that can be changed while the interpreter is alive
+		// Call RuntimeOptions::Invalidate after writing them
+		RuntimeOptions& getRuntimeOptions();
+
+		// Whether the delegate claims the matching layers, so their faults can be enabled at runtime
+		// In operation mode none only when layer_name names them, the clean baseline keeps the TFLite kernels
+		bool claimsLayers() const;
+
+		// Writes back the original value of every weight flipped in weights mode
+		// The weights belong to the interpreter, so it must be called while the interpreter is alive
+		void RestoreWeights();
+
+		// Restores the weights and flips a new set in every disturbed kernel tensor, with the bit position,
+		// the number of flips and the seed of the runtime options
+		// Consecutive weight fault trials reuse the interpreter instead of loading and partitioning the model again
+		// Returns an error if the bit position is not a bit of the int8 weights
+		TfLiteStatus FlipWeights();
+
 	private:
+		// WeightTensor
+		// Kernel tensor disturbed in weights mode, its data is owned by the interpreter
+		struct WeightTensor
+		{
+			// Index of the tensor in the model, identifies its stream of the generator
+			int tensor_index = -1;
+
+			// First weight of the tensor
+			signed char* data = nullptr;
+
+			// Number of weights of the tensor
+			int size = 0;
+		};
+
+		// Flips bit_position of number_flips different weights of a kernel tensor, their original values are saved first
+		void FlipTensorWeights(const WeightTensor& weight_tensor, int bit_position, int number_flips, unsigned long long seed) const;
+
+		// Creates the runtime options shared with the kernels from options_
+		void CreateRuntimeOptions();
+
+		// Checks the type and the layer name of a node, without side effects
+		bool MatchesLayer(const TfLiteRegistration* registration, const TfLiteNode* node, TfLiteContext* context) const;
+
+		// Finds the node whose input is cached and, when replaying, the layers before it that can be skipped
+		// A layer is skipped when everything it computes only feeds skipped layers or the cached input
+		// Fills activation_node and prefix_nodes of options_
+		TfLiteStatus FindActivationPrefix(TfLiteContext* context);
+
+		// Finds the last node disturbed by faulty_layer and the layers after it, which are claimed
+		// Fills golden_node and suffix_nodes of options_
+		TfLiteStatus FindGoldenSuffix(TfLiteContext* context);
+
 		// MyDelegateOptions to determine the behaviour of MyDelegate and MyDelegateKernel
 		MyDelegateOptions options_;
+
+		// Long-lived thread pool shared by all the kernels, created in Initialize
+		// Avoids creating and joining threads on every Eval
+		std::shared_ptr<ThreadPool> thread_pool_;
+
+		// Nodes of options_.prefix_nodes and options_.suffix_nodes, claimed without checking their type
+		std::unordered_set<const TfLiteNode*> claimed_node_set_;
+
+		// Kernel tensors disturbed in weights mode, found while the graph is partitioned
+		mutable std::vector<WeightTensor> weight_tensors_;
+
+		// Address and original value of every flipped weight, in the order they were flipped
+		mutable std::vector<std::pair<signed char*, signed char>> weight_snapshot_;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "DotProduct.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define DOT_PRODUCT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define DOT_PRODUCT_X86 0
+#endif
+
+// MSVC emits any instruction set through the intrinsics, GCC and Clang need the target of every function
+#if DOT_PRODUCT_X86 && !defined(_MSC_VER)
+#define DOT_PRODUCT_TARGET(features) __attribute__((target(features)))
+#else
+#define DOT_PRODUCT_TARGET(features)
+#endif
+
+namespace tflite {
+	namespace custom_ops {
+		namespace dot_product {
+
+			int32_t Scalar(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset)
+			{
+				int32_t acc = 0;
+				for (int i = 0; i < depth; ++i)
+				{
+					acc += filter[i] * (input[i] + input_offset);
+				}
+				return acc;
+			}
+
+#if DOT_PRODUCT_X86
+			DOT_PRODUCT_TARGET("avx2")
+			int32_t Avx2(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset)
+			{
+				// The offset input must fit in 16 bits, it always does for an int8 zero point
+				if (input_offset < -32640 || input_offset > 32640)
+					return Scalar(input, filter, depth, input_offset);
+
+				// The pairs of products of vpmaddwd are at most 2 * 255 * 128, they never saturate
+				const __m256i offset = _mm256_set1_epi16(static_cast<int16_t>(input_offset));
+				__m256i acc = _mm256_setzero_si256();
+				int i = 0;
+				for (; i + 16 <= depth; i += 16)
+				{
+					const __m256i input_values = _mm256_add_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i))), offset);
+					const __m256i filter_values = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(filter + i)));
+					acc = _mm256_add_epi32(acc, _mm256_madd_epi16(input_values, filter_values));
+				}
+
+				__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+				sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+				sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+				int32_t result = _mm_cvtsi128_si32(sum);
+				for (; i < depth; ++i)
+				{
+					result += filter[i] * (input[i] + input_offset);
+				}
+				return result;
+			}
+
+			DOT_PRODUCT_TARGET("avx512f,avx512bw,avx512vnni")
+			int32_t Avx512Vnni(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset)
+			{
+				// vpdpbusd multiplies unsigned by signed bytes, the input is moved to unsigned with input ^ 0x80 = input + 128
+				// sum(filter * (input + offset)) = sum(filter * (input + 128)) + (offset - 128) * sum(filter)
+				const __m512i sign_flip = _mm512_set1_epi8(static_cast<char>(0x80));
+				const __m512i ones = _mm512_set1_epi8(1);
+				__m512i acc = _mm512_setzero_si512();
+				__m512i filter_sum = _mm512_setzero_si512();
+				int i = 0;
+				for (; i + 64 <= depth; i += 64)
+				{
+					const __m512i input_values = _mm512_xor_si512(_mm512_loadu_si512(input + i), sign_flip);
+					const __m512i filter_values = _mm512_loadu_si512(filter + i);
+					acc = _mm512_dpbusd_epi32(acc, input_values, filter_values);
+					filter_sum = _mm512_dpbusd_epi32(filter_sum, ones, filter_values);
+				}
+				if (i < depth)
+				{
+					// The masked filter values are 0, so the masked input values do not add anything
+					const __mmask64 mask = ~0ull >> (64 - (depth - i));
+					const __m512i input_values = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, input + i), sign_flip);
+					const __m512i filter_values = _mm512_maskz_loadu_epi8(mask, filter + i);
+					acc = _mm512_dpbusd_epi32(acc, input_values, filter_values);
+					filter_sum = _mm512_dpbusd_epi32(filter_sum, ones, filter_values);
+				}
+
+				// Unsigned arithmetic wraps like the int32 accumulator
+				const uint32_t shifted = static_cast<uint32_t>(_mm512_reduce_add_epi32(acc));
+				const uint32_t correction = static_cast<uint32_t>(input_offset - 128) * static_cast<uint32_t>(_mm512_reduce_add_epi32(filter_sum));
+				return static_cast<int32_t>(shifted + correction);
+			}
+#else
+			int32_t Avx2(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset)
+			{
+				return Scalar(input, filter, depth, input_offset);
+			}
+
+			int32_t Avx512Vnni(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset)
+			{
+				return Scalar(input, filter, depth, input_offset);
+			}
+#endif
+
+			namespace {
+
+#if DOT_PRODUCT_X86
+				// Registers eax, ebx, ecx and edx of a CPUID leaf
+				void CpuId(int leaf, int subleaf, unsigned int registers[4])
+				{
+#ifdef _MSC_VER
+					int values[4];
+					__cpuidex(values, leaf, subleaf);
+					for (int k = 0; k < 4; k++)
+						registers[k] = static_cast<unsigned int>(values[k]);
+#else
+					__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+				}
+
+				// Register states the operating system saves on a context switch
+				unsigned long long GetEnabledStates()
+				{
+#ifdef _MSC_VER
+					return _xgetbv(0);
+#else
+					unsigned int eax, edx;
+					__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+					return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+				}
+#endif
+
+				// Best implementation for the CPU the library is loaded on
+				DotProductFunction Select()
+				{
+#if DOT_PRODUCT_X86
+					unsigned int registers[4];
+					CpuId(0, 0, registers);
+					const unsigned int max_leaf = registers[0];
+					CpuId(1, 0, registers);
+					const bool has_osxsave = (registers[2] & (1u << 27)) != 0;
+					if (max_leaf >= 7 && has_osxsave)
+					{
+						const unsigned long long states = GetEnabledStates();
+						// XMM and YMM, plus opmask and both halves of ZMM for AVX-512
+						const bool avx_states = (states & 0x6) == 0x6;
+						const bool avx512_states = (states & 0xE6) == 0xE6;
+						CpuId(7, 0, registers);
+						const bool has_avx2 = (registers[1] & (1u << 5)) != 0;
+						const bool has_avx512f = (registers[1] & (1u << 16)) != 0;
+						const bool has_avx512bw = (registers[1] & (1u << 30)) != 0;
+						const bool has_avx512vnni = (registers[2] & (1u << 11)) != 0;
+						if (avx512_states && has_avx512f && has_avx512bw && has_avx512vnni)
+							return Avx512Vnni;
+						if (avx_states && has_avx2)
+							return Avx2;
+					}
+#endif
+					return Scalar;
+				}
+
+			}
+
+			const DotProductFunction selected = Select();
+
+			const char* getSelectedName()
+			{
+				if (selected == Avx512Vnni)
+					return "avx512 vnni";
+				if (selected == Avx2)
+					return "avx2";
+				return "scalar";
+			}
+
+		}
+	}
+}
\ No newline at end of file
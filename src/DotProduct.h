@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+namespace tflite {
+	namespace custom_ops {
+
+		// Signature of the implementations of the int8 dot product
+		using DotProductFunction = int32_t(*)(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset);
+
+		// Implementations of the int8 dot product, every one gives the same result
+		// The vectorized ones must only be called when the CPU supports their instructions
+		namespace dot_product {
+
+			// Plain loop, used when the CPU has no supported vector extension
+			int32_t Scalar(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset);
+
+			// AVX2, 16 products per vpmaddwd on the values widened to 16 bits
+			int32_t Avx2(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset);
+
+			// AVX-512 VNNI, 64 products per vpdpbusd on the input moved to unsigned
+			int32_t Avx512Vnni(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset);
+
+			// Implementation selected for the CPU when the library is loaded
+			extern const DotProductFunction selected;
+
+			// Name of the selected implementation, for the logs
+			const char* getSelectedName();
+		}
+
+		// Shorter rows are summed inline, the call to the selected implementation is not worth it
+		constexpr int kMinVectorDepth = 16;
+
+		// Sum of filter[i] * (input[i] + input_offset) for i in [0, depth), wrapping like an int32 accumulator
+		// The input and the filter are contiguous along the channels in NHWC and OHWI, so every valid tap
+		// of a convolution is a single call
+		inline int32_t DotProductInt8(const int8_t* input, const int8_t* filter, int depth, int32_t input_offset)
+		{
+			if (depth < kMinVectorDepth)
+			{
+				int32_t acc = 0;
+				for (int i = 0; i < depth; ++i)
+				{
+					acc += filter[i] * (input[i] + input_offset);
+				}
+				return acc;
+			}
+			return dot_product::selected(input, filter, depth, input_offset);
+		}
+
+	}
+}
\ No newline at end of file
@@ -1,8 +1,25 @@
 #include <iostream>
 #include "DelegateCore.h"
 
+namespace {
+
+    // Gets MyDelegate from a TfLiteDelegate created by tflite_plugin_create_delegate
+    // The simple delegate factory stores the SimpleDelegateInterface in data_
+    tflite::MyDelegate* GetMyDelegate(TfLiteDelegate* delegate)
+    {
+        if (delegate == nullptr || delegate->data_ == nullptr)
+            return nullptr;
+        return dynamic_cast<tflite::MyDelegate*>(static_cast<tflite::SimpleDelegateInterface*>(delegate->data_));
+    }
+
+}
+
 // Defines two symbols that need to be exported to use the TFLite external
 // delegate. See tensorflow/lite/delegates/external for details.
+// The rest of the symbols change the fault options of a live delegate, so the same
+// interpreter can be reused for every point of a sweep
+// Changes are applied on the next invoke, which restarts the dataset index and
+// rebuilds the fault plan but keeps the interpreter and its tensors
 #ifdef __cplusplus
 extern "C" {
 #endif  // __cplusplus
@@ -34,6 +51,111 @@ extern "C" {
         tflite::TfLiteDelegateFactory::DeleteSimpleDelegate(delegate);
     }
 
+    // Changes the bit position flipped by the faults
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_set_bit_position(TfLiteDelegate* delegate, int bit_position)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr || bit_position < 0 || bit_position > 31)
+            return kTfLiteError;
+        my_delegate->getRuntimeOptions().bit_position = bit_position;
+        my_delegate->getRuntimeOptions().Invalidate();
+        return kTfLiteOk;
+    }
+
+    // Changes the number of flips per image
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_set_number_flips(TfLiteDelegate* delegate, int number_flips)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr || number_flips < 0)
+            return kTfLiteError;
+        my_delegate->getRuntimeOptions().number_flips = number_flips;
+        my_delegate->getRuntimeOptions().Invalidate();
+        return kTfLiteOk;
+    }
+
+    // Changes the bit error rate, 0 goes back to a fixed number of flips per image
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_set_bit_error_rate(TfLiteDelegate* delegate, double bit_error_rate)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr || bit_error_rate < 0.0 || bit_error_rate > 1.0)
+            return kTfLiteError;
+        my_delegate->getRuntimeOptions().bit_error_rate = bit_error_rate;
+        my_delegate->getRuntimeOptions().Invalidate();
+        return kTfLiteOk;
+    }
+
+    // Changes the seed of the error positions
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_set_seed(TfLiteDelegate* delegate, unsigned long long seed)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr)
+            return kTfLiteError;
+        my_delegate->getRuntimeOptions().seed = seed;
+        my_delegate->getRuntimeOptions().Invalidate();
+        return kTfLiteOk;
+    }
+
+    // Enables (convolution or image_weights) or disables (none) the faults of the delegated nodes
+    // A delegate created with none only claims the layers named by layer_name, without them there is nothing to disturb
+    // Weights mode disturbs the weights while the graph is partitioned, so it needs a new delegate
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_set_operation_mode(TfLiteDelegate* delegate, int operation_mode)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr)
+            return kTfLiteError;
+        const tflite::OperationMode mode = static_cast<tflite::OperationMode>(operation_mode);
+        if (mode != tflite::OperationMode::none && mode != tflite::OperationMode::convolution && mode != tflite::OperationMode::image_weights)
+            return kTfLiteError;
+        if (mode != tflite::OperationMode::none && !my_delegate->claimsLayers())
+            return kTfLiteError;
+        my_delegate->getRuntimeOptions().operation_mode = mode;
+        my_delegate->getRuntimeOptions().Invalidate();
+        return kTfLiteOk;
+    }
+
+    // Selects the claimed layers that are disturbed, comma separated name patterns or empty for all of them
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_set_faulty_layer(TfLiteDelegate* delegate, const char* faulty_layer)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr || faulty_layer == nullptr)
+            return kTfLiteError;
+        my_delegate->getRuntimeOptions().faulty_layer = faulty_layer;
+        my_delegate->getRuntimeOptions().Invalidate();
+        return kTfLiteOk;
+    }
+
+    // Writes back the original weights flipped in weights mode
+    // The interpreter owns the weights, so it must still be alive
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_restore_weights(TfLiteDelegate* delegate)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr)
+            return kTfLiteError;
+        my_delegate->RestoreWeights();
+        return kTfLiteOk;
+    }
+
+    // Restores the weights and flips a new set with the current bit position, number of flips and seed
+    // Weights mode reuses the interpreter for every trial instead of loading and partitioning the model again
+    // The flips are read by the builtin kernels on the next invoke, weights packed by another delegate do not see them
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_flip_weights(TfLiteDelegate* delegate)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr)
+            return kTfLiteError;
+        return my_delegate->FlipWeights();
+    }
+
+    // Restarts the dataset index without changing the options
+    TFL_CAPI_EXPORT TfLiteStatus tflite_plugin_reset_dataset_index(TfLiteDelegate* delegate)
+    {
+        tflite::MyDelegate* my_delegate = GetMyDelegate(delegate);
+        if (my_delegate == nullptr)
+            return kTfLiteError;
+        my_delegate->getRuntimeOptions().Invalidate();
+        return kTfLiteOk;
+    }
+
 #ifdef __cplusplus
 }
 #endif  // __cplusplus
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "FaultPlan.h"
+#include <algorithm>
+
+namespace tflite {
+
+	FaultPlan::FaultPlan(int max_images, long long max_faults)
+		: max_images_(max_images),
+		max_faults_(max_faults)
+	{
+		// Offsets go first so every array is aligned
+		const size_t offsets_bytes = sizeof(long long) * (static_cast<size_t>(max_images) + 1);
+		const size_t positions_bytes = sizeof(int32_t) * static_cast<size_t>(max_faults);
+		arena_.reset(new unsigned char[offsets_bytes + 2 * positions_bytes]);
+
+		offsets_ = reinterpret_cast<long long*>(arena_.get());
+		output_positions_ = reinterpret_cast<int32_t*>(arena_.get() + offsets_bytes);
+		kernel_positions_ = reinterpret_cast<int32_t*>(arena_.get() + offsets_bytes + positions_bytes);
+		offsets_[0] = 0;
+	}
+
+	int FaultPlan::getNumImages() const
+	{
+		return num_images_;
+	}
+
+	long long FaultPlan::getNumFaults() const
+	{
+		return offsets_[num_images_];
+	}
+
+	FaultSpan FaultPlan::getImage(int image) const
+	{
+		FaultSpan span;
+		if (image < 0 || image >= num_images_)
+			return span;
+		const long long start = offsets_[image];
+		span.output_positions = output_positions_ + start;
+		span.kernel_positions = kernel_positions_ + start;
+		span.size = static_cast<int>(offsets_[image + 1] - start);
+		return span;
+	}
+
+	bool FaultPlan::AppendImage(const std::vector<std::pair<int, int>>& positions)
+	{
+		if (num_images_ >= max_images_ || offsets_[num_images_] + static_cast<long long>(positions.size()) > max_faults_)
+			return false;
+
+		long long position = offsets_[num_images_];
+		for (const auto& pair : positions)
+		{
+			output_positions_[position] = pair.first;
+			kernel_positions_[position] = pair.second;
+			position++;
+		}
+		offsets_[++num_images_] = position;
+		return true;
+	}
+
+	bool FaultPlan::AppendImage(const int32_t* output_positions, const int32_t* kernel_positions, int size)
+	{
+		if (num_images_ >= max_images_ || offsets_[num_images_] + size > max_faults_)
+			return false;
+
+		const long long start = offsets_[num_images_];
+		std::copy(output_positions, output_positions + size, output_positions_ + start);
+		std::copy(kernel_positions, kernel_positions + size, kernel_positions_ + start);
+		offsets_[++num_images_] = start + size;
+		return true;
+	}
+
+	bool FaultPlan::AppendUniformImages(int num_images, int faults_per_image)
+	{
+		if (num_images_ + num_images > max_images_ || offsets_[num_images_] + static_cast<long long>(num_images) * faults_per_image > max_faults_)
+			return false;
+
+		for (int i = 0; i < num_images; ++i)
+		{
+			offsets_[num_images_ + 1] = offsets_[num_images_] + faults_per_image;
+			num_images_++;
+		}
+		return true;
+	}
+
+	void FaultPlan::SetImage(int image, const std::vector<std::pair<int, int>>& positions)
+	{
+		long long position = offsets_[image];
+		for (const auto& pair : positions)
+		{
+			output_positions_[position] = pair.first;
+			kernel_positions_[position] = pair.second;
+			position++;
+		}
+	}
+
+	void FaultPlan::Clear()
+	{
+		num_images_ = 0;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace tflite {
+
+	// FaultSpan
+	// View of the error positions of a single image, sorted in decreasing order
+	// Position i is the pair (output_positions[i], kernel_positions[i])
+	struct FaultSpan
+	{
+		// Flat positions in the output tensor
+		const int32_t* output_positions = nullptr;
+
+		// Flat positions inside the kernel of an output channel
+		const int32_t* kernel_positions = nullptr;
+
+		// Number of error positions
+		int size = 0;
+	};
+
+	// FaultList
+	// Growable error positions with the same layout as FaultPlan
+	// Used for the positions generated on the fly by the kernels
+	struct FaultList
+	{
+		// Flat positions in the output tensor
+		std::vector<int32_t> output_positions;
+
+		// Flat positions inside the kernel of an output channel
+		std::vector<int32_t> kernel_positions;
+
+		void Clear()
+		{
+			output_positions.clear();
+			kernel_positions.clear();
+		}
+
+		void Add(int32_t output_position, int32_t kernel_position)
+		{
+			output_positions.push_back(output_position);
+			kernel_positions.push_back(kernel_position);
+		}
+
+		// Adds all the positions of another list at the end
+		void Append(const FaultList& list)
+		{
+			output_positions.insert(output_positions.end(), list.output_positions.begin(), list.output_positions.end());
+			kernel_positions.insert(kernel_positions.end(), list.kernel_positions.begin(), list.kernel_positions.end());
+		}
+
+		// Turns increasing order into decreasing order
+		void Reverse()
+		{
+			std::reverse(output_positions.begin(), output_positions.end());
+			std::reverse(kernel_positions.begin(), kernel_positions.end());
+		}
+
+		FaultSpan getSpan() const
+		{
+			FaultSpan span;
+			span.output_positions = output_positions.data();
+			span.kernel_positions = kernel_positions.data();
+			span.size = static_cast<int>(output_positions.size());
+			return span;
+		}
+	};
+
+	// FaultCursor
+	// Error positions of an image visited by a kernel in increasing order of output position
+	// The cursor keeps the next faulty output, kNoOutput when no fault is left, so the kernels compute every output
+	// with the clean loop and only compare its position with the cursor before patching its faulty products
+	// The positions of the span are read from the back
+	class FaultCursor
+	{
+	public:
+		// Next output of a cursor without faults left, after every output position
+		static constexpr int32_t kNoOutput = INT32_MAX;
+
+		// Cursor over the positions [first, last) of the span
+		FaultCursor(const FaultSpan& span, int first, int last)
+			: span_(span), first_(first), counter_(last - 1)
+		{
+			Load();
+		}
+
+		// Whether any fault is left
+		bool hasFaults() const
+		{
+			return next_output_ != kNoOutput;
+		}
+
+		// Output position of the next fault
+		int32_t getNextOutput() const
+		{
+			return next_output_;
+		}
+
+		// Kernel position of the next fault, the cursor moves to the following one
+		int32_t Pop()
+		{
+			const int32_t kernel_position = span_.kernel_positions[counter_];
+			counter_--;
+			Load();
+			return kernel_position;
+		}
+
+	private:
+		void Load()
+		{
+			next_output_ = counter_ >= first_ ? span_.output_positions[counter_] : kNoOutput;
+		}
+
+		// Positions of the image
+		FaultSpan span_;
+
+		// First position of the cursor
+		int first_;
+
+		// Position of the next fault, the cursor moves towards first_
+		int counter_;
+
+		// Output position of the next fault
+		int32_t next_output_ = kNoOutput;
+	};
+
+	// FaultPlan
+	// Error positions of a whole dataset stored as a structure of arrays
+	// Every image is a row in CSR format: its positions are [offsets[image], offsets[image + 1])
+	// Offsets and positions live in a single allocation, so the plan costs 8 bytes per fault
+	// The plan is built once and shared by pointer between MyDelegate and its kernels
+	class FaultPlan
+	{
+	public:
+		/// <summary>
+		/// Constructor<para/>
+		///	&#009; - Allocates the arena, images are added with AppendImage
+		/// </summary>
+		/// <param name="max_images">: Maximum number of images of the plan</param>
+		/// <param name="max_faults">: Maximum total number of error positions of the plan</param>
+		FaultPlan(int max_images, long long max_faults);
+
+		FaultPlan(const FaultPlan&) = delete;
+		FaultPlan& operator=(const FaultPlan&) = delete;
+
+		// Number of images added to the plan
+		int getNumImages() const;
+
+		// Total number of error positions of the plan
+		long long getNumFaults() const;
+
+		// Error positions of an image, empty if the image is not in the plan
+		FaultSpan getImage(int image) const;
+
+		// Adds the next image, positions must be sorted in decreasing order
+		// Returns false if the plan is full
+		bool AppendImage(const std::vector<std::pair<int, int>>& positions);
+
+		// Adds the next image, positions must be sorted in decreasing order
+		// Returns false if the plan is full
+		bool AppendImage(const int32_t* output_positions, const int32_t* kernel_positions, int size);
+
+		// Adds num_images images of faults_per_image positions each, to be written with SetImage in any order
+		// Allows filling the images from several threads
+		// Returns false if the plan is full
+		bool AppendUniformImages(int num_images, int faults_per_image);
+
+		// Writes the positions of an image added with AppendUniformImages, sorted in decreasing order
+		// The number of positions must be the one given to AppendUniformImages
+		void SetImage(int image, const std::vector<std::pair<int, int>>& positions);
+
+		// Removes all the images, keeps the arena
+		void Clear();
+
+	private:
+		// Single allocation holding offsets, output positions and kernel positions
+		std::unique_ptr<unsigned char[]> arena_;
+
+		// Offsets of the images inside the position arrays, max_images + 1 values
+		long long* offsets_ = nullptr;
+
+		// Output positions of every image
+		int32_t* output_positions_ = nullptr;
+
+		// Kernel positions of every image
+		int32_t* kernel_positions_ = nullptr;
+
+		// Capacity of the plan
+		int max_images_ = 0;
+		long long max_faults_ = 0;
+
+		// Number of images added
+		int num_images_ = 0;
+	};
+
+}
\ No newline at end of file
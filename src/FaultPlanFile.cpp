@@ -0,0 +1,187 @@
+#include "FaultPlanFile.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace tflite {
+
+	static_assert(sizeof(FaultPlanFileHeader) == 48, "The header of the fault plan file must not have padding");
+
+	namespace {
+
+		// Appends an unsigned value with 7 bits per byte, the high bit marks that more bytes follow
+		void WriteVarint(uint64_t value, std::vector<unsigned char>& buffer)
+		{
+			while (value >= 0x80)
+			{
+				buffer.push_back(static_cast<unsigned char>(value | 0x80));
+				value >>= 7;
+			}
+			buffer.push_back(static_cast<unsigned char>(value));
+		}
+
+		// Reads a value written with WriteVarint, returns false if it goes past end or does not fit in 32 bits
+		bool ReadVarint(const unsigned char*& data, const unsigned char* end, uint32_t& value)
+		{
+			uint64_t result = 0;
+			for (int shift = 0; shift < 35; shift += 7)
+			{
+				if (data == end)
+					return false;
+				const unsigned char byte = *data++;
+				result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+				{
+					if (result > 0x7FFFFFFFu)
+						return false;
+					value = static_cast<uint32_t>(result);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		uint64_t ReadOffset(const unsigned char* offsets, int index)
+		{
+			uint64_t offset;
+			std::memcpy(&offset, offsets + index * sizeof(uint64_t), sizeof(uint64_t));
+			return offset;
+		}
+
+	}
+
+	bool FaultPlanFile::Write(const std::string& path, const FaultPlanFileHeader& header,
+		const std::function<void(int, std::vector<std::pair<int, int>>&)>& get_image)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		FaultPlanFileHeader file_header = header;
+		file_header.magic = kMagic;
+		file_header.version = kVersion;
+		file.write(reinterpret_cast<const char*>(&file_header), sizeof(file_header));
+
+		// Offsets are written once all the images are encoded
+		std::vector<uint64_t> offsets(static_cast<size_t>(file_header.num_images) + 1);
+		file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+		uint64_t offset = sizeof(file_header) + offsets.size() * sizeof(uint64_t);
+		std::vector<std::pair<int, int>> positions;
+		std::vector<unsigned char> buffer;
+		for (int image = 0; image < file_header.num_images; image++)
+		{
+			positions.clear();
+			get_image(image, positions);
+
+			buffer.clear();
+			WriteVarint(positions.size(), buffer);
+			for (size_t i = 0; i < positions.size(); i++)
+			{
+				if (i == 0)
+				{
+					WriteVarint(static_cast<uint32_t>(positions[i].first), buffer);
+					WriteVarint(static_cast<uint32_t>(positions[i].second), buffer);
+					continue;
+				}
+				const std::pair<int, int>& previous = positions[i - 1];
+				if (positions[i].first > previous.first || (positions[i].first == previous.first && positions[i].second > previous.second))
+					return false;
+				WriteVarint(static_cast<uint32_t>(previous.first - positions[i].first), buffer);
+				if (positions[i].first == previous.first)
+				{
+					WriteVarint(static_cast<uint32_t>(previous.second - positions[i].second), buffer);
+				}
+				else
+				{
+					WriteVarint(static_cast<uint32_t>(positions[i].second), buffer);
+				}
+			}
+
+			offsets[image] = offset;
+			file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+			offset += buffer.size();
+		}
+		offsets[file_header.num_images] = offset;
+
+		file.seekp(sizeof(file_header));
+		file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+		return static_cast<bool>(file);
+	}
+
+	bool FaultPlanFile::Open(const std::string& path)
+	{
+		offsets_ = nullptr;
+		if (!file_.Open(path) || file_.getSize() < sizeof(FaultPlanFileHeader))
+			return false;
+
+		std::memcpy(&header_, file_.getData(), sizeof(FaultPlanFileHeader));
+		if (header_.magic != kMagic || header_.version != kVersion || header_.num_images < 0 || header_.number_flips < 0)
+			return false;
+
+		const uint64_t table_end = sizeof(FaultPlanFileHeader) + (static_cast<uint64_t>(header_.num_images) + 1) * sizeof(uint64_t);
+		if (file_.getSize() < table_end)
+			return false;
+		offsets_ = file_.getData() + sizeof(FaultPlanFileHeader);
+		return ReadOffset(offsets_, header_.num_images) <= file_.getSize();
+	}
+
+	const FaultPlanFileHeader& FaultPlanFile::getHeader() const
+	{
+		return header_;
+	}
+
+	bool FaultPlanFile::ReadImage(int image, std::vector<std::pair<int, int>>& positions) const
+	{
+		positions.clear();
+		if (offsets_ == nullptr || image < 0 || image >= header_.num_images)
+			return true;
+
+		const uint64_t begin = ReadOffset(offsets_, image);
+		const uint64_t end = ReadOffset(offsets_, image + 1);
+		if (begin > end || end > file_.getSize())
+			return false;
+		const unsigned char* data = file_.getData() + begin;
+		const unsigned char* data_end = file_.getData() + end;
+
+		uint32_t size;
+		if (!ReadVarint(data, data_end, size) || size > static_cast<uint32_t>(header_.number_flips))
+			return false;
+		positions.reserve(size);
+
+		int output_position = 0;
+		int kernel_position = 0;
+		for (uint32_t i = 0; i < size; i++)
+		{
+			uint32_t output_value, kernel_value;
+			if (!ReadVarint(data, data_end, output_value) || !ReadVarint(data, data_end, kernel_value))
+				return false;
+			if (i == 0)
+			{
+				output_position = static_cast<int>(output_value);
+				kernel_position = static_cast<int>(kernel_value);
+			}
+			else
+			{
+				if (output_value > static_cast<uint32_t>(output_position))
+					return false;
+				output_position -= static_cast<int>(output_value);
+				if (output_value == 0)
+				{
+					if (kernel_value > static_cast<uint32_t>(kernel_position))
+						return false;
+					kernel_position -= static_cast<int>(kernel_value);
+				}
+				else
+				{
+					kernel_position = static_cast<int>(kernel_value);
+				}
+			}
+			if (output_position >= header_.output_size || kernel_position >= header_.kernel_size)
+				return false;
+			positions.emplace_back(output_position, kernel_position);
+		}
+		return true;
+	}
+
+}
\ No newline at end of file
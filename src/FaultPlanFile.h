@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace tflite {
+
+	// FaultPlanFileHeader
+	// First bytes of a fault plan file, all the values are little endian
+	// It is followed by num_images + 1 64 bits offsets of the encoded images from the start of the file
+	struct FaultPlanFileHeader
+	{
+		// Identifies the file as a fault plan
+		uint32_t magic = 0;
+
+		// Version of the encoding
+		uint32_t version = 0;
+
+		// Seed used to generate the positions
+		uint64_t seed = 0;
+
+		// Node of the model the positions belong to
+		int32_t node_index = -1;
+
+		// Builtin code of the node
+		int32_t builtin_code = 0;
+
+		// Bit position flipped by the campaign
+		int32_t bit_position = -1;
+
+		// Maximum number of positions of a single image
+		int32_t number_flips = 0;
+
+		// Number of elements of a single sample of the output tensor, checked against the node when the file is loaded
+		// Number of output channels when the positions are weight faults
+		int32_t output_size = 0;
+
+		// Number of multiplications of a single output element, checked against the node when the file is loaded
+		int32_t kernel_size = 0;
+
+		// Number of images stored in the file
+		int32_t num_images = 0;
+
+		// Number of trials of every image, the fault set of trial t of image i is stored at i * trials + t
+		// Files without trials store 0, which is read as a single trial
+		int32_t trials = 0;
+	};
+
+	// FaultPlanFile
+	// Binary file with the error positions of a whole campaign
+	// The file is memory mapped and every image is decoded in place when it is requested,
+	// so loading a saved campaign does not read nor parse the positions of the images that are not evaluated
+	// Images are encoded as:
+	//	- Number of positions as a varint
+	//	- Positions in decreasing order, the output position as a varint of its distance to the previous one
+	//	  and the kernel position as a varint of its distance to the previous one when the output position repeats,
+	//	  or its value otherwise. The first position stores both values
+	class FaultPlanFile
+	{
+	public:
+		// "DFPL" in little endian
+		constexpr static uint32_t kMagic = 0x4C504644u;
+
+		// Current version of the encoding
+		constexpr static uint32_t kVersion = 1;
+
+		/// <summary>
+		/// Writes a fault plan file<para/>
+		///	&#009; - The images are requested in order, so they can be generated while the file is written
+		/// </summary>
+		/// <param name="path">: Path of the file, overwritten if it exists</param>
+		/// <param name="header">: Header of the file, magic and version are filled by this function</param>
+		/// <param name="get_image">: Fills the positions of an image, sorted in decreasing order</param>
+		/// <returns>False if the file can not be written or the positions are not sorted</returns>
+		static bool Write(const std::string& path, const FaultPlanFileHeader& header,
+			const std::function<void(int, std::vector<std::pair<int, int>>&)>& get_image);
+
+		// Maps a fault plan file, returns false if it can not be opened or it is not a valid plan
+		bool Open(const std::string& path);
+
+		// Header of the mapped file
+		const FaultPlanFileHeader& getHeader() const;
+
+		// Decodes the positions of an image, empty if the image is not in the file
+		// Returns false if the image is corrupted
+		bool ReadImage(int image, std::vector<std::pair<int, int>>& positions) const;
+
+	private:
+		// Mapped contents of the file
+		MappedFile file_;
+
+		// Copy of the header of the file
+		FaultPlanFileHeader header_;
+
+		// Offsets of the encoded images inside the mapped file
+		const unsigned char* offsets_ = nullptr;
+	};
+
+}
\ No newline at end of file
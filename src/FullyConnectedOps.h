@@ -3,7 +3,9 @@
 #include <iostream>
 #include <vector>
 #include <bitset>
-#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
 
 #include "tensorflow/lite/core/c/builtin_op_data.h"
 #include "tensorflow/lite/core/c/c_api_types.h"
@@ -14,6 +16,9 @@
 #include "tensorflow/lite/kernels/kernel_util.h"
 
 #include "Options.h"
+#include "ThreadPool.h"
+#include "Philox.h"
+#include "Gemm.h"
 
 namespace tflite {
 
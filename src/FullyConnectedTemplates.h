@@ -100,9 +100,93 @@ namespace tflite {
                 }
             }
 
+            // Adds to the clean accumulator of an output the change of its product when bit_position of the product is flipped
+            // The product is the int32 result of the multiplication, so the accumulator is the one of the flipped multiplication
+            template <typename BiasType>
+            inline BiasType FlipFaultyProduct(const BiasType acc, const int32_t product, const int bit_position)
+            {
+                const int32_t flipped = static_cast<int32_t>(static_cast<uint32_t>(product) ^ (1u << bit_position));
+                // Wrapping like the accumulator of the flipped multiplication
+                return static_cast<BiasType>(static_cast<int64_t>(acc) + (static_cast<int64_t>(flipped) - product));
+            }
+
+            // Clean accumulators of the output channels [start_channel, end_channel) of rows consecutive samples, without the bias
+            // accs[row * output_depth + out_c], int8 layers multiply the weights packed in MyDelegateNode::Prepare
+            // with the GEMM microkernels, so start_channel must be the first channel of a panel and every channel of the last panel
+            // may be written
+            template <typename InputType, typename WeightType, typename BiasType>
+            void FullyConnectedAccumulators(
+                const int rows, const int start_channel, const int end_channel,
+                const int output_depth, const int accum_depth,
+                const int input_offset, const int filter_offset,
+                const InputType* input_data,
+                const WeightType* filter_data,
+                BiasType* accs,
+                const MyDelegateOptions& options)
+            {
+                if constexpr (std::is_same<InputType, int8_t>::value && std::is_same<WeightType, int8_t>::value && std::is_same<BiasType, int32_t>::value)
+                {
+                    const PackedFilter* packed = options.packed_filter.get();
+                    if (packed && packed->output_depth == output_depth && packed->depth == accum_depth)
+                    {
+                        // The rows of the GEMM are whole groups of inputs, the padded weights are 0
+                        const int8_t* lhs = input_data;
+                        thread_local std::vector<int8_t> padded_input;
+                        if (packed->padded_depth != accum_depth)
+                        {
+                            padded_input.assign(static_cast<size_t>(rows) * packed->padded_depth, 0);
+                            for (int row = 0; row < rows; ++row)
+                            {
+                                std::memcpy(padded_input.data() + static_cast<size_t>(row) * packed->padded_depth, input_data + static_cast<size_t>(row) * accum_depth, accum_depth);
+                            }
+                            lhs = padded_input.data();
+                        }
+                        gemm::MultiplyRange(lhs, rows, *packed,
+                            start_channel / gemm::kPanelChannels, (end_channel + gemm::kPanelChannels - 1) / gemm::kPanelChannels,
+                            input_offset, accs);
+
+                        // sum((w + filter_offset) * (x + input_offset)) = sum(w * (x + input_offset)) + filter_offset * sum(x + input_offset)
+                        // Unsigned arithmetic wraps like the int32 accumulator
+                        if (filter_offset != 0)
+                        {
+                            for (int row = 0; row < rows; ++row)
+                            {
+                                uint32_t input_sum = 0;
+                                for (int d = 0; d < accum_depth; ++d)
+                                {
+                                    input_sum += static_cast<uint32_t>(input_data[row * accum_depth + d] + input_offset);
+                                }
+                                for (int out_c = start_channel; out_c < end_channel; ++out_c)
+                                {
+                                    BiasType& acc = accs[row * output_depth + out_c];
+                                    acc = static_cast<int32_t>(static_cast<uint32_t>(acc) + static_cast<uint32_t>(filter_offset) * input_sum);
+                                }
+                            }
+                        }
+                        return;
+                    }
+                }
+
+                for (int row = 0; row < rows; ++row)
+                {
+                    for (int out_c = start_channel; out_c < end_channel; ++out_c)
+                    {
+                        BiasType acc = 0;
+                        for (int d = 0; d < accum_depth; ++d)
+                        {
+                            int32_t input_val = input_data[row * accum_depth + d];
+                            int32_t filter_val = filter_data[out_c * accum_depth + d];
+                            acc += (filter_val + filter_offset) * (input_val + input_offset);
+                        }
+                        accs[row * output_depth + out_c] = acc;
+                    }
+                }
+            }
+
+            // Clean accumulators of every output, the faulty products of the outputs held by the cursor are patched on top of them
             template <typename InputType, typename WeightType, typename OutputType, typename BiasType>
             void DisturbedFullyConnectedOperation(
-                const int32_t output_multiplier, const int32_t output_shift,
+                const int32_t* output_multiplier, const int32_t* output_shift,
                 const int batches, const int output_depth, const int accum_depth,
                 const int input_offset, const int filter_offset, const int output_offset,
                 const int output_activation_min, const int output_activation_max,
@@ -110,52 +194,199 @@ namespace tflite {
                 const WeightType* filter_data,
                 const BiasType* bias_data,
                 OutputType* output_data,
-                const std::vector<int>& chunk_indexes,
                 const MyDelegateOptions& options)
             {
-                const int& dataset_index = options.dataset_index;
-                int idx_counter = chunk_indexes.size() - 1;
+                // The whole batch in a single product, the weights are read once for every block of samples
+                std::vector<BiasType> accs(static_cast<size_t>(batches) * output_depth);
+                FullyConnectedAccumulators(
+                    batches, 0, output_depth,
+                    output_depth, accum_depth,
+                    input_offset, filter_offset,
+                    input_data, filter_data,
+                    accs.data(),
+                    options);
+
+                // Every sample of the batch is a different image of the dataset with its own error positions
                 for (int b = 0; b < batches; ++b)
                 {
+                    const FaultSpan error_positions = options.getErrorPositions(b);
+                    FaultCursor cursor(error_positions, 0, error_positions.size);
                     for (int out_c = 0; out_c < output_depth; ++out_c)
                     {
-                        BiasType acc = 0;
-                        int outputPosition = b * output_depth + out_c;
-                        for (int d = 0; d < accum_depth; ++d)
-                        {
-                            int& kernelPartialPosition = d;
-                            int32_t input_val = input_data[b * accum_depth + d];
-                            int32_t filter_val = filter_data[out_c * accum_depth + d];
-
-                            int32_t result = (filter_val + filter_offset) * (input_val + input_offset);
+                        BiasType acc = accs[b * output_depth + out_c];
+                        int outputPosition = out_c;
 
-                            if (idx_counter >= 0 && options.error_flat_positions[dataset_index][chunk_indexes[idx_counter]].first == outputPosition && options.error_flat_positions[dataset_index][chunk_indexes[idx_counter]].second == kernelPartialPosition)
-                            {
-                                std::bitset<32> bits(result);
-                                bits.flip(options.bit_position);
-                                result = static_cast<int>(bits.to_ulong());
-                                idx_counter--;
-                            }
-
-                            acc += result;
+                        // Fault epilogue, only the outputs held by the cursor have faulty products
+                        while (cursor.getNextOutput() == outputPosition)
+                        {
+                            const int kernelPartialPosition = cursor.Pop();
+                            int32_t input_val = input_data[b * accum_depth + kernelPartialPosition];
+                            int32_t filter_val = filter_data[out_c * accum_depth + kernelPartialPosition];
+                            acc = FlipFaultyProduct(acc, (filter_val + filter_offset) * (input_val + input_offset), options.bit_position);
                         }
                         if (bias_data)
                         {
                             acc += bias_data[out_c];
                         }
-                        int32_t acc_scaled = MultiplyByQuantizedMultiplier(acc, output_multiplier, output_shift);
+                        int32_t acc_scaled = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_c], output_shift[out_c]);
                         acc_scaled += output_offset;
                         acc_scaled = std::max(acc_scaled, output_activation_min);
                         acc_scaled = std::min(acc_scaled, output_activation_max);
-                        output_data[outputPosition] = static_cast<OutputType>(acc_scaled);
+                        output_data[b * output_depth + out_c] = static_cast<OutputType>(acc_scaled);
+                    }
+                }
+            }
+
+            // Number of output channels per tile
+            constexpr int kChannelBlock = 16;
+            static_assert(kChannelBlock % gemm::kPanelChannels == 0, "Tiles hold whole panels of the packed weights");
+
+            // Gets the faulty multiplications of a tile drawn with the bit error rate, sorted in decreasing order
+            // The gaps between faulty multiplications are geometric, so the cost depends on the number of faults
+            // The tile index is part of the generator key, so the faults do not depend on the number of threads
+            // Tiles are numbered inside the sample and the image is the dataset index of the sample,
+            // so the faults of an image do not depend on the batch it is evaluated in
+            // Every trial of an image is drawn with its own seed
+            inline void GetTileBitErrors(
+                const int image, const int trial, const int tile,
+                const int start_channel, const int end_channel,
+                const int accum_depth,
+                const MyDelegateOptions& options,
+                FaultList& tile_errors)
+            {
+                tile_errors.Clear();
+                const long long tile_macs = static_cast<long long>(end_channel - start_channel) * accum_depth;
+
+                PhiloxRandom generator(options.getTrialSeed(trial), options.node_index, image, tile);
+                const double log_complement = std::log1p(-options.bit_error_rate);
+                for (long long mac = generator.Geometric(log_complement); mac < tile_macs; mac += 1 + generator.Geometric(log_complement))
+                {
+                    const int out_c = start_channel + static_cast<int>(mac / accum_depth);
+                    tile_errors.Add(out_c, static_cast<int>(mac % accum_depth));
+                }
+                tile_errors.Reverse();
+            }
+
+            // Raw operation to pararellize in threads
+            // Computes the tile of output channels [start_channel, end_channel) of a single batch
+            // The tile index is counted inside the sample
+            template <typename InputType, typename WeightType, typename OutputType, typename BiasType>
+            void DisturbedFullyConnectedOperationByTile(
+                const int tile,
+                const int b, const int start_channel, const int end_channel,
+                const int32_t* output_multiplier, const int32_t* output_shift,
+                const int output_depth, const int accum_depth,
+                const int input_offset, const int filter_offset, const int output_offset,
+                const int output_activation_min, const int output_activation_max,
+                const InputType* input_data,
+                const WeightType* filter_data,
+                const BiasType* bias_data,
+                OutputType* output_data,
+                const MyDelegateOptions& options)
+            {
+                // Only the error positions of this tile are visited, from the back because they are sorted in decreasing order
+                FaultList tile_errors;
+                int idx_first, idx_last;
+                if (options.bit_error_rate > 0.0)
+                {
+                    GetTileBitErrors(options.dataset_index + b, 0, tile, start_channel, end_channel, accum_depth, options, tile_errors);
+                    idx_first = 0;
+                    idx_last = tile_errors.getSpan().size;
+                }
+                else
+                {
+                    // Error positions are relative to the sample
+                    options.getErrorRange(start_channel, end_channel, idx_first, idx_last, b);
+                }
+                const FaultSpan error_positions = options.bit_error_rate > 0.0 ? tile_errors.getSpan() : options.getErrorPositions(b);
+                FaultCursor cursor(error_positions, idx_first, idx_last);
+
+                // Clean accumulators of the tile, a GEMV of the panels of the tile
+                thread_local std::vector<BiasType> tile_accs;
+                tile_accs.resize(output_depth);
+                FullyConnectedAccumulators(
+                    1, start_channel, end_channel,
+                    output_depth, accum_depth,
+                    input_offset, filter_offset,
+                    input_data + b * accum_depth, filter_data,
+                    tile_accs.data(),
+                    options);
+
+                for (int out_c = start_channel; out_c < end_channel; ++out_c)
+                {
+                    BiasType acc = tile_accs[out_c];
+                    int outputPosition = out_c;
+
+                    // Fault epilogue, see DisturbedFullyConnectedOperation
+                    while (cursor.getNextOutput() == outputPosition)
+                    {
+                        const int kernelPartialPosition = cursor.Pop();
+                        int32_t input_val = input_data[b * accum_depth + kernelPartialPosition];
+                        int32_t filter_val = filter_data[out_c * accum_depth + kernelPartialPosition];
+                        acc = FlipFaultyProduct(acc, (filter_val + filter_offset) * (input_val + input_offset), options.bit_position);
+                    }
+                    if (bias_data)
+                    {
+                        acc += bias_data[out_c];
                     }
+                    int32_t acc_scaled = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_c], output_shift[out_c]);
+                    acc_scaled += output_offset;
+                    acc_scaled = std::max(acc_scaled, output_activation_min);
+                    acc_scaled = std::min(acc_scaled, output_activation_max);
+                    output_data[b * output_depth + out_c] = static_cast<OutputType>(acc_scaled);
                 }
             }
+            
+            template <typename InputType, typename WeightType, typename OutputType, typename BiasType>
+            void ParallelDisturbedFullyConnected(
+                const int32_t* output_multiplier, const int32_t* output_shift,
+                const int batches, const int output_depth, const int accum_depth,
+                const int input_offset, const int filter_offset, const int output_offset,
+                const int output_activation_min, const int output_activation_max,
+                const InputType* input_data,
+                const WeightType* filter_data,
+                const BiasType* bias_data,
+                OutputType* output_data,
+                const MyDelegateOptions& options)
+            {
+                // Tiles are (batch, channel block)
+                const int channel_blocks = (output_depth + kChannelBlock - 1) / kChannelBlock;
+                const int num_tiles = batches * channel_blocks;
 
+                options.thread_pool->ParallelFor(num_tiles, options.num_threads,
+                    [&](int tile)
+                    {
+                        const int b = tile / channel_blocks;
+                        const int start_channel = (tile % channel_blocks) * kChannelBlock;
+                        const int end_channel = std::min(start_channel + kChannelBlock, output_depth);
+
+                        DisturbedFullyConnectedOperationByTile<InputType, WeightType, OutputType, BiasType>(
+                            tile % channel_blocks,
+                            b, start_channel, end_channel,
+                            output_multiplier, output_shift,
+                            output_depth, accum_depth,
+                            input_offset, filter_offset, output_offset,
+                            output_activation_min, output_activation_max,
+                            input_data,
+                            filter_data,
+                            bias_data,
+                            output_data,
+                            options);
+                    });
+            }
+
+            // Evaluates every trial and bit position of an image in a single pass
+            // The batch is split in groups of samples holding the same image, ordered by trial and then by bit position,
+            // only the first one is read
+            // The clean outputs are accumulated once per image and copied to every sample of the group,
+            // then only the outputs with faults are recomputed for every trial
+            // With an accumulator cache the clean accumulators of an image are only computed on its first evaluation
+            // Flipping bit k changes a faulty product by (product ^ 2^k) - product,
+            // so each bit position only adds its delta to the clean accumulator and requantizes it
+            // Every sample is bit-identical to DisturbedFullyConnectedOperation with the seed of its trial and its bit flipped
             template <typename InputType, typename WeightType, typename OutputType, typename BiasType>
-            void DisturbedFullyConnectedOperationByChunks(
-                const int start_chunk, const int end_chunk,
-                const int32_t output_multiplier, const int32_t output_shift,
+            void FullyConnectedGrouped(
+                const int32_t* output_multiplier, const int32_t* output_shift,
                 const int batches, const int output_depth, const int accum_depth,
                 const int input_offset, const int filter_offset, const int output_offset,
                 const int output_activation_min, const int output_activation_max,
@@ -163,51 +394,233 @@ namespace tflite {
                 const WeightType* filter_data,
                 const BiasType* bias_data,
                 OutputType* output_data,
-                const std::vector<int>& chunk_indexes,
                 const MyDelegateOptions& options)
             {
-                const int& dataset_index = options.dataset_index;
-                int idx_counter = chunk_indexes.size() - 1;
-                for (int b = 0; b < batches; ++b)
+                static_assert(std::is_same<BiasType, int32_t>::value, "The accumulator cache stores int32 accumulators");
+                const int samples_per_image = options.getSamplesPerImage();
+                const int bit_variants = options.getBitVariants();
+                const int channel_blocks = (output_depth + kChannelBlock - 1) / kChannelBlock;
+                const int images = batches / samples_per_image;
+                std::vector<BiasType> scratch(output_depth);
+                FaultList bit_errors;
+                FaultList tile_errors;
+                for (int image = 0; image < images; ++image)
                 {
-                    for (int out_c = start_chunk; out_c < end_chunk; ++out_c)
+                    const int first_sample = image * samples_per_image;
+                    const InputType* image_input = input_data + first_sample * accum_depth;
+                    OutputType* group_output = output_data + first_sample * output_depth;
+
+                    // Clean accumulators, shared by every trial and bit position
+                    // Images outside the dataset are computed without being stored
+                    const int dataset_image = options.dataset_index + image;
+                    const uint64_t input_key = options.accumulator_cache ? AccumulatorCache::Hash(image_input, accum_depth * sizeof(InputType)) : 0;
+                    const BiasType* clean_accs = options.accumulator_cache ? options.accumulator_cache->Find(dataset_image, input_key) : nullptr;
+                    if (clean_accs == nullptr)
                     {
-                        BiasType acc = 0;
-                        int outputPosition = b * output_depth + out_c;
-                        for (int d = 0; d < accum_depth; ++d)
+                        BiasType* storage = options.accumulator_cache ? options.accumulator_cache->getStorage(dataset_image) : nullptr;
+                        if (storage == nullptr)
                         {
-                            int& kernelPartialPosition = d;
-                            int32_t input_val = input_data[b * accum_depth + d];
-                            int32_t filter_val = filter_data[out_c * accum_depth + d];
+                            storage = scratch.data();
+                        }
+                        FullyConnectedAccumulators(
+                            1, 0, output_depth,
+                            output_depth, accum_depth,
+                            input_offset, filter_offset,
+                            image_input, filter_data,
+                            storage,
+                            options);
+                        if (bias_data)
+                        {
+                            for (int out_c = 0; out_c < output_depth; ++out_c)
+                            {
+                                storage[out_c] += bias_data[out_c];
+                            }
+                        }
+                        if (options.accumulator_cache)
+                        {
+                            options.accumulator_cache->Store(dataset_image, input_key);
+                        }
+                        clean_accs = storage;
+                    }
 
-                            int32_t result = (filter_val + filter_offset) * (input_val + input_offset);
+                    for (int out_c = 0; out_c < output_depth; ++out_c)
+                    {
+                        const BiasType acc = clean_accs[out_c];
+                        int32_t acc_scaled = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_c], output_shift[out_c]);
+                        acc_scaled += output_offset;
+                        acc_scaled = std::max(acc_scaled, output_activation_min);
+                        acc_scaled = std::min(acc_scaled, output_activation_max);
+                        group_output[out_c] = static_cast<OutputType>(acc_scaled);
+                    }
+                    for (int sample = 1; sample < samples_per_image; ++sample)
+                    {
+                        std::copy(group_output, group_output + output_depth, group_output + sample * output_depth);
+                    }
 
-                            if (idx_counter >= 0 && options.error_flat_positions[dataset_index][chunk_indexes[idx_counter]].first == outputPosition && options.error_flat_positions[dataset_index][chunk_indexes[idx_counter]].second == kernelPartialPosition)
+                    for (int trial = 0; trial < options.trials_per_invoke; ++trial)
+                    {
+                        // Bit error rate faults are drawn with the same tiles as the tiled kernel
+                        // Tiles are visited backwards so the positions stay in decreasing order
+                        bit_errors.Clear();
+                        if (options.bit_error_rate > 0.0)
+                        {
+                            for (int tile = channel_blocks - 1; tile >= 0; --tile)
                             {
-                                std::bitset<32> bits(result);
-                                bits.flip(options.bit_position);
-                                result = static_cast<int>(bits.to_ulong());
-                                idx_counter--;
+                                const int start_channel = tile * kChannelBlock;
+                                const int end_channel = std::min(start_channel + kChannelBlock, output_depth);
+                                GetTileBitErrors(options.dataset_index + image, trial, tile, start_channel, end_channel, accum_depth, options, tile_errors);
+                                bit_errors.Append(tile_errors);
                             }
+                        }
+                        const FaultSpan error_positions = options.bit_error_rate > 0.0 ? bit_errors.getSpan() : options.getErrorPositions(image, trial);
+
+                        // Faulty outputs of the trial
+                        OutputType* trial_output = group_output + trial * bit_variants * output_depth;
+                        FaultCursor cursor(error_positions, 0, error_positions.size);
+                        while (cursor.hasFaults())
+                        {
+                            const int out_c = cursor.getNextOutput();
+
+                            // Change of every bit position, wrapping like the int32 accumulator
+                            uint32_t deltas[MyDelegateOptions::num_bit_positions] = {};
+                            while (cursor.getNextOutput() == out_c)
+                            {
+                                const int d = cursor.Pop();
+                                int32_t input_val = image_input[d];
+                                int32_t filter_val = filter_data[out_c * accum_depth + d];
+                                const uint32_t product = static_cast<uint32_t>((filter_val + filter_offset) * (input_val + input_offset));
+                                for (int variant = 0; variant < bit_variants; ++variant)
+                                {
+                                    const int bit = options.sweep_bit_positions ? variant : options.bit_position;
+                                    deltas[variant] += (product ^ (1u << bit)) - product;
+                                }
+                            }
+
+                            for (int variant = 0; variant < bit_variants; ++variant)
+                            {
+                                int32_t acc_scaled = MultiplyByQuantizedMultiplier(static_cast<int32_t>(static_cast<uint32_t>(clean_accs[out_c]) + deltas[variant]), output_multiplier[out_c], output_shift[out_c]);
+                                acc_scaled += output_offset;
+                                acc_scaled = std::max(acc_scaled, output_activation_min);
+                                acc_scaled = std::min(acc_scaled, output_activation_max);
+                                trial_output[variant * output_depth + out_c] = static_cast<OutputType>(acc_scaled);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Evaluates the per-image weight faults
+            // Every trial of an image flips bit_position of its own weights, the error positions are pairs of output and
+            // position inside the row of the kernel of that output
+            // The clean accumulators of an image are computed once, or taken from options.accumulator_cache, and copied
+            // to every sample of the group, then every output with flipped weights adds (w' - w) * (input + input_offset)
+            // The result is bit-identical to the clean fully connected layer with the flipped kernel
+            template <typename InputType, typename WeightType, typename OutputType, typename BiasType>
+            void FullyConnectedWeightFaults(
+                const int32_t* output_multiplier, const int32_t* output_shift,
+                const int batches, const int output_depth, const int accum_depth,
+                const int input_offset, const int filter_offset, const int output_offset,
+                const int output_activation_min, const int output_activation_max,
+                const InputType* input_data,
+                const WeightType* filter_data,
+                const BiasType* bias_data,
+                OutputType* output_data,
+                const MyDelegateOptions& options)
+            {
+                static_assert(std::is_same<BiasType, int32_t>::value, "The accumulator cache stores int32 accumulators");
+                const int samples_per_image = options.getSamplesPerImage();
+                const int images = batches / samples_per_image;
+                std::vector<BiasType> scratch(output_depth);
+                for (int image = 0; image < images; ++image)
+                {
+                    const int first_sample = image * samples_per_image;
+                    const InputType* image_input = input_data + first_sample * accum_depth;
+                    OutputType* group_output = output_data + first_sample * output_depth;
 
-                            acc += result;
+                    // Clean accumulators, shared by every trial
+                    // Images outside the dataset are computed without being stored
+                    const int dataset_image = options.dataset_index + image;
+                    const uint64_t input_key = options.accumulator_cache ? AccumulatorCache::Hash(image_input, accum_depth * sizeof(InputType)) : 0;
+                    const BiasType* clean_accs = options.accumulator_cache ? options.accumulator_cache->Find(dataset_image, input_key) : nullptr;
+                    if (clean_accs == nullptr)
+                    {
+                        BiasType* storage = options.accumulator_cache ? options.accumulator_cache->getStorage(dataset_image) : nullptr;
+                        if (storage == nullptr)
+                        {
+                            storage = scratch.data();
                         }
+                        FullyConnectedAccumulators(
+                            1, 0, output_depth,
+                            output_depth, accum_depth,
+                            input_offset, filter_offset,
+                            image_input, filter_data,
+                            storage,
+                            options);
                         if (bias_data)
                         {
-                            acc += bias_data[out_c];
+                            for (int out_c = 0; out_c < output_depth; ++out_c)
+                            {
+                                storage[out_c] += bias_data[out_c];
+                            }
                         }
-                        int32_t acc_scaled = MultiplyByQuantizedMultiplier(acc, output_multiplier, output_shift);
+                        if (options.accumulator_cache)
+                        {
+                            options.accumulator_cache->Store(dataset_image, input_key);
+                        }
+                        clean_accs = storage;
+                    }
+
+                    for (int out_c = 0; out_c < output_depth; ++out_c)
+                    {
+                        int32_t acc_scaled = MultiplyByQuantizedMultiplier(clean_accs[out_c], output_multiplier[out_c], output_shift[out_c]);
                         acc_scaled += output_offset;
                         acc_scaled = std::max(acc_scaled, output_activation_min);
                         acc_scaled = std::min(acc_scaled, output_activation_max);
-                        output_data[outputPosition] = static_cast<OutputType>(acc_scaled);
+                        group_output[out_c] = static_cast<OutputType>(acc_scaled);
+                    }
+                    for (int sample = 1; sample < samples_per_image; ++sample)
+                    {
+                        std::copy(group_output, group_output + output_depth, group_output + sample * output_depth);
+                    }
+
+                    for (int trial = 0; trial < options.trials_per_invoke; ++trial)
+                    {
+                        const FaultSpan error_positions = options.getErrorPositions(image, trial);
+                        OutputType* trial_output = group_output + trial * output_depth;
+                        FaultCursor cursor(error_positions, 0, error_positions.size);
+                        while (cursor.hasFaults())
+                        {
+                            const int out_c = cursor.getNextOutput();
+
+                            // The filter offset cancels in the change of the weight
+                            BiasType acc = clean_accs[out_c];
+                            while (cursor.getNextOutput() == out_c)
+                            {
+                                const int d = cursor.Pop();
+                                int32_t input_val = image_input[d];
+                                const WeightType filter_val = filter_data[out_c * accum_depth + d];
+                                const WeightType flipped_val = static_cast<WeightType>(static_cast<uint8_t>(filter_val) ^ (1u << options.bit_position));
+                                acc += (static_cast<int32_t>(flipped_val) - filter_val) * (input_val + input_offset);
+                            }
+
+                            int32_t acc_scaled = MultiplyByQuantizedMultiplier(acc, output_multiplier[out_c], output_shift[out_c]);
+                            acc_scaled += output_offset;
+                            acc_scaled = std::max(acc_scaled, output_activation_min);
+                            acc_scaled = std::min(acc_scaled, output_activation_max);
+                            trial_output[out_c] = static_cast<OutputType>(acc_scaled);
+                        }
                     }
                 }
             }
-            
+
+            // Kernel of a clean node with reference activations
+            // The first sample of an image stores its input and its accumulators as the reference of the image
+            // Every other sample starts from the reference accumulators and adds (input - reference input) * weight
+            // for the k inputs that differ, a rank-k update instead of the whole product
+            // The result is bit-identical to the clean fully connected layer
             template <typename InputType, typename WeightType, typename OutputType, typename BiasType>
-            void ParallelDisturbedFullyConnected(
-                const int32_t output_multiplier, const int32_t output_shift,
+            void FullyConnectedIncremental(
+                const int32_t* output_multiplier, const int32_t* output_shift,
                 const int batches, const int output_depth, const int accum_depth,
                 const int input_offset, const int filter_offset, const int output_offset,
                 const int output_activation_min, const int output_activation_max,
@@ -217,66 +630,71 @@ namespace tflite {
                 OutputType* output_data,
                 const MyDelegateOptions& options)
             {
-                std::vector<std::thread> threadPool;
-                //std::mutex coutMutex;
-
-                for (int i = 0; i < options.num_threads; ++i)
+                static_assert(std::is_same<BiasType, int32_t>::value, "The reference activations store int32 accumulators");
+                ReferenceActivations& references = *options.reference_activations;
+                const int samples_per_image = options.getSamplesPerImage();
+                std::vector<BiasType> accs(output_depth);
+                const int images = batches / samples_per_image;
+                for (int image = 0; image < images; ++image)
                 {
-                    const int start = i * options.chunk_size;
-                    const int end = std::min(start + options.chunk_size, options.channels);
-
-#if LOGGER
-                    //std::cout << "Indexes size " << chunk_indexes.size() << "\n";
-                    //std::cout << "Indexes capacity " << chunk_indexes.capacity() << "\n";
-                    //std::cout << "Start: " << start << " End: " << end << "\n";
-                    //std::cout << "Indexes in chunk " << i << ": ";
-                    //for (const auto& val : chunk_indexes)
-                    //{
-                    //	std::cout << val << " ";
-                    //}
-                    //std::cout << "\n";
-                    
-                    //std::cout << "Real positions\n";
-                    //for (const auto& val : options.error_vec_positions[dataset_index])
-                    //{
-                    //	for (const int& element : val.first)
-                    //	{
-                    //		std::cout << element << " ";
-                    //	}
-                    //	std::cout << "- ";
-                    //	for (const int& element : val.second)
-                    //	{
-                    //		std::cout << element << " ";
-                    //	}
-                    //	std::cout << "\n";
-                    //}
-                    //std::cout << "\n";
-#endif // LOGGER
-
-                    threadPool.emplace_back(
-                        DisturbedFullyConnectedOperationByChunks<InputType, WeightType, OutputType, BiasType>,
-                        start, end,
-                        output_multiplier, output_shift,
-                        batches, output_depth, accum_depth,
-                        input_offset, filter_offset, output_offset,
-                        output_activation_min, output_activation_max,
-                        input_data,
-                        filter_data,
-                        bias_data,
-                        output_data,
-                        std::cref(options.chunks_indexes[options.dataset_index][i]),
-                        std::cref(options));
-                }
+                    // Every sample of the group is keyed by the same image of the dataset
+                    const int dataset_image = options.dataset_index + image;
+                    for (int b = image * samples_per_image; b < (image + 1) * samples_per_image; ++b)
+                    {
+                        const InputType* sample_input = input_data + b * accum_depth;
+                        const InputType* reference_input = reinterpret_cast<const InputType*>(references.getInput(dataset_image));
+                        if (reference_input == nullptr)
+                        {
+                            FullyConnectedAccumulators(
+                                1, 0, output_depth,
+                                output_depth, accum_depth,
+                                input_offset, filter_offset,
+                                sample_input, filter_data,
+                                accs.data(),
+                                options);
+                            if (bias_data)
+                            {
+                                for (int out_c = 0; out_c < output_depth; ++out_c)
+                                {
+                                    accs[out_c] += bias_data[out_c];
+                                }
+                            }
+                            references.Store(dataset_image, sample_input, accs.data());
+                        }
+                        else
+                        {
+                            // The input offset cancels in the difference of the inputs
+                            std::memcpy(accs.data(), references.getResult(dataset_image), output_depth * sizeof(BiasType));
+                            for (int d = 0; d < accum_depth; ++d)
+                            {
+                                const int32_t input_change = static_cast<int32_t>(sample_input[d]) - reference_input[d];
+                                if (input_change == 0)
+                                    continue;
+                                for (int out_c = 0; out_c < output_depth; ++out_c)
+                                {
+                                    int32_t filter_val = filter_data[out_c * accum_depth + d];
+                                    accs[out_c] += (filter_val + filter_offset) * input_change;
+                                }
+                            }
+                        }
 
-                // Join all threads
-                for (auto& thread : threadPool)
-                {
-                    thread.join();
+                        for (int out_c = 0; out_c < output_depth; ++out_c)
+                        {
+                            int32_t acc_scaled = MultiplyByQuantizedMultiplier(accs[out_c], output_multiplier[out_c], output_shift[out_c]);
+                            acc_scaled += output_offset;
+                            acc_scaled = std::max(acc_scaled, output_activation_min);
+                            acc_scaled = std::min(acc_scaled, output_activation_max);
+                            output_data[b * output_depth + out_c] = static_cast<OutputType>(acc_scaled);
+                        }
+                    }
                 }
             }
 
+            // Disturbed fully connected layer with a multiplier and a shift for every output channel
+            // Per-tensor layers repeat theirs, see FullyConnectedDisturbed
             template <typename InputType, typename WeightType, typename OutputType, typename BiasType>
-            void FullyConnectedDisturbed(const FullyConnectedParams& params,
+            void FullyConnectedPerChannelDisturbed(const FullyConnectedParams& params,
+                const int32_t* output_multiplier, const int32_t* output_shift,
                 const RuntimeShape& input_shape,
                 const InputType* input_data,
                 const RuntimeShape& filter_shape,
@@ -288,8 +706,6 @@ namespace tflite {
                 const int32_t input_offset = params.input_offset;
                 const int32_t filter_offset = params.weights_offset;
                 const int32_t output_offset = params.output_offset;
-                const int32_t output_multiplier = params.output_multiplier;
-                const int output_shift = params.output_shift;
                 const int32_t output_activation_min = params.quantized_activation_min;
                 const int32_t output_activation_max = params.quantized_activation_max;
                 TFLITE_DCHECK_GE(filter_shape.DimensionsCount(), 2);
@@ -303,7 +719,53 @@ namespace tflite {
                 TFLITE_DCHECK_LE(output_depth, filter_shape.Dims(filter_dim_count - 2));
                 const int accum_depth = filter_shape.Dims(filter_dim_count - 1);
 
-                if (options.is_threaded)
+                if (options.reference_activations && options.operation_mode == OperationMode::none)
+                {
+                    // A clean node only adds the change of the inputs since the reference of the image
+                    FullyConnectedIncremental(
+                        output_multiplier, output_shift,
+                        batches, output_depth, accum_depth,
+                        input_offset, filter_offset, output_offset,
+                        output_activation_min, output_activation_max,
+                        input_data,
+                        filter_data,
+                        bias_data,
+                        output_data,
+                        options
+                    );
+                }
+                else if (options.operation_mode == OperationMode::image_weights)
+                {
+                    // Every image flips its own weights, the clean accumulators are only corrected
+                    FullyConnectedWeightFaults(
+                        output_multiplier, output_shift,
+                        batches, output_depth, accum_depth,
+                        input_offset, filter_offset, output_offset,
+                        output_activation_min, output_activation_max,
+                        input_data,
+                        filter_data,
+                        bias_data,
+                        output_data,
+                        options
+                    );
+                }
+                else if (options.isGrouped() || options.accumulator_cache)
+                {
+                    // Every trial and bit position of an image in a single pass, from the cached accumulators if there are any
+                    FullyConnectedGrouped(
+                        output_multiplier, output_shift,
+                        batches, output_depth, accum_depth,
+                        input_offset, filter_offset, output_offset,
+                        output_activation_min, output_activation_max,
+                        input_data,
+                        filter_data,
+                        bias_data,
+                        output_data,
+                        options
+                    );
+                }
+                // Bit error rate faults are keyed by tile, so they always use the tiled version
+                else if (options.is_threaded || options.bit_error_rate > 0.0)
                 {
                     // Parallel computing done here!
                     ParallelDisturbedFullyConnected(
@@ -329,51 +791,32 @@ namespace tflite {
                         filter_data,
                         bias_data,
                         output_data,
-                        options.full_indexes,
                         options
                     );
                 }
+            }
 
-                /*
-                auto& chunk_indexes = options.full_indexes;
-                int idx_counter = options.full_indexes.size() - 1;
-                for (int b = 0; b < batches; ++b)
-                {
-                    for (int out_c = 0; out_c < output_depth; ++out_c)
-                    {
-                        BiasType acc = 0;
-                        int outputPosition = b * output_depth + out_c;
-                        for (int d = 0; d < accum_depth; ++d)
-                        {
-                            int& kernelPartialPosition = d;
-                            int32_t input_val = input_data[b * accum_depth + d];
-                            int32_t filter_val = filter_data[out_c * accum_depth + d];
-
-                            int32_t result = (filter_val + filter_offset) * (input_val + input_offset);
-
-                            if (idx_counter >= 0 && options.error_flat_positions[options.dataset_index][chunk_indexes[idx_counter]].first == outputPosition && options.error_flat_positions[options.dataset_index][chunk_indexes[idx_counter]].second == kernelPartialPosition)
-                            {
-                                std::bitset<32> bits(result);
-                                bits.flip(options.bit_position);
-                                result = static_cast<int>(bits.to_ulong());
-                                idx_counter--;
-                            }
-
-                            acc += result;
-                        }
-                        if (bias_data)
-                        {
-                            acc += bias_data[out_c];
-                        }
-                        int32_t acc_scaled = MultiplyByQuantizedMultiplier(acc, output_multiplier, output_shift);
-                        acc_scaled += output_offset;
-                        acc_scaled = std::max(acc_scaled, output_activation_min);
-                        acc_scaled = std::min(acc_scaled, output_activation_max);
-                        output_data[outputPosition] = static_cast<OutputType>(acc_scaled);
-                    }
-                }
-                */
-
+            // Disturbed fully connected layer with the multiplier and the shift of the tensor
+            template <typename InputType, typename WeightType, typename OutputType, typename BiasType>
+            void FullyConnectedDisturbed(const FullyConnectedParams& params,
+                const RuntimeShape& input_shape,
+                const InputType* input_data,
+                const RuntimeShape& filter_shape,
+                const WeightType* filter_data,
+                const RuntimeShape& bias_shape, const BiasType* bias_data,
+                const RuntimeShape& output_shape, OutputType* output_data,
+                const MyDelegateOptions& options)
+            {
+                const int output_depth = output_shape.Dims(output_shape.DimensionsCount() - 1);
+                const std::vector<int32_t> output_multiplier(output_depth, params.output_multiplier);
+                const std::vector<int32_t> output_shift(output_depth, params.output_shift);
+                FullyConnectedPerChannelDisturbed(
+                    params, output_multiplier.data(), output_shift.data(),
+                    input_shape, input_data,
+                    filter_shape, filter_data,
+                    bias_shape, bias_data,
+                    output_shape, output_data,
+                    options);
             }
 
             namespace {
@@ -431,6 +874,7 @@ namespace tflite {
                     // since it will be always assumed to be 0.
                     FullyConnectedParams op_params;
                     op_params.input_offset = -input->params.zero_point;
+                    op_params.weights_offset = 0;
                     op_params.output_offset = output->params.zero_point;
                     op_params.quantized_activation_min = data->output_activation_min;
                     op_params.quantized_activation_max = data->output_activation_max;
@@ -446,13 +890,22 @@ namespace tflite {
                         //    GetTensorData<int32_t>(bias), GetTensorShape(output),
                         //    GetTensorData<int8_t>(output));
 
-                        FullyConnectedPerChannel(
+                        //FullyConnectedPerChannel(
+                        //    op_params, data->per_channel_output_multiplier.data(),
+                        //    data->per_channel_output_shift.data(), GetTensorShape(input),
+                        //    GetTensorData<int8_t>(input), GetTensorShape(filter),
+                        //    GetTensorData<int8_t>(filter), GetTensorShape(bias),
+                        //    GetTensorData<int32_t>(bias), GetTensorShape(output),
+                        //    GetTensorData<int8_t>(output));
+
+                        // Per-channel layers get the same faults as the per-tensor ones
+                        FullyConnectedPerChannelDisturbed(
                             op_params, data->per_channel_output_multiplier.data(),
                             data->per_channel_output_shift.data(), GetTensorShape(input),
                             GetTensorData<int8_t>(input), GetTensorShape(filter),
                             GetTensorData<int8_t>(filter), GetTensorShape(bias),
                             GetTensorData<int32_t>(bias), GetTensorShape(output),
-                            GetTensorData<int8_t>(output));
+                            GetTensorData<int8_t>(output), options);
                     }
                 }
 
@@ -0,0 +1,242 @@
+#include "Gemm.h"
+#include "DotProduct.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define GEMM_X86 1
+#include <immintrin.h>
+#else
+#define GEMM_X86 0
+#endif
+
+// MSVC emits any instruction set through the intrinsics, GCC and Clang need the target of every function
+#if GEMM_X86 && !defined(_MSC_VER)
+#define GEMM_TARGET(features) __attribute__((target(features)))
+#else
+#define GEMM_TARGET(features)
+#endif
+
+namespace tflite {
+	namespace custom_ops {
+		namespace gemm {
+
+			void PackFilter(const int8_t* filter_data, int output_depth, int depth, PackedFilter& packed)
+			{
+				packed.output_depth = output_depth;
+				packed.depth = depth;
+				packed.padded_depth = (depth + kDepthGroup - 1) / kDepthGroup * kDepthGroup;
+				packed.panels = (output_depth + kPanelChannels - 1) / kPanelChannels;
+
+				const int groups = packed.padded_depth / kDepthGroup;
+				packed.data.assign(static_cast<size_t>(packed.panels) * groups * kPanelChannels * kDepthGroup, 0);
+				packed.sums.assign(static_cast<size_t>(packed.panels) * kPanelChannels, 0);
+				for (int channel = 0; channel < output_depth; ++channel)
+				{
+					const int panel = channel / kPanelChannels;
+					const int panel_channel = channel % kPanelChannels;
+					for (int k = 0; k < depth; ++k)
+					{
+						const int8_t weight = filter_data[static_cast<size_t>(channel) * depth + k];
+						const size_t group = static_cast<size_t>(panel) * groups + k / kDepthGroup;
+						packed.data[(group * kPanelChannels + panel_channel) * kDepthGroup + k % kDepthGroup] = weight;
+						packed.sums[channel] += weight;
+					}
+				}
+			}
+
+			namespace {
+
+				// Channels of the panel that exist in the filter
+				int getPanelChannels(const PackedFilter& packed, int panel)
+				{
+					return std::min(kPanelChannels, packed.output_depth - panel * kPanelChannels);
+				}
+
+				void MultiplyScalar(const int8_t* lhs, int rows, const PackedFilter& packed, int start_panel, int end_panel, int32_t input_offset, int32_t* accumulators)
+				{
+					const int groups = packed.padded_depth / kDepthGroup;
+					for (int row = 0; row < rows; ++row)
+					{
+						const int8_t* row_input = lhs + static_cast<size_t>(row) * packed.padded_depth;
+						int32_t* row_output = accumulators + static_cast<size_t>(row) * packed.output_depth;
+						for (int panel = start_panel; panel < end_panel; ++panel)
+						{
+							const int8_t* panel_data = packed.data.data() + static_cast<size_t>(panel) * groups * kPanelChannels * kDepthGroup;
+							const int channels = getPanelChannels(packed, panel);
+
+							// Unsigned arithmetic wraps like the int32 accumulator
+							uint32_t sums[kPanelChannels] = {};
+							for (int group = 0; group < groups; ++group)
+							{
+								const int8_t* group_input = row_input + group * kDepthGroup;
+								const int8_t* group_data = panel_data + group * kPanelChannels * kDepthGroup;
+								for (int channel = 0; channel < channels; ++channel)
+								{
+									for (int k = 0; k < kDepthGroup; ++k)
+									{
+										sums[channel] += static_cast<uint32_t>(group_data[channel * kDepthGroup + k] * group_input[k]);
+									}
+								}
+							}
+							for (int channel = 0; channel < channels; ++channel)
+							{
+								const uint32_t correction = static_cast<uint32_t>(input_offset) * static_cast<uint32_t>(packed.sums[panel * kPanelChannels + channel]);
+								row_output[panel * kPanelChannels + channel] = static_cast<int32_t>(sums[channel] + correction);
+							}
+						}
+					}
+				}
+
+#if GEMM_X86
+				inline int32_t LoadGroup(const int8_t* input)
+				{
+					int32_t value;
+					std::memcpy(&value, input, sizeof(value));
+					return value;
+				}
+
+				// kRows im2col rows times a panel, the 4 products of a group of every channel are widened to 16 bits
+				// and summed in pairs by vpmaddwd, the two halves of a channel are added at the end
+				template <int kRows>
+				GEMM_TARGET("avx2")
+				void PanelAvx2(const int8_t* const* rows_input, const int8_t* panel_data, int groups,
+					const int32_t* panel_sums, int32_t input_offset, int channels, int32_t* const* rows_output)
+				{
+					__m256i acc[kRows][4];
+					for (int row = 0; row < kRows; ++row)
+						for (int quad = 0; quad < 4; ++quad)
+							acc[row][quad] = _mm256_setzero_si256();
+
+					for (int group = 0; group < groups; ++group)
+					{
+						const int8_t* group_data = panel_data + group * kPanelChannels * kDepthGroup;
+						__m256i weights[4];
+						for (int quad = 0; quad < 4; ++quad)
+							weights[quad] = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group_data + quad * 16)));
+						for (int row = 0; row < kRows; ++row)
+						{
+							// The 4 inputs of the group repeated for the 4 channels of a quad
+							const __m256i input_values = _mm256_cvtepi8_epi16(_mm_set1_epi32(LoadGroup(rows_input[row] + group * kDepthGroup)));
+							for (int quad = 0; quad < 4; ++quad)
+								acc[row][quad] = _mm256_add_epi32(acc[row][quad], _mm256_madd_epi16(input_values, weights[quad]));
+						}
+					}
+
+					const __m256i offset = _mm256_set1_epi32(input_offset);
+					const __m256i correction_low = _mm256_mullo_epi32(offset, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(panel_sums)));
+					const __m256i correction_high = _mm256_mullo_epi32(offset, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(panel_sums + 8)));
+					for (int row = 0; row < kRows; ++row)
+					{
+						// vphaddd works inside the 128 bits lanes, the permutation puts the channels back in order
+						const __m256i low = _mm256_add_epi32(correction_low,
+							_mm256_permute4x64_epi64(_mm256_hadd_epi32(acc[row][0], acc[row][1]), _MM_SHUFFLE(3, 1, 2, 0)));
+						const __m256i high = _mm256_add_epi32(correction_high,
+							_mm256_permute4x64_epi64(_mm256_hadd_epi32(acc[row][2], acc[row][3]), _MM_SHUFFLE(3, 1, 2, 0)));
+						if (channels == kPanelChannels)
+						{
+							_mm256_storeu_si256(reinterpret_cast<__m256i*>(rows_output[row]), low);
+							_mm256_storeu_si256(reinterpret_cast<__m256i*>(rows_output[row] + 8), high);
+						}
+						else
+						{
+							int32_t panel_output[kPanelChannels];
+							_mm256_storeu_si256(reinterpret_cast<__m256i*>(panel_output), low);
+							_mm256_storeu_si256(reinterpret_cast<__m256i*>(panel_output + 8), high);
+							std::memcpy(rows_output[row], panel_output, channels * sizeof(int32_t));
+						}
+					}
+				}
+
+				// kRows im2col rows times a panel, a vpdpbusd per row and group on the input moved to unsigned
+				// sum(filter * (input + offset)) = sum(filter * (input + 128)) + (offset - 128) * sum(filter)
+				template <int kRows>
+				GEMM_TARGET("avx512f,avx512bw,avx512vnni")
+				void PanelAvx512Vnni(const int8_t* const* rows_input, const int8_t* panel_data, int groups,
+					const int32_t* panel_sums, int32_t input_offset, int channels, int32_t* const* rows_output)
+				{
+					const __m512i sign_flip = _mm512_set1_epi8(static_cast<char>(0x80));
+					__m512i acc[kRows];
+					for (int row = 0; row < kRows; ++row)
+						acc[row] = _mm512_setzero_si512();
+
+					for (int group = 0; group < groups; ++group)
+					{
+						const __m512i weights = _mm512_loadu_si512(panel_data + group * kPanelChannels * kDepthGroup);
+						for (int row = 0; row < kRows; ++row)
+						{
+							const __m512i input_values = _mm512_xor_si512(_mm512_set1_epi32(LoadGroup(rows_input[row] + group * kDepthGroup)), sign_flip);
+							acc[row] = _mm512_dpbusd_epi32(acc[row], input_values, weights);
+						}
+					}
+
+					const __m512i correction = _mm512_mullo_epi32(_mm512_set1_epi32(input_offset - 128), _mm512_loadu_si512(panel_sums));
+					const __mmask16 mask = static_cast<__mmask16>((1u << channels) - 1);
+					for (int row = 0; row < kRows; ++row)
+					{
+						_mm512_mask_storeu_epi32(rows_output[row], mask, _mm512_add_epi32(acc[row], correction));
+					}
+				}
+
+				// Kernel of kRows im2col rows times a panel
+				using PanelFunction = void(*)(const int8_t* const* rows_input, const int8_t* panel_data, int groups,
+					const int32_t* panel_sums, int32_t input_offset, int channels, int32_t* const* rows_output);
+
+				// Rows in blocks of block_rows, the remaining rows one by one
+				void MultiplyPanels(const int8_t* lhs, int rows, const PackedFilter& packed, int start_panel, int end_panel, int32_t input_offset, int32_t* accumulators,
+					int block_rows, PanelFunction block_kernel, PanelFunction row_kernel)
+				{
+					constexpr int kMaxBlockRows = 4;
+					const int groups = packed.padded_depth / kDepthGroup;
+					const size_t panel_bytes = static_cast<size_t>(groups) * kPanelChannels * kDepthGroup;
+					const int8_t* rows_input[kMaxBlockRows];
+					int32_t* rows_output[kMaxBlockRows];
+					int row = 0;
+					while (row < rows)
+					{
+						const int count = row + block_rows <= rows ? block_rows : 1;
+						const PanelFunction kernel = count == block_rows ? block_kernel : row_kernel;
+						for (int panel = start_panel; panel < end_panel; ++panel)
+						{
+							for (int k = 0; k < count; ++k)
+							{
+								rows_input[k] = lhs + static_cast<size_t>(row + k) * packed.padded_depth;
+								rows_output[k] = accumulators + static_cast<size_t>(row + k) * packed.output_depth + panel * kPanelChannels;
+							}
+							kernel(rows_input, packed.data.data() + panel * panel_bytes, groups,
+								packed.sums.data() + panel * kPanelChannels, input_offset, getPanelChannels(packed, panel), rows_output);
+						}
+						row += count;
+					}
+				}
+#endif
+
+			}
+
+			void Multiply(const int8_t* lhs, int rows, const PackedFilter& packed, int32_t input_offset, int32_t* accumulators)
+			{
+				MultiplyRange(lhs, rows, packed, 0, packed.panels, input_offset, accumulators);
+			}
+
+			void MultiplyRange(const int8_t* lhs, int rows, const PackedFilter& packed, int start_panel, int end_panel, int32_t input_offset, int32_t* accumulators)
+			{
+#if GEMM_X86
+				// Same instruction set as the dot products, selected once for the CPU
+				if (dot_product::selected == dot_product::Avx512Vnni)
+				{
+					MultiplyPanels(lhs, rows, packed, start_panel, end_panel, input_offset, accumulators, 4, PanelAvx512Vnni<4>, PanelAvx512Vnni<1>);
+					return;
+				}
+				if (dot_product::selected == dot_product::Avx2)
+				{
+					MultiplyPanels(lhs, rows, packed, start_panel, end_panel, input_offset, accumulators, 2, PanelAvx2<2>, PanelAvx2<1>);
+					return;
+				}
+#endif
+				MultiplyScalar(lhs, rows, packed, start_panel, end_panel, input_offset, accumulators);
+			}
+
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace tflite {
+	namespace custom_ops {
+
+		// PackedFilter
+		// Int8 filter of a convolution or weights of a fully connected layer packed for the GEMM microkernels, [output_depth][depth] in OHWI order
+		// The output channels are split in panels of gemm::kPanelChannels and the depth in groups of gemm::kDepthGroup,
+		// the layout is [panel][depth group][channel of the panel][position in the group]
+		// so a panel row of 4 bytes per channel is contiguous for vpdpbusd
+		// Channels and depth are padded with zero weights, padded products add nothing
+		struct PackedFilter
+		{
+			// Output channels of the filter
+			int output_depth = 0;
+
+			// Products of every output, filter_height * filter_width * filter_input_depth
+			int depth = 0;
+
+			// Depth rounded up to a multiple of the depth group, row size of the im2col blocks
+			int padded_depth = 0;
+
+			// Number of panels of output channels
+			int panels = 0;
+
+			// Packed weights
+			std::vector<int8_t> data;
+
+			// Sum of the weights of every output channel, folds the input offset into a single product per output
+			std::vector<int32_t> sums;
+		};
+
+		// Blocked int8 GEMM of the convolutions, the im2col rows of a block of output pixels times the packed filter
+		namespace gemm {
+
+			// Output channels of a panel, one zmm register of int32 accumulators
+			constexpr int kPanelChannels = 16;
+
+			// Consecutive products of a channel multiplied by a single vpdpbusd lane
+			constexpr int kDepthGroup = 4;
+
+			// Output pixels of an im2col block, the block is reused by every panel while it stays in the cache
+			constexpr int kBlockPixels = 64;
+
+			// Packs a [output_depth][depth] filter
+			void PackFilter(const int8_t* filter_data, int output_depth, int depth, PackedFilter& packed);
+
+			// accumulators[row * output_depth + channel] = sum of filter[channel][k] * (lhs[row][k] + input_offset)
+			// The rows of lhs are padded_depth bytes, the result wraps like an int32 accumulator
+			// Uses the instruction set selected for the dot products
+			void Multiply(const int8_t* lhs, int rows, const PackedFilter& packed, int32_t input_offset, int32_t* accumulators);
+
+			// Multiply for the output channels of the panels [start_panel, end_panel) only, the other accumulators are not written
+			// A single row is the GEMV of the fully connected layers
+			void MultiplyRange(const int8_t* lhs, int rows, const PackedFilter& packed, int start_panel, int end_panel, int32_t input_offset, int32_t* accumulators);
+		}
+
+	}
+}
\ No newline at end of file
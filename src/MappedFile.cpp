@@ -0,0 +1,195 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tflite {
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const std::string& path)
+	{
+		Close();
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		file_handle_ = file;
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			Close();
+			return false;
+		}
+		mapping_handle_ = mapping;
+
+		data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (data_ == nullptr)
+		{
+			Close();
+			return false;
+		}
+		size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+		file_descriptor_ = open(path.c_str(), O_RDONLY);
+		if (file_descriptor_ < 0)
+			return false;
+
+		struct stat file_status;
+		if (fstat(file_descriptor_, &file_status) != 0 || file_status.st_size == 0)
+		{
+			Close();
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(file_status.st_size), PROT_READ, MAP_SHARED, file_descriptor_, 0);
+		if (view == MAP_FAILED)
+		{
+			Close();
+			return false;
+		}
+		data_ = static_cast<const unsigned char*>(view);
+		size_ = static_cast<size_t>(file_status.st_size);
+#endif
+		return true;
+	}
+
+	bool MappedFile::OpenWritable(const std::string& path, size_t size)
+	{
+		Close();
+		if (size == 0)
+			return false;
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		file_handle_ = file;
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size))
+		{
+			Close();
+			return false;
+		}
+		if (static_cast<size_t>(file_size.QuadPart) != size)
+		{
+			// Truncated first, so the whole file is zero
+			LARGE_INTEGER new_size;
+			new_size.QuadPart = 0;
+			if (!SetFilePointerEx(file, new_size, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+			{
+				Close();
+				return false;
+			}
+			new_size.QuadPart = static_cast<LONGLONG>(size);
+			if (!SetFilePointerEx(file, new_size, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+			{
+				Close();
+				return false;
+			}
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			Close();
+			return false;
+		}
+		mapping_handle_ = mapping;
+
+		data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+		if (data_ == nullptr)
+		{
+			Close();
+			return false;
+		}
+#else
+		file_descriptor_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (file_descriptor_ < 0)
+			return false;
+
+		struct stat file_status;
+		if (fstat(file_descriptor_, &file_status) != 0)
+		{
+			Close();
+			return false;
+		}
+		if (static_cast<size_t>(file_status.st_size) != size)
+		{
+			// Truncated first, so the whole file is zero
+			if (ftruncate(file_descriptor_, 0) != 0 || ftruncate(file_descriptor_, static_cast<off_t>(size)) != 0)
+			{
+				Close();
+				return false;
+			}
+		}
+
+		void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor_, 0);
+		if (view == MAP_FAILED)
+		{
+			Close();
+			return false;
+		}
+		data_ = static_cast<const unsigned char*>(view);
+#endif
+		size_ = size;
+		writable_ = true;
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (data_ != nullptr)
+			UnmapViewOfFile(data_);
+		if (mapping_handle_ != nullptr)
+			CloseHandle(mapping_handle_);
+		if (file_handle_ != nullptr)
+			CloseHandle(file_handle_);
+		mapping_handle_ = nullptr;
+		file_handle_ = nullptr;
+#else
+		if (data_ != nullptr)
+			munmap(const_cast<unsigned char*>(data_), size_);
+		if (file_descriptor_ >= 0)
+			close(file_descriptor_);
+		file_descriptor_ = -1;
+#endif
+		data_ = nullptr;
+		size_ = 0;
+		writable_ = false;
+	}
+
+	const unsigned char* MappedFile::getData() const
+	{
+		return data_;
+	}
+
+	unsigned char* MappedFile::getWritableData()
+	{
+		return writable_ ? const_cast<unsigned char*>(data_) : nullptr;
+	}
+
+	size_t MappedFile::getSize() const
+	{
+		return size_;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace tflite {
+
+	// MappedFile
+	// Memory mapping of a whole file, read-only unless it is opened with OpenWritable
+	// The contents are read in place, pages are loaded by the operating system when they are touched
+	class MappedFile
+	{
+	public:
+		// MappedFile constructor, nothing is mapped
+		MappedFile() = default;
+
+		// MappedFile destructor, unmaps the file
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Maps the file, returns false if it can not be opened or it is empty
+		bool Open(const std::string& path);
+
+		// Maps the file for reading and writing, it is created if it does not exist
+		// A file of a different size is resized to size bytes, the added bytes are zero
+		// Writes go to the file through the page cache
+		bool OpenWritable(const std::string& path, size_t size);
+
+		// Unmaps the file
+		void Close();
+
+		// First byte of the file, nullptr if nothing is mapped
+		const unsigned char* getData() const;
+
+		// First byte of the file, nullptr if nothing is mapped or it is read-only
+		unsigned char* getWritableData();
+
+		// Size of the file in bytes
+		size_t getSize() const;
+
+	private:
+#ifdef _WIN32
+		// Handle of the file
+		void* file_handle_ = nullptr;
+
+		// Handle of the file mapping object
+		void* mapping_handle_ = nullptr;
+#else
+		// Descriptor of the file
+		int file_descriptor_ = -1;
+#endif
+
+		// Mapped view of the file
+		const unsigned char* data_ = nullptr;
+
+		// Size of the mapped view
+		size_t size_ = 0;
+
+		// The view can be written
+		bool writable_ = false;
+	};
+
+}
\ No newline at end of file
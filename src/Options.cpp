@@ -1,25 +1,48 @@
 #include "Options.h"
 #include "Logger.h"
+#include <algorithm>
 
 namespace tflite {
 
-	bool MyDelegateOptions::new_call = false;
-
 	MyDelegateOptions::MyDelegateOptions(const MyDelegateOptions& options)
 		: operation_mode(options.operation_mode),
+		kernel_backend(options.kernel_backend),
+		fault_generation(options.fault_generation),
+		accumulator_caching(options.accumulator_caching),
+		activation_caching(options.activation_caching),
+		golden_caching(options.golden_caching),
+		seed(options.seed),
 		bit_position(options.bit_position),
 		number_flips(options.number_flips),
+		sweep_bit_positions(options.sweep_bit_positions),
+		trials_per_invoke(options.trials_per_invoke),
+		incremental_propagation(options.incremental_propagation),
+		bit_error_rate(options.bit_error_rate),
 		dataset_size(options.dataset_size),
 		node_index(options.node_index),
 		builtin_code(options.builtin_code),
-		channels(options.channels),
-		chunk_size(options.chunk_size),
-		layer_name(options.layer_name)
+		layer_name(options.layer_name),
+		faulty_layer(options.faulty_layer),
+		fault_plan_out(options.fault_plan_out),
+		fault_plan_in(options.fault_plan_in),
+		accumulator_cache_file(options.accumulator_cache_file),
+		activation_cache_file(options.activation_cache_file),
+		golden_cache_file(options.golden_cache_file),
+		model_key(options.model_key),
+		activation_node(options.activation_node),
+		prefix_nodes(options.prefix_nodes),
+		golden_node(options.golden_node),
+		suffix_nodes(options.suffix_nodes),
+		fault_plan(options.fault_plan),
+		accumulator_cache(options.accumulator_cache),
+		packed_filter(options.packed_filter),
+		conv_indirection(options.conv_indirection),
+		conv_specialization(options.conv_specialization),
+		reference_activations(options.reference_activations),
+		runtime(options.runtime)
 	{
 		// Copy constructor
-		error_flat_positions.resize(dataset_size);
-		error_vec_positions.resize(dataset_size);
-		chunks_indexes.resize(dataset_size);
+		// The fault plan, the caches, the packed filter, the indirection, the specialization and the runtime options are shared, not copied
 		// This constructor is called from the initialization list of the constructor of MyDelegateKernel
 #if LOGGER
 		//std::cout << "MyDelegateOptions copy constructor\n";
@@ -33,6 +56,10 @@ namespace tflite {
 		//std::cout << "MyDelegateOptions constructor from keys\n";
 #endif // LOGGER
 
+		// Random seed unless it is given in the options
+		std::random_device random_device;
+		seed = (static_cast<unsigned long long>(random_device()) << 32) | random_device();
+
 		for (int i = 0; i < num_options; i++)
 		{
 			if (options_keys != nullptr && options_values != nullptr)
@@ -41,6 +68,30 @@ namespace tflite {
 				{
 					operation_mode = (OperationMode)std::stoi(*(options_values + i));
 				}
+				else if (strcmp(*(options_keys + i), "kernel_backend") == 0)
+				{
+					kernel_backend = (KernelBackend)std::stoi(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "fault_generation") == 0)
+				{
+					fault_generation = (FaultGeneration)std::stoi(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "accumulator_caching") == 0)
+				{
+					accumulator_caching = (AccumulatorCaching)std::stoi(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "activation_caching") == 0)
+				{
+					activation_caching = (ActivationCaching)std::stoi(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "golden_caching") == 0)
+				{
+					golden_caching = (GoldenCaching)std::stoi(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "seed") == 0)
+				{
+					seed = std::stoull(*(options_values + i));
+				}
 				else if (strcmp(*(options_keys + i), "bit_position") == 0)
 				{
 					bit_position = std::stoi(*(options_values + i));
@@ -49,6 +100,22 @@ namespace tflite {
 				{
 					number_flips = std::stoi(*(options_values + i));
 				}
+				else if (strcmp(*(options_keys + i), "sweep_bit_positions") == 0)
+				{
+					sweep_bit_positions = std::stoi(*(options_values + i)) != 0;
+				}
+				else if (strcmp(*(options_keys + i), "trials_per_invoke") == 0)
+				{
+					trials_per_invoke = std::max(1, std::stoi(*(options_values + i)));
+				}
+				else if (strcmp(*(options_keys + i), "incremental_propagation") == 0)
+				{
+					incremental_propagation = std::stoi(*(options_values + i)) != 0;
+				}
+				else if (strcmp(*(options_keys + i), "bit_error_rate") == 0)
+				{
+					bit_error_rate = std::stod(*(options_values + i));
+				}
 				else if (strcmp(*(options_keys + i), "dataset_size") == 0)
 				{
 					dataset_size = std::stoi(*(options_values + i));
@@ -57,6 +124,30 @@ namespace tflite {
 				{
 					layer_name = std::string(*(options_values + i));
 				}
+				else if (strcmp(*(options_keys + i), "faulty_layer") == 0)
+				{
+					faulty_layer = std::string(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "fault_plan_out") == 0)
+				{
+					fault_plan_out = std::string(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "fault_plan_in") == 0)
+				{
+					fault_plan_in = std::string(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "accumulator_cache_file") == 0)
+				{
+					accumulator_cache_file = std::string(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "activation_cache_file") == 0)
+				{
+					activation_cache_file = std::string(*(options_values + i));
+				}
+				else if (strcmp(*(options_keys + i), "golden_cache_file") == 0)
+				{
+					golden_cache_file = std::string(*(options_values + i));
+				}
 				else
 				{
 					std::cout << "Warning: unmatched key : " << *(options_keys + i) << " = " << *(options_values + i) << std::endl;
@@ -64,9 +155,43 @@ namespace tflite {
 			}
 		}
 
-		error_flat_positions.resize(dataset_size);
-		error_vec_positions.resize(dataset_size);
-		chunks_indexes.resize(dataset_size);
+		// A saved plan replaces the generation of the positions
+		if (!fault_plan_in.empty())
+		{
+			fault_generation = FaultGeneration::replay;
+		}
+
+		// A cache file keeps the accumulators between campaigns
+		if (!accumulator_cache_file.empty())
+		{
+			accumulator_caching = AccumulatorCaching::mapped;
+		}
+
+		// Activations are only cached in a file
+		if (activation_caching != ActivationCaching::none && activation_cache_file.empty())
+		{
+			std::cout << "Warning: activation caching needs activation_cache_file, activations are not cached\n";
+			activation_caching = ActivationCaching::none;
+		}
+
+		// Golden outputs are only cached in a file
+		if (golden_caching != GoldenCaching::none && golden_cache_file.empty())
+		{
+			std::cout << "Warning: golden caching needs golden_cache_file, golden outputs are not cached\n";
+			golden_caching = GoldenCaching::none;
+		}
+
+		// Weight faults always come from the error positions and flip a single bit of the int8 weights
+		if (operation_mode == OperationMode::image_weights && bit_error_rate > 0.0)
+		{
+			std::cout << "Warning: bit error rate is not supported with image weights, number_flips weights are flipped\n";
+			bit_error_rate = 0.0;
+		}
+		if (operation_mode == OperationMode::image_weights && sweep_bit_positions)
+		{
+			std::cout << "Warning: bit positions can not be swept with image weights, only bit_position is flipped\n";
+			sweep_bit_positions = false;
+		}
 	}
 	
 	void MyDelegateOptions::convertPositionInt2Vec(int position, int max_size, const std::vector<int>& tensor_dimensions, std::vector<int>& vec_position)
@@ -84,7 +209,7 @@ namespace tflite {
 	bool MyDelegateOptions::getPairIntGreater(const std::pair<int, int>& pair1, const std::pair<int, int>& pair2)
 	{
 		// Sort in decreasing order based on the first element of the pair
-		return pair1.first > pair2.first || pair1.first == pair2.first && pair1.second > pair2.second;
+		return pair1.first > pair2.first || (pair1.first == pair2.first && pair1.second > pair2.second);
 	}
 
 	int MyDelegateOptions::convertPositionVec2Int(const std::vector<int>& tensor_dimensions, const std::vector<int>& vec_position)
@@ -102,26 +227,100 @@ namespace tflite {
 		return position;
 	}
 
-	bool MyDelegateOptions::getPairVecGreater(const std::pair<std::vector<int>, std::vector<int>>& pair1, const std::pair<std::vector<int>, std::vector<int>>& pair2, const std::vector<int>& first_dimensions, const std::vector<int>& second_dimensions)
+	bool MyDelegateOptions::matchLayerName(const char* tensor_name, const std::string& patterns)
 	{
-		// Sort in decreasing order based on the first element of the pair
-		const std::vector<int>& first1 = pair1.first;
-		const std::vector<int>& second1 = pair1.second;
-		const std::vector<int>& first2 = pair2.first;
-		const std::vector<int>& second2 = pair2.second;
+		if (patterns.empty())
+			return true;
+		if (tensor_name == nullptr)
+			return false;
+		size_t start = 0;
+		while (start <= patterns.size())
+		{
+			size_t end = patterns.find(',', start);
+			if (end == std::string::npos)
+				end = patterns.size();
+			const std::string pattern = patterns.substr(start, end - start);
+			if (!pattern.empty() && strstr(tensor_name, pattern.c_str()) != nullptr)
+				return true;
+			start = end + 1;
+		}
+		return false;
+	}
 
-		const int pos_first1 = convertPositionVec2Int(first_dimensions, first1);
-		const int pos_first2 = convertPositionVec2Int(first_dimensions, first2);
+	FaultSpan MyDelegateOptions::getErrorPositions(int image, int trial) const
+	{
+		if (!fault_plan)
+			return FaultSpan();
+		// Lazy generation and replay overwrite the positions of the images of the batch being evaluated
+		return fault_plan->getImage(getFaultSetIndex(fault_generation == FaultGeneration::precomputed ? dataset_index + image : image, trial));
+	}
 
-		const int pos_second1 = convertPositionVec2Int(first_dimensions, second1);
-		const int pos_second2 = convertPositionVec2Int(first_dimensions, second2);
+	void MyDelegateOptions::getErrorRange(int start, int end, int& first, int& last, int image) const
+	{
+		const FaultSpan error_positions = getErrorPositions(image);
+		const int32_t* output_begin = error_positions.output_positions;
+		const int32_t* output_end = error_positions.output_positions + error_positions.size;
+		// Positions not smaller than end are placed before the range
+		first = std::partition_point(output_begin, output_end,
+			[end](int32_t position) { return position >= end; }) - output_begin;
+		// Positions not smaller than start are placed inside the range
+		last = std::partition_point(output_begin + first, output_end,
+			[start](int32_t position) { return position >= start; }) - output_begin;
+	}
+
+	int MyDelegateOptions::getFaultSetIndex(int image, int trial) const
+	{
+		// The trials of an image are contiguous
+		return image * trials_per_invoke + trial;
+	}
+
+	unsigned long long MyDelegateOptions::getTrialSeed(int trial) const
+	{
+		if (trial == 0)
+			return seed;
+		// SplitMix64 finalizer, every trial gets an unrelated key
+		unsigned long long key = seed + 0x9E3779B97F4A7C15ull * static_cast<unsigned long long>(trial);
+		key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+		key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+		return key ^ (key >> 31);
+	}
+
+	bool MyDelegateOptions::isDelegatedMode() const
+	{
+		return operation_mode == OperationMode::convolution || operation_mode == OperationMode::image_weights;
+	}
+
+	bool MyDelegateOptions::isGrouped() const
+	{
+		// Layers without faults compute every sample as it comes
+		return (operation_mode == OperationMode::convolution && (sweep_bit_positions || trials_per_invoke > 1)) ||
+			(operation_mode == OperationMode::image_weights && trials_per_invoke > 1);
+	}
+
+	int MyDelegateOptions::getBitVariants() const
+	{
+		// Weight faults flip a single bit of the int8 weights
+		return sweep_bit_positions && operation_mode == OperationMode::convolution ? num_bit_positions : 1;
+	}
 
-		return pos_first1 > pos_first2 || pos_first1 == pos_first2 && pos_second1 > pos_second2;
+	int MyDelegateOptions::getSamplesPerImage() const
+	{
+		return samples_per_image;
+	}
+
+	int MyDelegateOptions::getGroupSize(OperationMode delegate_mode) const
+	{
+		if (delegate_mode == OperationMode::convolution)
+			return sweep_bit_positions ? trials_per_invoke * num_bit_positions : trials_per_invoke;
+		if (delegate_mode == OperationMode::image_weights)
+			return trials_per_invoke;
+		return 1;
 	}
 
 	void MyDelegateOptions::Log() const
 	{
 		std::cout << "layer name = " << layer_name << "\n";
+		std::cout << "faulty layer = " << faulty_layer << "\n";
 		switch (operation_mode)
 		{
 		case tflite::OperationMode::none:
@@ -133,17 +332,103 @@ namespace tflite {
 		case tflite::OperationMode::convolution:
 			std::cout << "operation mode = convolution\n";
 			break;
+		case tflite::OperationMode::image_weights:
+			std::cout << "operation mode = image weights\n";
+			break;
 		default:
 			std::cout << "operation mode = unknown\n";
 			break;
 		}
+		switch (kernel_backend)
+		{
+		case tflite::KernelBackend::reference:
+			std::cout << "kernel backend = reference\n";
+			break;
+		case tflite::KernelBackend::hybrid:
+			std::cout << "kernel backend = hybrid\n";
+			break;
+		case tflite::KernelBackend::gemm:
+			std::cout << "kernel backend = gemm\n";
+			break;
+		default:
+			std::cout << "kernel backend = unknown\n";
+			break;
+		}
+		switch (fault_generation)
+		{
+		case tflite::FaultGeneration::precomputed:
+			std::cout << "fault generation = precomputed\n";
+			break;
+		case tflite::FaultGeneration::lazy:
+			std::cout << "fault generation = lazy\n";
+			break;
+		case tflite::FaultGeneration::replay:
+			std::cout << "fault generation = replay\n";
+			break;
+		default:
+			std::cout << "fault generation = unknown\n";
+			break;
+		}
+		switch (accumulator_caching)
+		{
+		case tflite::AccumulatorCaching::none:
+			std::cout << "accumulator caching = none\n";
+			break;
+		case tflite::AccumulatorCaching::memory:
+			std::cout << "accumulator caching = memory\n";
+			break;
+		case tflite::AccumulatorCaching::mapped:
+			std::cout << "accumulator caching = mapped\n";
+			break;
+		default:
+			std::cout << "accumulator caching = unknown\n";
+			break;
+		}
+		switch (activation_caching)
+		{
+		case tflite::ActivationCaching::none:
+			std::cout << "activation caching = none\n";
+			break;
+		case tflite::ActivationCaching::capture:
+			std::cout << "activation caching = capture\n";
+			break;
+		case tflite::ActivationCaching::replay:
+			std::cout << "activation caching = replay\n";
+			break;
+		default:
+			std::cout << "activation caching = unknown\n";
+			break;
+		}
+		switch (golden_caching)
+		{
+		case tflite::GoldenCaching::none:
+			std::cout << "golden caching = none\n";
+			break;
+		case tflite::GoldenCaching::capture:
+			std::cout << "golden caching = capture\n";
+			break;
+		case tflite::GoldenCaching::replay:
+			std::cout << "golden caching = replay\n";
+			break;
+		default:
+			std::cout << "golden caching = unknown\n";
+			break;
+		}
+		std::cout << "seed = " << seed << "\n";
 		std::cout << "bit position = " << bit_position << "\n";
 		std::cout << "number flips = " << number_flips << "\n";
+		std::cout << "sweep bit positions = " << (sweep_bit_positions ? "true" : "false") << "\n";
+		std::cout << "trials per invoke = " << trials_per_invoke << "\n";
+		std::cout << "incremental propagation = " << (incremental_propagation ? "true" : "false") << "\n";
+		std::cout << "bit error rate = " << bit_error_rate << "\n";
+		std::cout << "fault plan out = " << fault_plan_out << "\n";
+		std::cout << "fault plan in = " << fault_plan_in << "\n";
+		std::cout << "accumulator cache file = " << accumulator_cache_file << "\n";
+		std::cout << "activation cache file = " << activation_cache_file << "\n";
+		std::cout << "golden cache file = " << golden_cache_file << "\n";
 		std::cout << "dataset size = " << dataset_size << "\n";
 		std::cout << "node index = " << node_index << "\n";
 		std::cout << "builtin code = " << custom_logger::get_builtin_code(builtin_code) << "\n";
-		std::cout << "channels = " << channels << "\n";
-		std::cout << "chunk size = " << chunk_size << "\n";
 		std::cout << "num threads = " << num_threads << "\n";
 		std::cout << "is threaded: " << (is_threaded ? "true" : "false") << "\n";
 	}
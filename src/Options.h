@@ -2,26 +2,130 @@
 #include <iostream>
 #include <string>
 #include <random>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "FaultPlan.h"
+#include "AccumulatorCache.h"
+#include "ReferenceActivations.h"
 
 namespace tflite {
+	// Forward declaration
+	class ThreadPool;
+	namespace custom_ops {
+		struct PackedFilter;
+		class ConvIndirection;
+		class ConvSpecialization;
+	}
+
 	// States of delegate enum class
 	// With these states you can state the delegate effects:
 	// - No effect
 	// - Affect kernel weights
 	// - Affect convolution operation
+	// - Affect kernel weights with different flips for every image
 	enum class OperationMode {
 		none,
 		weights,
-		convolution
+		convolution,
+		image_weights
+	};
+
+	// Kernel backend enum class
+	// With these states you can select how the delegated convolution is computed:
+	// - Reference: naive loop that checks for a fault at every multiplication
+	// - Hybrid: TFLite optimized clean pass, then only the faulty output elements are recomputed
+	// - Gemm: im2col blocks times the packed filter, then the faulty products are corrected on the accumulators
+	enum class KernelBackend {
+		reference,
+		hybrid,
+		gemm
+	};
+
+	// Fault generation enum class
+	// With these states you can select when the error positions are generated:
+	// - Precomputed: positions of the whole dataset are generated in MyDelegateKernel::Init
+	// - Lazy: positions of each image are generated in MyDelegateKernel::Eval from its dataset index
+	// - Replay: positions of each image are decoded in MyDelegateKernel::Eval from the mapped fault_plan_in file
+	enum class FaultGeneration {
+		precomputed,
+		lazy,
+		replay
+	};
+
+	// Accumulator caching enum class
+	// With these states you can select if the clean accumulators of the disturbed layer are reused:
+	// - None: the clean accumulators are computed on every Eval
+	// - Memory: the clean accumulators of every image are kept in memory after its first evaluation
+	// - Mapped: the clean accumulators are kept in the memory mapped accumulator_cache_file, so later campaigns reuse them
+	enum class AccumulatorCaching {
+		none,
+		memory,
+		mapped
+	};
+
+	// Activation caching enum class
+	// With these states you can select if the layers before the first delegated node are executed:
+	// - None: the whole model is executed on every invoke
+	// - Capture: the input of the first delegated node is written to activation_cache_file for every image
+	// - Replay: the layers before the first delegated node are claimed and skipped, its input is read from activation_cache_file
+	enum class ActivationCaching {
+		none,
+		capture,
+		replay
+	};
+
+	// Golden caching enum class
+	// With these states you can select if the layers after the last faulty node are executed:
+	// - None: the whole model is executed on every invoke
+	// - Capture: the clean output of the last faulty node and the outputs of the model are written to golden_cache_file for every image
+	// - Replay: the layers after the last faulty node are claimed, they are skipped when its output matches the capture
+	enum class GoldenCaching {
+		none,
+		capture,
+		replay
+	};
+
+	// RuntimeOptions
+	// Fault options that can be changed on a live delegate from the C API of EntryPoint.cpp
+	// Shared by MyDelegate and all its kernels, so the interpreter does not need to be rebuilt
+	// Every change increases the epoch, the kernels compare it on every Eval and when it differs
+	// they copy the new values, rebuild their fault plan and restart the dataset index
+	struct RuntimeOptions
+	{
+		// Operation mode, only none, convolution and image_weights can be selected on a live delegate
+		OperationMode operation_mode = OperationMode::none;
+
+		// Bit position to be flipped
+		int bit_position = -1;
+
+		// Number of flips per image in the dataset
+		int number_flips = -1;
+
+		// Probability of flipping the bit of a single multiplication
+		double bit_error_rate = 0.0;
+
+		// Seed of the counter-based generator of the error positions
+		unsigned long long seed = 0;
+
+		// Name patterns of the claimed layers that are disturbed, empty for all of them
+		std::string faulty_layer = "";
+
+		// Number of changes, the values must be written before increasing it
+		std::atomic<unsigned long long> epoch{ 0 };
+
+		// Publishes the values written to the kernels
+		void Invalidate()
+		{
+			epoch.fetch_add(1, std::memory_order_release);
+		}
 	};
 
 	// MyDelegateOptions
 	// Stores the options to determine the behaviour of the delegate
 	struct MyDelegateOptions
 	{
-		// Overseer to check if same session has called 
-		static bool new_call;
-
 		// Maximum number of threads to avoid bottleneck
 		// This number was obtained experimentally
 		constexpr static int max_number_threads = 8;
@@ -30,48 +134,164 @@ namespace tflite {
 		// This number was obtained experimentally
 		constexpr static int max_operations_per_thread = 100000;
 
+		// Number of bits of the int32 products, one output variant per bit when sweeping the bit positions
+		constexpr static int num_bit_positions = 32;
+
 		// Controls the index of the dataset image beig evaluated
+		// Index of the first sample when the input has a batch of several images
 		int dataset_index = 0;
 
+		// Number of samples of the batch that share the same image of the dataset
+		// Set by MyDelegateKernel before every evaluation, so every node of the partition, clean or disturbed,
+		// moves through the images of the batch in the same groups
+		int samples_per_image = 1;
+
 		// Operation mode:
 		//	- None: convolution runs normally
 		//	- Kernel weights: kernel weights are affected
 		//	- Convolution multiplication: convolution multiplication is affected
+		//	- Image weights: the delegated nodes flip bit_position of number_flips weights, different ones for every image
 		OperationMode operation_mode = OperationMode::none;
 
+		// Kernel backend:
+		//	- Reference: every product is checked against the error positions
+		//	- Hybrid: optimized convolution followed by the recomputation of the faulty outputs
+		//	- Gemm: blocked int8 GEMM of the packed filter followed by the correction of the faulty accumulators
+		KernelBackend kernel_backend = KernelBackend::reference;
+
+		// Fault generation:
+		//	- Precomputed: fault_plan holds the positions of every image of the dataset
+		//	- Lazy: fault_plan only holds the positions of the image being evaluated
+		//	- Replay: set when fault_plan_in is given, fault_plan only holds the positions of the image being evaluated
+		FaultGeneration fault_generation = FaultGeneration::precomputed;
+
+		// Accumulator caching:
+		//	- None: every Eval computes the whole disturbed layer
+		//	- Memory: accumulator_cache keeps the clean accumulators of the dataset in memory
+		//	- Mapped: set when accumulator_cache_file is given, accumulator_cache keeps them in the file
+		// Later trials of an image only copy its accumulators, add the change of the faulty products and requantize
+		AccumulatorCaching accumulator_caching = AccumulatorCaching::none;
+
+		// Activation caching:
+		//	- None: the layers before the first delegated node run on every invoke
+		//	- Capture: the first delegated node writes its input for every image of the dataset
+		//	- Replay: the layers before it are skipped and its input is copied from the capture
+		// The capture only depends on the model and the dataset, a single capture serves every campaign
+		ActivationCaching activation_caching = ActivationCaching::none;
+
+		// Golden caching:
+		//	- None: the layers after the last faulty node run on every invoke
+		//	- Capture: the model runs without faults and its outputs are written for every image of the dataset
+		//	- Replay: when a fault is masked the outputs of the model are copied from the capture
+		// The layers after the last faulty node are evaluated by their TFLite kernels inside the delegate
+		GoldenCaching golden_caching = GoldenCaching::none;
+
+		// Seed of the counter-based generator of the error positions
+		// Drawn from std::random_device when it is not given
+		unsigned long long seed = 0;
+
 		// Bit position to be flipped
+		// Bit of the int8 weight in image_weights mode, in [0, 7]
 		int bit_position = -1;
 
 		// Number of flips per image in the dataset
 		int number_flips = -1;
+
+		// Evaluates every bit position in a single pass, only in convolution mode
+		// Sample k of a group of samples holding the same image gets the faults of the image with bit k flipped
+		// and bit_position is not used
+		// The disturbed layer accumulates every faulty output once and only requantizes it again per bit
+		bool sweep_bit_positions = false;
+
+		// Number of independent fault sets evaluated on every image in a single pass
+		// The batch is split in groups of samples holding the same image, trials_per_invoke groups of
+		// num_bit_positions samples when sweeping the bit positions and trials_per_invoke samples otherwise
+		// Trial t uses its own stream of the generator, trial 0 gets the same faults as a single trial
+		// The disturbed layer computes the clean output of the image once and only recomputes the faulty outputs per trial
+		int trials_per_invoke = 1;
+
+		// Clean delegated nodes keep the input and the result of the first evaluation of every image
+		// Later evaluations only compute the outputs whose receptive field reaches an input element that differs
+		// from the reference, fully connected nodes add the change of those inputs to the reference accumulators
+		// Needs dataset_size, the references of the whole dataset are kept in memory
+		bool incremental_propagation = false;
+
+		// Probability of flipping the bit of a single multiplication, in (0, 1]
+		// When it is greater than 0 the faults are drawn inside the kernels while iterating
+		// and number_flips, fault_generation and fault_plan are not used
+		// Only used in convolution mode
+		double bit_error_rate = 0.0;
 		
 		// Size of the dataset
 		int dataset_size = 0;
 
-		// Convert into vector if accepting more than one node
+		// Index of the node, every MyDelegateNode has its own copy of the options
 		int node_index = -1;
 
-		// Convert into vector if accepting more than one node
+		// Builtin code of the node
 		int builtin_code = 0;
 
-		// Convert to vector for more than one node
-		// Number of channels of kernel filter to distribute to make use of threads
-		int channels = 0;
-
-		// Convert to vector for more than one node
-		// Size of the chunk of data of indexes to distribute to make use of threads
-		int chunk_size = 0;
-
 		// Number of threads for all processes
+		// Capped by the size of the thread pool
 		int num_threads = max_number_threads;
 
+		// Thread pool owned by MyDelegate and shared by all its kernels
+		// Set in the constructor of MyDelegateKernel
+		ThreadPool* thread_pool = nullptr;
+
 		// Threaded version necessary?
 		bool is_threaded = false;
 
-		// Convert to vector for more than one node
-		// Name pattern of the layer to be affected
-		// If accepting more than one node this logic need to be modified
+		// Name patterns of the layers claimed by the delegate, separated by commas
+		// Every Conv2D and FullyConnected node whose kernel tensor name contains one of them is claimed
+		// Empty claims all of them, except in operation mode none, where only a non-empty list claims the layers
+		// so their faults can be enabled later through the C API
 		std::string layer_name = "";
+
+		// Name patterns of the claimed layers that are disturbed, separated by commas
+		// The rest of the claimed layers run without faults
+		// Empty disturbs all the claimed layers
+		std::string faulty_layer = "";
+
+		// Path of the binary fault plan file written after the positions are generated
+		// Empty to not save the plan
+		std::string fault_plan_out = "";
+
+		// Path of a binary fault plan file written with fault_plan_out
+		// The file is memory mapped and its positions replace the generated ones
+		// Empty to generate the positions from the seed
+		std::string fault_plan_in = "";
+
+		// Path of the accumulator cache file, "{node}" is replaced by the node index
+		// Created if it does not exist, its images are reused when it was written for the same node and weights
+		// Empty to keep the accumulators in memory
+		std::string accumulator_cache_file = "";
+
+		// Path of the activation cache file, "{node}" is replaced by the node index
+		// Needed when activation_caching is capture or replay
+		std::string activation_cache_file = "";
+
+		// Path of the golden cache file
+		// Needed when golden_caching is capture or replay
+		std::string golden_cache_file = "";
+
+		// Hash of the constant tensors of the model, computed in MyDelegate::Initialize when activations or golden outputs are cached
+		// A capture is only replayed by the same model
+		unsigned long long model_key = 0;
+
+		// Node whose input is captured or replayed, the first node claimed for its layer name
+		// -1 when activations are not cached
+		int activation_node = -1;
+
+		// Nodes before activation_node that are claimed and skipped when replaying, in execution order
+		std::vector<int> prefix_nodes;
+
+		// Last node disturbed by faulty_layer, its output is compared against the golden capture
+		// -1 when golden outputs are not cached
+		int golden_node = -1;
+
+		// Nodes after golden_node, claimed and evaluated by their TFLite kernels, in execution order
+		std::vector<int> suffix_nodes;
 		
 		// Position vector values of the input tensor
 		// Filled during MyDelegateKernel::Init
@@ -85,22 +305,38 @@ namespace tflite {
 		// Filled during MyDelegateKernel::Init
 		std::vector<int> output_dimensions;
 
-		// Holds the indexes sectioned according to the real positions
-		std::vector<std::vector<std::vector<int>>> chunks_indexes;
-		
-		// Indexes for non-parallel solution
-		std::vector<int> full_indexes;
+		// Error positions of the dataset, built in MyDelegateKernel::Init
+		// Copies of the options share the same plan
+		// Images:
+		//	- dataset_size images of num_flips positions
+		//	- 1 image of num_flips positions per sample of the batch for lazy fault generation and replay
+		//	- No plan for bit error rate faults
+		std::shared_ptr<const FaultPlan> fault_plan;
+
+		// Clean accumulators of the dataset, built in MyDelegateKernel::Init for the disturbed nodes
+		// Filled by the kernels, copies of the options share the same cache
+		// No cache when accumulator_caching is none
+		std::shared_ptr<AccumulatorCache> accumulator_cache;
 
-		// Convert to vector to accept more than one node
-		// Dimensions:
-		//	- dataset_size x num_flips x pairs of int positions
-		std::vector<std::vector<std::pair<int, int>>> error_flat_positions;
+		// Filter of a convolution packed for the GEMM microkernels, built in MyDelegateNode::Prepare when kernel_backend is gemm
+		// No packed filter for grouped convolutions, they use the reference kernel
+		// The weights of a fully connected layer are always packed, its clean accumulators are a GEMV of the packed weights
+		std::shared_ptr<const custom_ops::PackedFilter> packed_filter;
 
-		// Convert to vector to accept more than one node.
-		// They are needed to discriminate the channels for threads.
-		// Dimensions:
-		//	- dataset_size x num_flips x pairs of vector positions
-		std::vector<std::vector<std::pair<std::vector<int>, std::vector<int>>>> error_vec_positions;
+		// Taps of every output pixel of a convolution inside the input, built in MyDelegateNode::Prepare for the size of the sample
+		// Required by the convolution kernels, MyDelegateNode::Eval builds them again if the geometry has changed since Prepare
+		std::shared_ptr<const custom_ops::ConvIndirection> conv_indirection;
+
+		// Kernel of a convolution specialized for its filter size and stride, built in MyDelegateNode::Prepare with the indirection
+		// Required by the convolution kernels, MyDelegateNode::Eval selects it again if the convolution has changed since Prepare
+		std::shared_ptr<const custom_ops::ConvSpecialization> conv_specialization;
+
+		// Reference activations of a clean node, built in MyDelegateNode::Init when incremental_propagation is set
+		// No references for the disturbed nodes, their output changes with every fault set
+		std::shared_ptr<ReferenceActivations> reference_activations;
+
+		// Options changed at runtime, created by MyDelegate and shared by all the copies
+		std::shared_ptr<RuntimeOptions> runtime;
 
 		// Default constructor
 		// Careful, the generator is not seeded by the default constructor
@@ -133,8 +369,38 @@ namespace tflite {
 		// Convert vector position to integer position
 		int convertPositionVec2Int(const std::vector<int>& output_dimensions, const std::vector<int>& vec_position);
 
-		// Custom pair of vector positions sorting
-		bool getPairVecGreater(const std::pair<std::vector<int>, std::vector<int>>& pair1, const std::pair<std::vector<int>, std::vector<int>>& pair2, const std::vector<int>& first_dimensions, const std::vector<int>& second_dimensions);
+		// Error positions of a trial of an image of the batch being evaluated, image dataset_index + image of the dataset
+		// Output positions are relative to the sample
+		FaultSpan getErrorPositions(int image = 0, int trial = 0) const;
+
+		// Gets the range [first, last) of error positions of an image whose output position is in [start, end)
+		// Binary search, error positions are sorted in decreasing order
+		void getErrorRange(int start, int end, int& first, int& last, int image = 0) const;
+
+		// Index of the fault set of a trial of an image of the dataset, in the fault plan and in fault plan files
+		int getFaultSetIndex(int image, int trial) const;
+
+		// Seed of the generator of a trial, trial 0 uses seed
+		unsigned long long getTrialSeed(int trial) const;
+
+		// Checks if the delegated nodes are disturbed, in convolution or image_weights mode
+		bool isDelegatedMode() const;
+
+		// Checks if the disturbed layer evaluates several samples of every image in a single pass
+		bool isGrouped() const;
+
+		// Number of output variants of every trial, one per bit position when sweeping them
+		int getBitVariants() const;
+
+		// Number of samples of the batch that share the same image of the dataset
+		int getSamplesPerImage() const;
+
+		// Number of samples filled by every image when the delegate disturbs its nodes in the operation mode
+		// The batch is grouped for the whole model, so it does not depend on the node being disturbed
+		int getGroupSize(OperationMode delegate_mode) const;
+
+		// Checks if a tensor name contains one of the comma separated patterns, an empty list matches everything
+		static bool matchLayerName(const char* tensor_name, const std::string& patterns);
 
 		// Logger function of MyDelegateOptions
 		void Log() const;
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace tflite {
+
+	// PhiloxRandom
+	// Counter-based random number generator Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+	// Every output only depends on the key and the counter, so any stream can be reproduced
+	// without generating the previous ones
+	// The 64 bits seed is the key, the stream identifiers are the upper half of the counter,
+	// the substream is the second word and the first word counts the blocks drawn from the substream
+	class PhiloxRandom
+	{
+	public:
+		using result_type = uint32_t;
+
+		/// <summary>
+		/// Constructor<para/>
+		///	&#009; - Same seed and stream identifiers always produce the same sequence
+		/// </summary>
+		/// <param name="seed">: Key of the generator</param>
+		/// <param name="stream_high">: First identifier of the stream, e.g. the node index</param>
+		/// <param name="stream_low">: Second identifier of the stream, e.g. the dataset index</param>
+		/// <param name="substream">: Identifier inside the stream, e.g. the tile index</param>
+		PhiloxRandom(uint64_t seed, uint32_t stream_high, uint32_t stream_low, uint32_t substream = 0)
+			: key_{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) },
+			counter_{ 0, substream, stream_low, stream_high }
+		{
+		}
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+		// Next 32 bits random value
+		result_type operator()()
+		{
+			if (used_ == 4)
+			{
+				GenerateBlock();
+				used_ = 0;
+			}
+			return block_[used_++];
+		}
+
+		// Unbiased random integer in [0, range)
+		// Implemented here instead of std::uniform_int_distribution because the standard
+		// distributions are not guaranteed to give the same values across compilers
+		int Uniform(int range)
+		{
+			// Lemire's multiply and reject method
+			uint64_t product = static_cast<uint64_t>(operator()()) * static_cast<uint32_t>(range);
+			uint32_t low = static_cast<uint32_t>(product);
+			if (low < static_cast<uint32_t>(range))
+			{
+				const uint32_t threshold = (0u - static_cast<uint32_t>(range)) % static_cast<uint32_t>(range);
+				while (low < threshold)
+				{
+					product = static_cast<uint64_t>(operator()()) * static_cast<uint32_t>(range);
+					low = static_cast<uint32_t>(product);
+				}
+			}
+			return static_cast<int>(product >> 32);
+		}
+
+		// Unbiased random integer in [0, range) for ranges that do not fit in 32 bits
+		long long Uniform64(long long range)
+		{
+			if (range <= 0x7FFFFFFFll)
+				return Uniform(static_cast<int>(range));
+
+			// Rejection of the last incomplete interval
+			const uint64_t unsigned_range = static_cast<uint64_t>(range);
+			const uint64_t limit = UINT64_MAX - UINT64_MAX % unsigned_range;
+			uint64_t value;
+			do
+			{
+				// Two statements, the order of evaluation of the operands is not specified
+				value = static_cast<uint64_t>(operator()()) << 32;
+				value |= operator()();
+			} while (value >= limit);
+			return static_cast<long long>(value % unsigned_range);
+		}
+
+		// Uniform random double in (0, 1] with 53 bits of resolution
+		double UniformDouble()
+		{
+			const uint64_t high = operator()() >> 5;
+			const uint64_t low = operator()() >> 6;
+			return static_cast<double>((high << 26) + low + 1) * (1.0 / 9007199254740992.0);
+		}
+
+		// Number of failed Bernoulli trials before the first success
+		// log_complement = log(1 - probability), computed once by the caller
+		long long Geometric(double log_complement)
+		{
+			// Inversion of the geometric distribution, capped to avoid overflowing with tiny probabilities
+			const double skip = std::floor(std::log(UniformDouble()) / log_complement);
+			return static_cast<long long>(std::min(skip, 1e18));
+		}
+
+	private:
+		// Computes the next 4 values and increases the block counter
+		void GenerateBlock()
+		{
+			constexpr uint32_t kMultiplier0 = 0xD2511F53u;
+			constexpr uint32_t kMultiplier1 = 0xCD9E8D57u;
+			constexpr uint32_t kWeyl0 = 0x9E3779B9u;
+			constexpr uint32_t kWeyl1 = 0xBB67AE85u;
+
+			uint32_t x[4] = { counter_[0], counter_[1], counter_[2], counter_[3] };
+			uint32_t k[2] = { key_[0], key_[1] };
+			for (int round = 0; round < 10; ++round)
+			{
+				const uint64_t product0 = static_cast<uint64_t>(kMultiplier0) * x[0];
+				const uint64_t product1 = static_cast<uint64_t>(kMultiplier1) * x[2];
+				const uint32_t y0 = static_cast<uint32_t>(product1 >> 32) ^ x[1] ^ k[0];
+				const uint32_t y1 = static_cast<uint32_t>(product1);
+				const uint32_t y2 = static_cast<uint32_t>(product0 >> 32) ^ x[3] ^ k[1];
+				const uint32_t y3 = static_cast<uint32_t>(product0);
+				x[0] = y0;
+				x[1] = y1;
+				x[2] = y2;
+				x[3] = y3;
+				k[0] += kWeyl0;
+				k[1] += kWeyl1;
+			}
+			block_[0] = x[0];
+			block_[1] = x[1];
+			block_[2] = x[2];
+			block_[3] = x[3];
+
+			// Every substream has 2^32 blocks
+			++counter_[0];
+		}
+
+		// Key of the generator
+		uint32_t key_[2];
+
+		// Counter of the generator
+		uint32_t counter_[4];
+
+		// Last computed block of values
+		uint32_t block_[4] = { 0, 0, 0, 0 };
+
+		// Number of values of the block already returned
+		int used_ = 4;
+	};
+
+}
\ No newline at end of file
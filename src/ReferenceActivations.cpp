@@ -0,0 +1,48 @@
+#include "ReferenceActivations.h"
+
+#include <cstring>
+
+namespace tflite {
+
+	ReferenceActivations::ReferenceActivations(int num_images, size_t input_bytes, size_t result_bytes)
+		: input_bytes_(input_bytes),
+		result_bytes_(result_bytes),
+		images_(num_images > 0 ? num_images : 0)
+	{
+	}
+
+	const unsigned char* ReferenceActivations::getInput(int image) const
+	{
+		if (image < 0 || image >= static_cast<int>(images_.size()) || images_[image].empty())
+			return nullptr;
+		return images_[image].data();
+	}
+
+	const unsigned char* ReferenceActivations::getResult(int image) const
+	{
+		if (image < 0 || image >= static_cast<int>(images_.size()) || images_[image].empty())
+			return nullptr;
+		return images_[image].data() + input_bytes_;
+	}
+
+	void ReferenceActivations::Store(int image, const void* input, const void* result)
+	{
+		if (image < 0 || image >= static_cast<int>(images_.size()))
+			return;
+		std::vector<unsigned char>& storage = images_[image];
+		storage.resize(input_bytes_ + result_bytes_);
+		std::memcpy(storage.data(), input, input_bytes_);
+		std::memcpy(storage.data() + input_bytes_, result, result_bytes_);
+	}
+
+	size_t ReferenceActivations::getInputBytes() const
+	{
+		return input_bytes_;
+	}
+
+	size_t ReferenceActivations::getResultBytes() const
+	{
+		return result_bytes_;
+	}
+
+}
\ No newline at end of file
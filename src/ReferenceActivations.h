@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace tflite {
+
+	// ReferenceActivations
+	// Input sample and result of the first evaluation of every image of the dataset for a single clean node
+	// A later evaluation of the same image only differs where an upstream fault reached the input,
+	// so only the results that depend on the changed input elements are computed again
+	// Any pair of input and result is a valid reference, it does not need to be the clean one
+	// The images are kept in memory and only allocated when they are stored
+	class ReferenceActivations
+	{
+	public:
+		/// <summary>
+		/// Constructor<para/>
+		///	&#009; - Every image starts empty
+		/// </summary>
+		/// <param name="num_images">: Number of images of the dataset</param>
+		/// <param name="input_bytes">: Bytes of a single input sample</param>
+		/// <param name="result_bytes">: Bytes of the result of a single sample, outputs or accumulators</param>
+		ReferenceActivations(int num_images, size_t input_bytes, size_t result_bytes);
+
+		ReferenceActivations(const ReferenceActivations&) = delete;
+		ReferenceActivations& operator=(const ReferenceActivations&) = delete;
+
+		// Input sample of an image, nullptr if the image has no reference
+		const unsigned char* getInput(int image) const;
+
+		// Result of an image, nullptr if the image has no reference
+		const unsigned char* getResult(int image) const;
+
+		// Copies the input sample and the result of an image, ignored if the image is not in the dataset
+		void Store(int image, const void* input, const void* result);
+
+		// Bytes of a single input sample
+		size_t getInputBytes() const;
+
+		// Bytes of the result of a single sample
+		size_t getResultBytes() const;
+
+	private:
+		// Bytes of a single input sample
+		size_t input_bytes_ = 0;
+
+		// Bytes of the result of a single sample
+		size_t result_bytes_ = 0;
+
+		// Input followed by the result of every image, empty until the image is stored
+		std::vector<std::vector<unsigned char>> images_;
+	};
+
+}
\ No newline at end of file
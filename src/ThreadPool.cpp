@@ -0,0 +1,126 @@
+#include "ThreadPool.h"
+
+namespace tflite {
+
+	ThreadPool::ThreadPool(int num_threads)
+		: ranges_(new TileRange[std::max(num_threads, 1)])
+	{
+		// The calling thread of ParallelFor is always participant 0
+		for (int i = 1; i < num_threads; ++i)
+		{
+			workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		start_condition_.notify_all();
+		for (auto& worker : workers_)
+		{
+			worker.join();
+		}
+	}
+
+	int ThreadPool::getNumThreads() const
+	{
+		return static_cast<int>(workers_.size()) + 1;
+	}
+
+	void ThreadPool::ParallelFor(int num_tiles, int max_threads, const std::function<void(int)>& task)
+	{
+		if (num_tiles <= 0)
+			return;
+
+		const int active_threads = std::max(1, std::min({ max_threads, getNumThreads(), num_tiles }));
+		if (active_threads == 1)
+		{
+			// Not worth waking up the workers
+			for (int tile = 0; tile < num_tiles; ++tile)
+			{
+				task(tile);
+			}
+			return;
+		}
+
+		std::lock_guard<std::mutex> call_lock(call_mutex_);
+
+		// Every participant starts with a contiguous range of tiles
+		const int tiles_per_thread = num_tiles / active_threads;
+		const int remainder = num_tiles % active_threads;
+		int start = 0;
+		for (int i = 0; i < active_threads; ++i)
+		{
+			const int size = tiles_per_thread + (i < remainder ? 1 : 0);
+			ranges_[i].next.store(start, std::memory_order_relaxed);
+			ranges_[i].end = start + size;
+			start += size;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			task_ = &task;
+			active_threads_ = active_threads;
+			pending_workers_ = active_threads - 1;
+			generation_++;
+		}
+		start_condition_.notify_all();
+
+		RunTiles(0);
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_condition_.wait(lock, [this] { return pending_workers_ == 0; });
+		task_ = nullptr;
+	}
+
+	void ThreadPool::WorkerLoop(int participant)
+	{
+		unsigned long long seen_generation = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				start_condition_.wait(lock, [this, seen_generation] { return stop_ || generation_ != seen_generation; });
+				if (stop_)
+					return;
+				seen_generation = generation_;
+				// Workers beyond the number of participants skip this call
+				if (participant >= active_threads_)
+					continue;
+			}
+
+			RunTiles(participant);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				pending_workers_--;
+				if (pending_workers_ == 0)
+				{
+					done_condition_.notify_one();
+				}
+			}
+		}
+	}
+
+	void ThreadPool::RunTiles(int participant)
+	{
+		const std::function<void(int)>& task = *task_;
+		const int active_threads = active_threads_;
+
+		// Own range first, then steal from the ranges of the other participants
+		for (int i = 0; i < active_threads; ++i)
+		{
+			TileRange& range = ranges_[(participant + i) % active_threads];
+			int tile = range.next.fetch_add(1, std::memory_order_relaxed);
+			while (tile < range.end)
+			{
+				task(tile);
+				tile = range.next.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tflite {
+
+	// ThreadPool
+	// Long-lived pool of workers owned by MyDelegate and shared with every MyDelegateKernel
+	// The work is split in tiles, every participant starts with a contiguous range of tiles
+	// and once it is finished it steals the remaining tiles of the other participants
+	class ThreadPool
+	{
+	public:
+		/// <summary>
+		/// Constructor<para/>
+		///	&#009; - The calling thread is counted as a participant, so only num_threads - 1 workers are created
+		/// </summary>
+		/// <param name="num_threads">: Total number of threads that can work on a ParallelFor call</param>
+		ThreadPool(int num_threads);
+
+		// ThreadPool destructor, joins all the workers
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Total number of threads that can work on a ParallelFor call, calling thread included
+		int getNumThreads() const;
+
+		/// <summary>
+		/// Runs task(tile) for every tile in [0, num_tiles) and returns when all of them are finished<para/>
+		///	&#009; - The calling thread works as participant 0
+		/// </summary>
+		/// <param name="num_tiles">: Number of tiles to be processed</param>
+		/// <param name="max_threads">: Maximum number of participants for this call</param>
+		/// <param name="task">: Function that processes a single tile</param>
+		void ParallelFor(int num_tiles, int max_threads, const std::function<void(int)>& task);
+
+	private:
+		// Range of tiles owned by a participant, aligned to avoid false sharing of the cursors
+		struct alignas(64) TileRange
+		{
+			std::atomic<int> next;
+			int end;
+		};
+
+		// Loop executed by the workers of the pool
+		void WorkerLoop(int participant);
+
+		// Processes the own range of tiles and then steals from the other participants
+		void RunTiles(int participant);
+
+		// Workers of the pool, participant i is workers_[i - 1]
+		std::vector<std::thread> workers_;
+
+		// Ranges of tiles, one per participant
+		std::unique_ptr<TileRange[]> ranges_;
+
+		// Task of the current ParallelFor call
+		const std::function<void(int)>* task_ = nullptr;
+
+		// Number of participants of the current ParallelFor call
+		int active_threads_ = 0;
+
+		// Workers that still have not finished the current ParallelFor call
+		int pending_workers_ = 0;
+
+		// Incremented on every ParallelFor call to wake up the workers
+		unsigned long long generation_ = 0;
+
+		// Stops the workers on destruction
+		bool stop_ = false;
+
+		// Protects the state shared with the workers
+		std::mutex mutex_;
+
+		// Serializes concurrent ParallelFor callers
+		std::mutex call_mutex_;
+
+		// Signals the workers that there is a new ParallelFor call
+		std::condition_variable start_condition_;
+
+		// Signals the calling thread that all the workers are finished
+		std::condition_variable done_condition_;
+	};
+
+}
@@ -0,0 +1,353 @@
+#include "ConvOps.h"
+#include "Gemm.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Compares every backend of the disturbed convolution with a naive reference convolution
+// The layers and the error positions are drawn from a fixed seed, so a failure is reproduced on every run
+// The process returns the number of failed comparisons
+
+namespace tflite {
+	namespace kernel_check {
+
+		constexpr unsigned int kSeed = 2024;
+		constexpr int kLayers = 60;
+		constexpr int kImages = 2;
+		constexpr int kTrials = 2;
+		constexpr int kFaultsPerSample = 8;
+
+		// Quantized per channel convolution of random geometry, data and requantization
+		struct ConvLayer
+		{
+			ConvParams params{};
+			int input_height = 0;
+			int input_width = 0;
+			int input_depth = 0;
+			int filter_height = 0;
+			int filter_width = 0;
+			int output_height = 0;
+			int output_width = 0;
+			int output_depth = 0;
+
+			// Samples of the batch, every image is repeated samples_per_image times
+			int samples = 0;
+			int samples_per_image = 1;
+
+			std::vector<int8_t> input;
+			std::vector<int8_t> filter;
+			std::vector<int32_t> bias;
+			std::vector<int32_t> output_multiplier;
+			std::vector<int32_t> output_shift;
+
+			RuntimeShape getInputShape() const { return RuntimeShape({ samples, input_height, input_width, input_depth }); }
+			RuntimeShape getFilterShape() const { return RuntimeShape({ output_depth, filter_height, filter_width, input_depth }); }
+			RuntimeShape getBiasShape() const { return RuntimeShape({ output_depth }); }
+			RuntimeShape getOutputShape() const { return RuntimeShape({ samples, output_height, output_width, output_depth }); }
+			int getSampleSize() const { return output_height * output_width * output_depth; }
+			int getKernelSize() const { return filter_height * filter_width * input_depth; }
+		};
+
+		ConvLayer MakeLayer(std::mt19937& rng, int images, int samples_per_image)
+		{
+			ConvLayer layer;
+			do
+			{
+				layer.filter_height = rng() % 4 ? 1 + rng() % 3 : 5;
+				layer.filter_width = rng() % 4 ? layer.filter_height : 1 + rng() % 3;
+				layer.input_height = 1 + rng() % 12;
+				layer.input_width = 1 + rng() % 12;
+				layer.input_depth = 1 + rng() % 48;
+				layer.output_depth = 1 + rng() % 48;
+
+				ConvParams& params = layer.params;
+				params.stride_height = params.stride_width = 1 + rng() % 2;
+				params.dilation_height_factor = params.dilation_width_factor = rng() % 4 ? 1 : 2;
+				const bool same_padding = rng() % 2;
+				params.padding_values.height = same_padding ? params.dilation_height_factor * (layer.filter_height / 2) : 0;
+				params.padding_values.width = same_padding ? params.dilation_width_factor * (layer.filter_width / 2) : 0;
+
+				const int effective_height = params.dilation_height_factor * (layer.filter_height - 1) + 1;
+				const int effective_width = params.dilation_width_factor * (layer.filter_width - 1) + 1;
+				layer.output_height = (layer.input_height + 2 * params.padding_values.height - effective_height) / params.stride_height + 1;
+				layer.output_width = (layer.input_width + 2 * params.padding_values.width - effective_width) / params.stride_width + 1;
+			} while (layer.input_height + 2 * layer.params.padding_values.height < layer.params.dilation_height_factor * (layer.filter_height - 1) + 1 ||
+				layer.input_width + 2 * layer.params.padding_values.width < layer.params.dilation_width_factor * (layer.filter_width - 1) + 1);
+
+			ConvParams& params = layer.params;
+			params.input_offset = static_cast<int32_t>(rng() % 256) - 128;
+			params.output_offset = static_cast<int32_t>(rng() % 20) - 10;
+			params.quantized_activation_min = -128;
+			params.quantized_activation_max = 127;
+
+			layer.samples = images * samples_per_image;
+			layer.samples_per_image = samples_per_image;
+
+			const int image_size = layer.input_height * layer.input_width * layer.input_depth;
+			layer.input.resize(layer.samples * image_size);
+			for (int image = 0; image < images; ++image)
+			{
+				int8_t* image_input = layer.input.data() + image * samples_per_image * image_size;
+				for (int i = 0; i < image_size; ++i)
+					image_input[i] = static_cast<int8_t>(rng());
+				for (int sample = 1; sample < samples_per_image; ++sample)
+					std::copy(image_input, image_input + image_size, image_input + sample * image_size);
+			}
+
+			layer.filter.resize(layer.output_depth * layer.getKernelSize());
+			for (int8_t& value : layer.filter)
+				value = static_cast<int8_t>(rng());
+			for (int out_channel = 0; out_channel < layer.output_depth; ++out_channel)
+			{
+				layer.bias.push_back(static_cast<int32_t>(rng() % 2000) - 1000);
+				layer.output_multiplier.push_back((1 << 30) + static_cast<int32_t>(rng() % (1 << 29)));
+				layer.output_shift.push_back(-static_cast<int32_t>(rng() % 10));
+			}
+			return layer;
+		}
+
+		// Error positions of every sample, sorted in decreasing order like the fault plan expects them
+		// Some positions share their output to exercise the outputs with several faulty products, padded
+		// products may be drawn too and must be ignored by every backend
+		std::shared_ptr<FaultPlan> MakeFaultPlan(std::mt19937& rng, const ConvLayer& layer)
+		{
+			auto plan = std::make_shared<FaultPlan>(layer.samples, static_cast<long long>(layer.samples) * kFaultsPerSample);
+			const int max_faults = std::min(kFaultsPerSample, layer.getSampleSize() * layer.getKernelSize());
+			for (int sample = 0; sample < layer.samples; ++sample)
+			{
+				std::vector<std::pair<int, int>> positions;
+				while (static_cast<int>(positions.size()) < max_faults)
+				{
+					const int output_position = !positions.empty() && rng() % 3 == 0 ? positions.back().first : rng() % layer.getSampleSize();
+					const std::pair<int, int> position(output_position, rng() % layer.getKernelSize());
+					if (std::find(positions.begin(), positions.end(), position) == positions.end())
+						positions.push_back(position);
+				}
+				std::sort(positions.begin(), positions.end(), std::greater<std::pair<int, int>>());
+				plan->AppendImage(positions);
+			}
+			return plan;
+		}
+
+		// Naive convolution of a sample, every faulty product has the bit flipped before it is accumulated
+		void ReferenceConvolution(const ConvLayer& layer, int sample, const FaultSpan& error_positions, int bit_position, int8_t* output)
+		{
+			const ConvParams& params = layer.params;
+			const int8_t* input = layer.input.data() + sample * layer.input_height * layer.input_width * layer.input_depth;
+			std::vector<uint32_t> accumulators(layer.getSampleSize());
+			auto getProduct = [&](int output_position, int kernel_position, uint32_t& product)
+			{
+				const int out_channel = output_position % layer.output_depth;
+				const int out_x = (output_position / layer.output_depth) % layer.output_width;
+				const int out_y = output_position / (layer.output_depth * layer.output_width);
+				const int in_channel = kernel_position % layer.input_depth;
+				const int filter_x = (kernel_position / layer.input_depth) % layer.filter_width;
+				const int filter_y = kernel_position / (layer.input_depth * layer.filter_width);
+				const int in_y = out_y * params.stride_height - params.padding_values.height + params.dilation_height_factor * filter_y;
+				const int in_x = out_x * params.stride_width - params.padding_values.width + params.dilation_width_factor * filter_x;
+				if (in_y < 0 || in_y >= layer.input_height || in_x < 0 || in_x >= layer.input_width)
+					return false;
+				const int32_t input_val = input[(in_y * layer.input_width + in_x) * layer.input_depth + in_channel];
+				const int32_t filter_val = layer.filter[out_channel * layer.getKernelSize() + kernel_position];
+				product = static_cast<uint32_t>(filter_val * (input_val + params.input_offset));
+				return true;
+			};
+
+			for (int output_position = 0; output_position < layer.getSampleSize(); ++output_position)
+			{
+				for (int kernel_position = 0; kernel_position < layer.getKernelSize(); ++kernel_position)
+				{
+					uint32_t product;
+					if (getProduct(output_position, kernel_position, product))
+						accumulators[output_position] += product;
+				}
+			}
+			for (int i = 0; i < error_positions.size; ++i)
+			{
+				uint32_t product;
+				if (getProduct(error_positions.output_positions[i], error_positions.kernel_positions[i], product))
+					accumulators[error_positions.output_positions[i]] += (product ^ (1u << bit_position)) - product;
+			}
+
+			for (int output_position = 0; output_position < layer.getSampleSize(); ++output_position)
+			{
+				const int out_channel = output_position % layer.output_depth;
+				int32_t acc = static_cast<int32_t>(accumulators[output_position]) + layer.bias[out_channel];
+				acc = MultiplyByQuantizedMultiplier(acc, layer.output_multiplier[out_channel], layer.output_shift[out_channel]);
+				acc += params.output_offset;
+				acc = std::max(acc, params.quantized_activation_min);
+				acc = std::min(acc, params.quantized_activation_max);
+				output[output_position] = static_cast<int8_t>(acc);
+			}
+		}
+
+		// Options of a backend, the samples per image are set by the kernel of the delegate on every node
+		MyDelegateOptions MakeOptions(const ConvLayer& layer, const std::shared_ptr<FaultPlan>& plan, int bit_position)
+		{
+			MyDelegateOptions options;
+			if (layer.samples_per_image > 1)
+			{
+				options.operation_mode = OperationMode::convolution;
+				options.trials_per_invoke = layer.samples_per_image;
+			}
+			options.samples_per_image = options.getGroupSize(options.operation_mode);
+			options.bit_position = bit_position;
+			options.fault_plan = plan;
+			return options;
+		}
+
+		int Compare(const char* backend, int layer_index, const std::vector<int8_t>& expected, const std::vector<int8_t>& actual)
+		{
+			int mismatches = 0;
+			for (size_t i = 0; i < expected.size(); ++i)
+			{
+				if (expected[i] != actual[i])
+					mismatches++;
+			}
+			if (mismatches == 0)
+				return 0;
+			std::printf("Layer %d: %s differs from the reference at %d outputs\n", layer_index, backend, mismatches);
+			return 1;
+		}
+
+		int CheckLayer(std::mt19937& rng, ThreadPool& thread_pool, int layer_index, int samples_per_image, bool bit_error_rate_mode)
+		{
+			const ConvLayer layer = MakeLayer(rng, kImages, samples_per_image);
+			const RuntimeShape input_shape = layer.getInputShape();
+			const RuntimeShape filter_shape = layer.getFilterShape();
+			const RuntimeShape bias_shape = layer.getBiasShape();
+			const RuntimeShape output_shape = layer.getOutputShape();
+			const int output_size = output_shape.FlatSize();
+			const int bit_position = rng() % MyDelegateOptions::num_bit_positions;
+			const std::shared_ptr<FaultPlan> plan = bit_error_rate_mode ? nullptr : MakeFaultPlan(rng, layer);
+			const unsigned long long seed = rng();
+
+			// Structures built by MyDelegateNode::Prepare for the layer
+			const custom_ops::ConvGeometry geometry = custom_ops::conv::getConvGeometry(layer.params, input_shape, filter_shape, output_shape);
+			auto conv_indirection = std::make_shared<const custom_ops::ConvIndirection>(geometry);
+			auto conv_specialization = std::make_shared<const custom_ops::ConvSpecialization>(
+				geometry, layer.filter.data(), layer.output_depth, layer.params.input_offset);
+			auto packed_filter = std::make_shared<custom_ops::PackedFilter>();
+			custom_ops::gemm::PackFilter(layer.filter.data(), layer.output_depth, layer.getKernelSize(), *packed_filter);
+
+			auto makeOptions = [&]()
+			{
+				MyDelegateOptions options = MakeOptions(layer, plan, bit_position);
+				options.conv_indirection = conv_indirection;
+				options.conv_specialization = conv_specialization;
+				options.thread_pool = &thread_pool;
+				options.num_threads = 1;
+				if (bit_error_rate_mode)
+				{
+					options.bit_error_rate = 0.002;
+					options.seed = seed;
+					options.node_index = layer_index;
+				}
+				return options;
+			};
+			auto runDisturbed = [&](const MyDelegateOptions& options)
+			{
+				std::vector<int8_t> output(output_size);
+				custom_ops::conv::ConvPerChannelDisturbed(layer.params,
+					layer.output_multiplier.data(), layer.output_shift.data(),
+					input_shape, layer.input.data(), filter_shape, layer.filter.data(),
+					bias_shape, layer.bias.data(), output_shape, output.data(), options);
+				return output;
+			};
+
+			// The positions drawn by the bit error rate are only known to the kernels, so the scalar
+			// backend is the reference of the others
+			const MyDelegateOptions scalar_options = makeOptions();
+			std::vector<int8_t> expected(output_size);
+			if (bit_error_rate_mode)
+			{
+				expected = runDisturbed(scalar_options);
+			}
+			else
+			{
+				for (int sample = 0; sample < layer.samples; ++sample)
+				{
+					ReferenceConvolution(layer, sample, plan->getImage(sample), bit_position, expected.data() + sample * layer.getSampleSize());
+				}
+			}
+
+			int failures = 0;
+			if (!bit_error_rate_mode)
+				failures += Compare("scalar kernel", layer_index, expected, runDisturbed(scalar_options));
+
+			MyDelegateOptions tiled_options = makeOptions();
+			tiled_options.num_threads = 4;
+			tiled_options.is_threaded = true;
+			failures += Compare("tiled kernel", layer_index, expected, runDisturbed(tiled_options));
+
+			// The clean pass and the recompute of the faulty outputs only support one sample per image
+			if (samples_per_image == 1)
+			{
+				const MyDelegateOptions hybrid_options = makeOptions();
+				std::vector<int8_t> output(output_size);
+				custom_ops::conv::ConvPerChannel(layer.params,
+					layer.output_multiplier.data(), layer.output_shift.data(),
+					input_shape, layer.input.data(), filter_shape, layer.filter.data(),
+					bias_shape, layer.bias.data(), output_shape, output.data(), hybrid_options);
+				custom_ops::conv::RecomputeDisturbedOutputs(layer.params,
+					layer.output_multiplier.data(), layer.output_shift.data(),
+					input_shape, layer.input.data(), filter_shape, layer.filter.data(),
+					bias_shape, layer.bias.data(), output_shape, output.data(), hybrid_options);
+				failures += Compare("hybrid recompute", layer_index, expected, output);
+			}
+
+			MyDelegateOptions gemm_options = makeOptions();
+			gemm_options.packed_filter = packed_filter;
+			{
+				std::vector<int8_t> output(output_size);
+				custom_ops::conv::ConvPerChannelCached(layer.params,
+					layer.output_multiplier.data(), layer.output_shift.data(),
+					input_shape, layer.input.data(), filter_shape, layer.filter.data(),
+					bias_shape, layer.bias.data(), output_shape, output.data(), gemm_options);
+				failures += Compare("GEMM kernel", layer_index, expected, output);
+			}
+
+			// Clean output of the GEMM engine
+			if (!bit_error_rate_mode)
+			{
+				std::vector<int8_t> clean_expected(output_size);
+				for (int sample = 0; sample < layer.samples; ++sample)
+				{
+					ReferenceConvolution(layer, sample, FaultSpan(), bit_position, clean_expected.data() + sample * layer.getSampleSize());
+				}
+				std::vector<int8_t> output(output_size);
+				custom_ops::conv::ConvPerChannelGemm(layer.params,
+					layer.output_multiplier.data(), layer.output_shift.data(),
+					input_shape, layer.input.data(), filter_shape, layer.filter.data(),
+					bias_shape, layer.bias.data(), output_shape, output.data(), gemm_options);
+				failures += Compare("clean GEMM kernel", layer_index, clean_expected, output);
+			}
+			return failures;
+		}
+
+	}
+}
+
+int main()
+{
+	using namespace tflite::kernel_check;
+
+	std::mt19937 rng(kSeed);
+	tflite::ThreadPool thread_pool(4);
+	int failures = 0;
+	for (int layer_index = 0; layer_index < kLayers; ++layer_index)
+	{
+		// Error positions of the fault plan, a trial per sample and the bit error rate
+		failures += CheckLayer(rng, thread_pool, layer_index, 1, false);
+		failures += CheckLayer(rng, thread_pool, layer_index, kTrials, false);
+		failures += CheckLayer(rng, thread_pool, layer_index, 1, true);
+	}
+	std::printf("%d layers checked, %d failed comparisons\n", 3 * kLayers, failures);
+	return failures;
+}
\ No newline at end of file